@@ -0,0 +1,398 @@
+//
+// Vector and matrix math benchmark
+//
+// Runs the matrix and vector products, cross and dot products and normalizing
+// over arrays of random values, once through the functions of vector.c and
+// matrix.c, once through the inline aligned versions of simd_math.h one value
+// at a time, and once through their batch versions, and reports the time per
+// operation of each and the largest difference from the current functions.
+// Build it with -DSIMD_MATH_SCALAR to measure the inline scalar versions.
+//
+// Then runs the kernels of kernels.c at every level the CPU supports, over a
+// screen sized buffer, and reports their times and whether they give the same
+// pixels as the scalar ones.
+//
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../src/vector.h"
+#include "../src/matrix.h"
+#include "../src/simd_math.h"
+#include "../src/kernels.h"
+
+#define NUM_ITERATIONS 2000
+#define NUM_VECTORS 4096
+#define NUM_MATRICES 1024
+
+#define NUM_KERNEL_PASSES 100
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 600
+#define TEXTURE_SIZE 256
+
+static vec4_t vectors[NUM_VECTORS];
+static vec4_t vector_results[NUM_VECTORS];
+static float dot_results[NUM_VECTORS];
+static mat4_t matrices[NUM_MATRICES];
+static mat4_t matrix_results[NUM_MATRICES];
+
+static vec4a_t aligned_vectors[NUM_VECTORS];
+static vec4a_t aligned_others[NUM_VECTORS];
+static vec4a_t aligned_results[NUM_VECTORS];
+static float aligned_dot_results[NUM_VECTORS];
+static mat4a_t aligned_matrices[NUM_MATRICES];
+static mat4a_t aligned_matrix_results[NUM_MATRICES];
+
+static uint32_t colors[SCREEN_WIDTH * SCREEN_HEIGHT];
+static float depths[SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint32_t scalar_colors[2][SCREEN_WIDTH * SCREEN_HEIGHT];    // Filled and textured
+static float scalar_depths[2][SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint32_t texels[TEXTURE_SIZE * TEXTURE_SIZE];
+static uint32_t expanded_texels[TEXTURE_SIZE * TEXTURE_SIZE];
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Make the compiler assume the results of a pass are read, so it neither skips
+// passes nor merges them into one
+static void end_pass(void) {
+    __asm__ __volatile__("" : : : "memory");
+}
+
+static float random_float(void) {
+    return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+static vec3_t get_vec3(int i) {
+    return vec3_from_vec4(vectors[i]);
+}
+
+// Another vector for the products of two, so a vector is never used with itself
+static vec3_t get_other_vec3(int i) {
+    return vec3_from_vec4(vectors[(i + 1) % NUM_VECTORS]);
+}
+
+static float get_vector_error(const vec4_t* expected, const vec4a_t* results, int count, int num_lanes) {
+    float error = 0;
+    for (int i = 0; i < count; i++) {
+        error = fmaxf(error, fabsf(expected[i].x - results[i].x));
+        error = fmaxf(error, fabsf(expected[i].y - results[i].y));
+        error = fmaxf(error, fabsf(expected[i].z - results[i].z));
+        if (num_lanes == 4)
+            error = fmaxf(error, fabsf(expected[i].w - results[i].w));
+    }
+    return error;
+}
+
+static void print_row(const char* operation, double current_seconds, double inline_seconds, double batch_seconds, int count, float error) {
+    double operations = (double)NUM_ITERATIONS * count;
+    printf("%-22s %12.2f %12.2f", operation, current_seconds * 1e9 / operations, inline_seconds * 1e9 / operations);
+    if (batch_seconds >= 0)
+        printf(" %12.2f", batch_seconds * 1e9 / operations);
+    else
+        printf(" %12s", "-");
+    printf(" %12.2g\n", error);
+}
+
+static void run_mat4_mul_vec4(void) {
+    mat4_t m = matrices[0];
+    mat4a_t aligned_m = mat4a_from_mat4(m);
+
+    double start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            vector_results[i] = mat4_mul_vec4(m, vectors[i]);
+        }
+        end_pass();
+    }
+    double current_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_results[i] = mat4a_mul_vec4a(&aligned_m, aligned_vectors[i]);
+        }
+        end_pass();
+    }
+    double inline_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        mat4a_mul_vec4a_array(&aligned_m, aligned_vectors, aligned_results, NUM_VECTORS);
+        end_pass();
+    }
+    double batch_seconds = now_seconds() - start;
+
+    print_row("mat4 * vec4", current_seconds, inline_seconds, batch_seconds, NUM_VECTORS,
+        get_vector_error(vector_results, aligned_results, NUM_VECTORS, 4));
+}
+
+static void run_mat4_mul_mat4(void) {
+    mat4_t m = matrices[NUM_MATRICES - 1];
+    mat4a_t aligned_m = mat4a_from_mat4(m);
+
+    double start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_MATRICES; i++) {
+            matrix_results[i] = mat4_mul_mat4(m, matrices[i]);
+        }
+        end_pass();
+    }
+    double current_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_MATRICES; i++) {
+            aligned_matrix_results[i] = mat4a_mul_mat4a(&aligned_m, &aligned_matrices[i]);
+        }
+        end_pass();
+    }
+    double inline_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        mat4a_mul_mat4a_array(&aligned_m, aligned_matrices, aligned_matrix_results, NUM_MATRICES);
+        end_pass();
+    }
+    double batch_seconds = now_seconds() - start;
+
+    float error = 0;
+    for (int i = 0; i < NUM_MATRICES; i++) {
+        mat4_t result = mat4_from_mat4a(&aligned_matrix_results[i]);
+        for (int k = 0; k < 16; k++) {
+            error = fmaxf(error, fabsf(matrix_results[i].m[k / 4][k % 4] - result.m[k / 4][k % 4]));
+        }
+    }
+    print_row("mat4 * mat4", current_seconds, inline_seconds, batch_seconds, NUM_MATRICES, error);
+}
+
+static void run_cross(void) {
+    double start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            vector_results[i] = vec4_from_vec3(vec3_cross(get_vec3(i), get_other_vec3(i)));
+        }
+        end_pass();
+    }
+    double current_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_results[i] = vec4a_cross3(aligned_vectors[i], aligned_others[i]);
+        }
+        end_pass();
+    }
+    double inline_seconds = now_seconds() - start;
+
+    print_row("cross", current_seconds, inline_seconds, -1, NUM_VECTORS,
+        get_vector_error(vector_results, aligned_results, NUM_VECTORS, 3));
+}
+
+static void run_dot(void) {
+    double start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            dot_results[i] = vec3_dot(get_vec3(i), get_other_vec3(i));
+        }
+        end_pass();
+    }
+    double current_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_dot_results[i] = vec4a_dot3(aligned_vectors[i], aligned_others[i]);
+        }
+        end_pass();
+    }
+    double inline_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        vec4a_dot3_array(aligned_vectors, aligned_others, aligned_dot_results, NUM_VECTORS);
+        end_pass();
+    }
+    double batch_seconds = now_seconds() - start;
+
+    float error = 0;
+    for (int i = 0; i < NUM_VECTORS; i++) {
+        error = fmaxf(error, fabsf(dot_results[i] - aligned_dot_results[i]));
+    }
+    print_row("dot", current_seconds, inline_seconds, batch_seconds, NUM_VECTORS, error);
+}
+
+static void run_normalize(bool is_fast) {
+    double start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            vec3_t v = get_vec3(i);
+            vec3_normalize(&v);
+            vector_results[i] = vec4_from_vec3(v);
+        }
+        end_pass();
+    }
+    double current_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_results[i] = is_fast ? vec4a_normalize3_fast(aligned_vectors[i]) : vec4a_normalize3(aligned_vectors[i]);
+        }
+        end_pass();
+    }
+    double inline_seconds = now_seconds() - start;
+
+    double batch_seconds = -1;
+    if (is_fast) {
+        // Normalized in place, so passes after the first one normalize unit vectors
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_results[i] = aligned_vectors[i];
+        }
+        start = now_seconds();
+        for (int j = 0; j < NUM_ITERATIONS; j++) {
+            vec4a_normalize3_fast_array(aligned_results, NUM_VECTORS);
+            end_pass();
+        }
+        batch_seconds = now_seconds() - start;
+
+        // The error of normalizing once
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            aligned_results[i] = aligned_vectors[i];
+        }
+        vec4a_normalize3_fast_array(aligned_results, NUM_VECTORS);
+    }
+
+    print_row(is_fast ? "normalize (fast)" : "normalize", current_seconds, inline_seconds, batch_seconds, NUM_VECTORS,
+        get_vector_error(vector_results, aligned_results, NUM_VECTORS, 3));
+}
+
+// Draw every row of the screen as a span of a triangle covering all of it
+static void draw_screen(bool is_textured) {
+    static const texture_t texture = { texels, TEXTURE_SIZE, TEXTURE_SIZE, 1, { texels }, NULL, 0 };
+    vec4_t a = { -10, -10, 0, 2 };
+    vec4_t b = { -10, 1300, 0, 3 };
+    vec4_t c = { 1700, -10, 0, 5 };
+    tex2_t a_uv = { 0, 0 };
+    tex2_t b_uv = { 0, 4 };
+    tex2_t c_uv = { 4, 0 };
+
+    kernels.fill_f32(depths, 1.0, SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t* row_colors = colors + y * SCREEN_WIDTH;
+        float* row_depths = depths + y * SCREEN_WIDTH;
+        if (is_textured)
+            kernels.draw_textured_span(row_colors, row_depths, y, 0, SCREEN_WIDTH, &texture, a, b, c, a_uv, b_uv, c_uv);
+        else
+            kernels.draw_filled_span(row_colors, row_depths, y, 0, SCREEN_WIDTH, 0xFF00FF00, a, b, c);
+    }
+}
+
+// Time drawing the screen, and compare the last one with the scalar kernels
+static double time_screen(bool is_textured, bool* is_same) {
+    double start = now_seconds();
+    for (int j = 0; j < NUM_KERNEL_PASSES; j++) {
+        draw_screen(is_textured);
+        end_pass();
+    }
+    double seconds = now_seconds() - start;
+
+    if (cpu_level == CPU_LEVEL_SCALAR) {
+        memcpy(scalar_colors[is_textured], colors, sizeof(colors));
+        memcpy(scalar_depths[is_textured], depths, sizeof(depths));
+    }
+    *is_same = *is_same &&
+        memcmp(colors, scalar_colors[is_textured], sizeof(colors)) == 0 &&
+        memcmp(depths, scalar_depths[is_textured], sizeof(depths)) == 0;
+    return seconds;
+}
+
+static void run_kernels(cpu_level_t level) {
+    set_kernels_level(level);
+    mat4a_t aligned_m = aligned_matrices[0];
+    bool is_same = true;
+
+    double start = now_seconds();
+    for (int j = 0; j < NUM_KERNEL_PASSES; j++) {
+        kernels.fill_u32(colors, 0xFF000000, SCREEN_WIDTH * SCREEN_HEIGHT);
+        kernels.fill_f32(depths, 1.0, SCREEN_WIDTH * SCREEN_HEIGHT);
+        end_pass();
+    }
+    double clear_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+        kernels.transform_points(&aligned_m, aligned_vectors, aligned_results, NUM_VECTORS);
+        end_pass();
+    }
+    double transform_seconds = now_seconds() - start;
+
+    double filled_seconds = time_screen(false, &is_same);
+    double textured_seconds = time_screen(true, &is_same);
+
+    // Expanding in place leaves RGBA texels, which are expanded again as if
+    // they were RGB ones, since only the time matters
+    start = now_seconds();
+    for (int j = 0; j < NUM_KERNEL_PASSES; j++) {
+        kernels.expand_rgb_texels((unsigned char*)expanded_texels, TEXTURE_SIZE * TEXTURE_SIZE);
+        end_pass();
+    }
+    double expand_seconds = now_seconds() - start;
+
+    double pixels = (double)NUM_KERNEL_PASSES * SCREEN_WIDTH * SCREEN_HEIGHT;
+    printf("%-22s %12.1f %12.2f %12.2f %12.2f %12.2f %12s\n",
+        get_cpu_level_name(level),
+        clear_seconds * 1e6 / NUM_KERNEL_PASSES,
+        transform_seconds * 1e9 / ((double)NUM_ITERATIONS * NUM_VECTORS),
+        filled_seconds * 1e9 / pixels,
+        textured_seconds * 1e9 / pixels,
+        expand_seconds * 1e9 / ((double)NUM_KERNEL_PASSES * TEXTURE_SIZE * TEXTURE_SIZE),
+        is_same ? "yes" : "NO");
+}
+
+int main(void) {
+    srand(1);
+    for (int i = 0; i < NUM_VECTORS; i++) {
+        vectors[i] = (vec4_t){ random_float(), random_float(), random_float(), 1 };
+        aligned_vectors[i] = vec4a_from_vec4(vectors[i]);
+    }
+    for (int i = 0; i < NUM_VECTORS; i++) {
+        aligned_others[i] = vec4a_from_vec4(vectors[(i + 1) % NUM_VECTORS]);
+    }
+    for (int i = 0; i < NUM_MATRICES; i++) {
+        for (int k = 0; k < 16; k++) {
+            matrices[i].m[k / 4][k % 4] = random_float();
+        }
+        aligned_matrices[i] = mat4a_from_mat4(matrices[i]);
+    }
+    for (int i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE; i++) {
+        texels[i] = (uint32_t)rand();
+    }
+
+#if SIMD_MATH_SSE
+    printf("Math benchmark (SSE)\n");
+#else
+    printf("Math benchmark (scalar)\n");
+#endif
+    printf("%-22s %12s %12s %12s %12s\n", "operation", "ns/current", "ns/inline", "ns/batch", "max error");
+    run_mat4_mul_vec4();
+    run_mat4_mul_mat4();
+    run_cross();
+    run_dot();
+    run_normalize(false);
+    run_normalize(true);
+
+    printf("\nKernels\n");
+    printf("%-22s %12s %12s %12s %12s %12s %12s\n", "level", "us/clear", "ns/point", "ns/filled px", "ns/texel px", "ns/expand", "same pixels");
+    cpu_level_t supported_level = get_supported_cpu_level();
+    for (int level = CPU_LEVEL_SCALAR; level <= (int)supported_level; level++) {
+        run_kernels((cpu_level_t)level);
+    }
+    return 0;
+}
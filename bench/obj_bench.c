@@ -0,0 +1,729 @@
+//
+// OBJ loading throughput benchmark
+//
+// Loads every bundled mesh a number of times and reports the file bytes parsed
+// per second. Build it with -DOBJ_LEGACY_PARSER to measure the original fgets
+// and sscanf loader instead of the mapped one.
+// Then writes a large grid mesh and charts how chunked parsing scales from one
+// thread up to the number of CPUs, checking that every result matches the
+// single threaded one. Then compares a cold start, which parses each mesh and
+// writes its cache file, with a warm one that maps the cache. Finally reports
+// the vertex cache miss ratio of every mesh before and after reordering it, and
+// the bytes per triangle and fetch time of the full and the compact vertices,
+// the levels of detail of every mesh with the triangles submitted per frame as
+// it moves away from the camera, how many faces cluster culling skips for
+// views all around each mesh, what composing the world matrices of thousands
+// of instances costs with and without transform nodes, what finding the
+// visible ones costs by scanning every instance or querying the bounding
+// volume hierarchy over them, and how many instances occlusion culling
+// removes behind a ring of walls.
+//
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../src/array.h"
+#include "../src/mesh.h"
+#include "../src/mesh_optimize.h"
+#include "../src/mesh_compact.h"
+#include "../src/mesh_lod.h"
+#include "../src/meshlet.h"
+#include "../src/clipping.h"
+#include "../src/transform.h"
+#include "../src/scene.h"
+#include "../src/bvh.h"
+#include "../src/occlusion.h"
+#include "../src/matrix.h"
+#include "../src/cache.h"
+#include "../src/thread_pool.h"
+
+#define NUM_ITERATIONS 20
+#define NUM_SCALING_ITERATIONS 3
+#define NUM_FETCH_ITERATIONS 200
+#define GRID_SIZE 600
+#define GRID_FILENAME "./bench_obj_grid.obj"
+#define LOD_WINDOW_HEIGHT 600
+#define LOD_NUM_DISTANCES 6
+#define LOD_WINDOW_WIDTH 800
+#define CULL_NUM_VIEWS 64
+#define SCENE_NUM_ITERATIONS 256
+#define SCENE_NUM_VIEWS 16
+#define OCCLUSION_NUM_WALLS 6
+#define OCCLUSION_WALL_DISTANCE 10.0f
+#define OCCLUSION_WALL_WIDTH 4.0f
+#define SCENE_SPACING 4.0f
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+static const char* obj_files[] = {
+    "./assets/cube.obj",
+    "./assets/f22.obj",
+    "./assets/f117.obj",
+    "./assets/efa.obj",
+    "./assets/sphere.obj",
+    "./assets/crab.obj",
+    "./assets/drone.obj"
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#if !defined(OBJ_LEGACY_PARSER)
+
+//
+// Write a flat grid with one vertex and texture coordinate per grid point and
+// two faces per cell, about 45 MB for the default size
+//
+static bool write_grid_obj(const char* filename, int size) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+        return false;
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            fprintf(file, "v %f %f %f\n", x / (float)size - 0.5f, y / (float)size - 0.5f, (x * y % 7) / 70.0f);
+        }
+    }
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            fprintf(file, "vt %f %f\n", x / (float)(size - 1), y / (float)(size - 1));
+        }
+    }
+    for (int y = 0; y < size - 1; y++) {
+        for (int x = 0; x < size - 1; x++) {
+            int a = y * size + x + 1, b = a + 1, c = a + size, d = c + 1;
+            fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, d, d);
+            fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, d, d, c, c);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+static bool is_same_mesh(mesh_t* a, mesh_t* b) {
+    return array_length(a->vertices) == array_length(b->vertices) &&
+        array_length(a->faces) == array_length(b->faces) &&
+        memcmp(a->vertices, b->vertices, sizeof(vertex_t) * array_length(a->vertices)) == 0 &&
+        memcmp(a->faces, b->faces, sizeof(face_t) * array_length(a->faces)) == 0;
+}
+
+//
+// Chart the load time of the grid mesh from one thread up to the CPU count
+//
+static void run_scaling_benchmark(void) {
+    struct stat st;
+    if (!write_grid_obj(GRID_FILENAME, GRID_SIZE) || stat(GRID_FILENAME, &st) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", GRID_FILENAME);
+        return;
+    }
+
+    thread_pool_init(0);
+    int num_cpus = thread_pool_size();
+    thread_pool_destroy();
+    int max_threads = num_cpus > 4 ? num_cpus : 4;
+
+    printf("\nchunked load of a %.1f MB grid, %d CPU(s)\n", st.st_size / 1e6, num_cpus);
+    mesh_t reference = { .vertices = NULL, .faces = NULL };
+    double serial_seconds = 0;
+
+    for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        thread_pool_init(num_threads);
+
+        mesh_t mesh = { .vertices = NULL, .faces = NULL };
+        double best_seconds = 0;
+        for (int j = 0; j < NUM_SCALING_ITERATIONS; j++) {
+            array_free(mesh.vertices);
+            array_free(mesh.faces);
+            mesh.vertices = NULL;
+            mesh.faces = NULL;
+
+            double start = now_seconds();
+            load_obj_mesh(GRID_FILENAME, &mesh);
+            double seconds = now_seconds() - start;
+            if (j == 0 || seconds < best_seconds)
+                best_seconds = seconds;
+        }
+        thread_pool_destroy();
+
+        bool is_identical = true;
+        if (num_threads == 1) {
+            reference = mesh;
+            serial_seconds = best_seconds;
+        } else {
+            is_identical = is_same_mesh(&reference, &mesh);
+            array_free(mesh.vertices);
+            array_free(mesh.faces);
+        }
+
+        double speedup = serial_seconds / best_seconds;
+        char bar[64];
+        int bar_length = (int)(speedup * 10 + 0.5);
+        bar_length = bar_length < (int)sizeof(bar) - 1 ? bar_length : (int)sizeof(bar) - 1;
+        memset(bar, '#', bar_length);
+        bar[bar_length] = '\0';
+        printf("%2d thread(s) %9.2f ms %8.1f MB/s %5.2fx %-9s |%s\n", num_threads, best_seconds * 1000.0,
+            st.st_size / best_seconds / 1e6, speedup, is_identical ? "identical" : "DIFFERENT", bar);
+    }
+
+    array_free(reference.vertices);
+    array_free(reference.faces);
+    remove(GRID_FILENAME);
+}
+
+//
+// Time loading every mesh without a cache file and then through the one written
+//
+static void run_cache_benchmark(int num_files) {
+    printf("\n%-22s %10s %12s %12s\n", "mesh cache", "bytes", "cold ms", "warm ms");
+    for (int i = 0; i < num_files; i++) {
+        char cache_filename[1024];
+        snprintf(cache_filename, sizeof(cache_filename), "%s%s", obj_files[i], CACHE_EXTENSION);
+        remove(cache_filename);
+
+        double seconds[2];
+        bool is_mapped = false;
+        for (int pass = 0; pass < 2; pass++) {
+            mesh_t mesh = { .vertices = NULL, .faces = NULL };
+            double start = now_seconds();
+            mesh_load_options_t options = get_mesh_load_options();
+            load_obj_mesh_cached(obj_files[i], &mesh, &options);
+            seconds[pass] = now_seconds() - start;
+            is_mapped = mesh.mapping != NULL;
+            free_mesh(&mesh);
+        }
+
+        struct stat st;
+        long size = stat(cache_filename, &st) == 0 ? (long)st.st_size : 0;
+        printf("%-22s %10ld %12.3f %12.3f%s\n", obj_files[i], size, seconds[0] * 1000.0, seconds[1] * 1000.0,
+            is_mapped ? "" : " (not mapped)");
+    }
+}
+
+//
+// Report the average cache miss ratio of every mesh in file order and in the
+// order optimize_mesh_order picks, and the time the reordering takes
+//
+static void run_vertex_cache_benchmark(int num_files) {
+    printf("\n%-22s %10s %10s %10s %12s\n", "vertex cache", "vertices", "ACMR", "optimized", "ms/reorder");
+    for (int i = 0; i < num_files; i++) {
+        mesh_t mesh = { .vertices = NULL, .faces = NULL };
+        if (!load_obj_mesh(obj_files[i], &mesh))
+            continue;
+
+        float acmr = compute_mesh_acmr(&mesh, ACMR_CACHE_SIZE);
+        double start = now_seconds();
+        optimize_mesh_order(&mesh);
+        double seconds = now_seconds() - start;
+        float optimized_acmr = compute_mesh_acmr(&mesh, ACMR_CACHE_SIZE);
+
+        printf("%-22s %10d %10.3f %10.3f %12.3f\n", obj_files[i], array_length(mesh.vertices), acmr, optimized_acmr, seconds * 1000.0);
+        free_mesh(&mesh);
+    }
+}
+
+//
+// Time fetching the vertices of every face the way the render loop does, and
+// return a checksum so the work cannot be optimised away
+//
+static float fetch_faces(const mesh_t* mesh, double* seconds) {
+    float sum = 0;
+    double start = now_seconds();
+    for (int j = 0; j < NUM_FETCH_ITERATIONS; j++) {
+        int num_faces = get_mesh_num_faces(mesh, 0);
+        for (int i = 0; i < num_faces; i++) {
+            vertex_t vertices[3];
+            get_mesh_face_vertices(mesh, 0, i, vertices);
+            sum += vertices[0].position.x + vertices[1].uv.u + vertices[2].position.z;
+        }
+    }
+    *seconds = now_seconds() - start;
+    return sum;
+}
+
+//
+// Compare the full and the compact vertices of every mesh: bytes the render
+// loop reads per triangle, time to fetch a face and the largest position error
+// relative to the size of the mesh
+//
+static void run_compact_benchmark(int num_files) {
+    printf("\n%-22s %10s %10s %10s %10s %10s\n", "compact mesh", "B/tri", "compact", "ns/face", "compact", "max error");
+    for (int i = 0; i < num_files; i++) {
+        mesh_t mesh = { .vertices = NULL, .faces = NULL };
+        if (!load_obj_mesh(obj_files[i], &mesh))
+            continue;
+        compute_mesh_bounds(&mesh);
+
+        double seconds, compact_seconds;
+        volatile float checksum = fetch_faces(&mesh, &seconds);
+        compact_mesh(&mesh);
+        checksum += fetch_faces(&mesh, &compact_seconds);
+        (void)checksum;
+
+        vec3_t extent = vec3_sub(mesh.bounds_max, mesh.bounds_min);
+        float size = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+        float max_error = 0;
+        for (int f = 0; f < array_length(mesh.faces); f++) {
+            vertex_t vertices[3];
+            get_mesh_face_vertices(&mesh, 0, f, vertices);
+            const int corners[3] = { mesh.faces[f].a, mesh.faces[f].b, mesh.faces[f].c };
+            for (int j = 0; j < 3; j++) {
+                float error = vec3_length(vec3_sub(vertices[j].position, mesh.vertices[corners[j]].position));
+                max_error = fmaxf(max_error, error / size);
+            }
+        }
+
+        double num_fetches = (double)array_length(mesh.faces) * NUM_FETCH_ITERATIONS;
+        printf("%-22s %10.1f %10.1f %10.2f %10.2f %10.1e\n", obj_files[i], get_mesh_bytes_per_face(&mesh, false),
+            get_mesh_bytes_per_face(&mesh, true), seconds * 1e9 / num_fetches, compact_seconds * 1e9 / num_fetches, max_error);
+        free_mesh(&mesh);
+    }
+}
+
+//
+// Build the levels of detail of every mesh and report their faces and errors,
+// then move the mesh away from the camera, its size doubling the distance each
+// step, and report the triangles submitted per frame with levels of detail on
+// and off. The selection carries over between steps like it does between frames.
+//
+static void run_lod_benchmark(int num_files) {
+    printf("\n%-22s %10s %10s %12s  %s\n", "level of detail", "levels", "max error", "ms/build", "faces per level");
+    mesh_t meshes[sizeof(obj_files) / sizeof(obj_files[0])];
+    for (int i = 0; i < num_files; i++) {
+        mesh_t empty = { .vertices = NULL, .faces = NULL };
+        meshes[i] = empty;
+        mesh_t* mesh = &meshes[i];
+        if (!load_obj_mesh(obj_files[i], mesh))
+            continue;
+        if (use_vertex_cache_order)
+            optimize_mesh_order(mesh);
+        compute_mesh_bounds(mesh);
+
+        double start = now_seconds();
+        build_mesh_lods(mesh, use_vertex_cache_order);
+        double seconds = now_seconds() - start;
+
+        vec3_t extent = vec3_sub(mesh->bounds_max, mesh->bounds_min);
+        float radius = vec3_length(extent) * 0.5f;
+        printf("%-22s %10d %9.2f%% %12.3f ", obj_files[i], mesh->num_lods,
+            radius > 0 ? mesh->lod_errors[mesh->num_lods - 1] / radius * 100.0f : 0.0f, seconds * 1000.0);
+        for (int level = 0; level < mesh->num_lods; level++) {
+            printf(" %d", array_length(mesh->lods[level]));
+        }
+        printf("\n");
+    }
+
+    float projection_scale = 1.0f / tanf(M_PI / 6.0f) * LOD_WINDOW_HEIGHT / 2.0f;
+    printf("\n%-22s", "triangles (on/off)");
+    for (int step = 0; step < LOD_NUM_DISTANCES; step++) {
+        printf(" %12.0fx", 1.0f * (2 << step));
+    }
+    printf("\n");
+
+    for (int i = 0; i < num_files; i++) {
+        mesh_t* mesh = &meshes[i];
+        if (mesh->faces == NULL)
+            continue;
+
+        // Centre the mesh in front of the camera at a multiple of its radius
+        vec3_t center = vec3_mul(vec3_add(mesh->bounds_min, mesh->bounds_max), 0.5f);
+        float radius = vec3_length(vec3_sub(mesh->bounds_max, mesh->bounds_min)) * 0.5f;
+        printf("%-22s", obj_files[i]);
+        int lod = 0;
+        for (int step = 0; step < LOD_NUM_DISTANCES; step++) {
+            float distance = radius * (2 << step);
+            mat4_t world_view_matrix = mat4_mul_mat4(mat4_make_translation(0, 0, distance),
+                mat4_make_translation(-center.x, -center.y, -center.z));
+            lod = select_mesh_lod(mesh, lod, world_view_matrix, projection_scale);
+
+            int num_faces;
+            get_mesh_lod_faces(mesh, lod, &num_faces);
+            printf(" %6d/%6d", num_faces, array_length(mesh->faces));
+        }
+        printf("\n");
+        free_mesh(mesh);
+    }
+}
+
+//
+// Count the faces of a mesh seen from an eye looking at a target, walking the
+// clusters like the render loop: faces tested one by one after cluster culling,
+// faces that test leaves and faces facing the camera inside clusters that were
+// culled, which has to stay 0
+//
+static void cull_view(const mesh_t* mesh, vec3_t eye, vec3_t target, int* num_tested, int* num_visible, int* num_lost) {
+    vec3_t up = { 0, 1, 0 };
+    mat4_t view_matrix = mat4_look_at(eye, target, up);
+    meshlet_view_t view = make_meshlet_view(view_matrix, true);
+
+    int num_meshlets;
+    const meshlet_t* meshlets = get_mesh_meshlets(mesh, 0, &num_meshlets);
+    for (int m = 0; m < num_meshlets; m++) {
+        bool is_culled = is_meshlet_culled(&meshlets[m], &view);
+        for (int i = meshlets[m].first_face; i < meshlets[m].first_face + meshlets[m].num_faces; i++) {
+            vertex_t vertices[3];
+            get_mesh_face_vertices(mesh, 0, i, vertices);
+            vec3_t a = vec3_from_vec4(mat4_mul_vec4(view_matrix, vec4_from_vec3(vertices[0].position)));
+            vec3_t b = vec3_from_vec4(mat4_mul_vec4(view_matrix, vec4_from_vec3(vertices[1].position)));
+            vec3_t c = vec3_from_vec4(mat4_mul_vec4(view_matrix, vec4_from_vec3(vertices[2].position)));
+            vec3_t normal = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+            bool is_facing = vec3_dot(normal, a) < 0;
+            bool is_inside = !is_sphere_outside_frustum(a, 0) || !is_sphere_outside_frustum(b, 0) ||
+                !is_sphere_outside_frustum(c, 0);
+            if (!is_culled) {
+                (*num_tested)++;
+                *num_visible += is_facing;
+            } else if (is_facing && is_inside) {
+                (*num_lost)++;
+            }
+        }
+    }
+}
+
+//
+// Split every mesh into clusters and look at it from directions spread over a
+// sphere, once from far enough to see all of it and once from close by, where
+// the frustum cuts most of it off. Reports the share of clusters culled and of
+// faces still tested one by one, next to the share that face the camera.
+//
+static void run_meshlet_benchmark(int num_files) {
+    float fov_y = M_PI / 3.0f;
+    float fov_x = atanf(tanf(fov_y / 2) * LOD_WINDOW_WIDTH / LOD_WINDOW_HEIGHT) * 2;
+    init_frustum_planes(fov_x, fov_y, 0.1f, 100.0f);
+
+    printf("\n%-22s %9s %9s %10s %27s %27s %6s\n", "clusters", "clusters", "faces/cl", "ms/build",
+        "far: culled/tested/seen", "near: culled/tested/seen", "lost");
+    for (int i = 0; i < num_files; i++) {
+        mesh_t mesh = { .vertices = NULL, .faces = NULL };
+        if (!load_obj_mesh(obj_files[i], &mesh))
+            continue;
+        if (use_vertex_cache_order)
+            optimize_mesh_order(&mesh);
+        compute_mesh_bounds(&mesh);
+
+        double start = now_seconds();
+        build_mesh_meshlets(&mesh);
+        double seconds = now_seconds() - start;
+
+        int num_faces = array_length(mesh.faces);
+        int num_meshlets = array_length(mesh.meshlets[0]);
+        vec3_t center = vec3_mul(vec3_add(mesh.bounds_min, mesh.bounds_max), 0.5f);
+        float radius = vec3_length(vec3_sub(mesh.bounds_max, mesh.bounds_min)) * 0.5f;
+        printf("%-22s %9d %9.1f %10.3f", obj_files[i], num_meshlets, (float)num_faces / num_meshlets, seconds * 1000.0);
+
+        // Far views see the whole mesh, near ones sit just outside its bounding sphere
+        const float distances[2] = { 3.0f, 1.2f };
+        int num_lost = 0;
+        for (int d = 0; d < 2; d++) {
+            int num_tested = 0, num_visible = 0;
+            memset(&cull_stats, 0, sizeof(cull_stats));
+            for (int v = 0; v < CULL_NUM_VIEWS; v++) {
+                // Spiral over the sphere, keeping clear of the poles the up vector cannot handle
+                float y = 0.9f - 1.8f * (v + 0.5f) / CULL_NUM_VIEWS;
+                float angle = v * 2.39996323f;
+                float r = sqrtf(1 - y * y);
+                vec3_t direction = { r * cosf(angle), y, r * sinf(angle) };
+                vec3_t eye = vec3_add(center, vec3_mul(direction, radius * distances[d]));
+                cull_view(&mesh, eye, center, &num_tested, &num_visible, &num_lost);
+            }
+            float num_total = (float)num_faces * CULL_NUM_VIEWS;
+            printf("    %6.1f%% %6.1f%% %6.1f%%", 100.0f * (cull_stats.num_frustum_culled + cull_stats.num_backface_culled) /
+                cull_stats.num_meshlets, 100.0f * num_tested / num_total, 100.0f * num_visible / num_total);
+        }
+        printf(" %6d\n", num_lost);
+        free_mesh(&mesh);
+    }
+}
+
+//
+// Find the instances in view the way the scene did before it had a hierarchy,
+// testing the bounding sphere of every one of them
+//
+static int scan_scene(const scene_t* scene, mat4_t view_matrix) {
+    int num_visible = 0;
+    int num_instances = array_length(scene->instances);
+    for (int i = 0; i < num_instances; i++) {
+        vec3_t center = vec3_from_vec4(mat4_mul_vec4(view_matrix, vec4_from_vec3(scene->instances[i].center)));
+        num_visible += !is_sphere_outside_frustum(center, scene->instances[i].radius);
+    }
+    return num_visible;
+}
+
+//
+// Fill a scene with a square grid of instances of one mesh around the camera
+// and find the ones in view while it turns around, by scanning all of them and
+// by querying the hierarchy, whose results have to agree. Then moves one in a
+// hundred instances every frame and times the whole update, refitting included.
+//
+static void run_scene_benchmark(void) {
+    const int num_instances[] = { 100, 1000, 10000 };
+    float fov_y = M_PI / 3.0f;
+    float fov_x = atanf(tanf(fov_y / 2) * LOD_WINDOW_WIDTH / LOD_WINDOW_HEIGHT) * 2;
+    init_frustum_planes(fov_x, fov_y, 0.1f, 100.0f);
+    float projection_scale = 1.0f / tanf(fov_y / 2) * LOD_WINDOW_HEIGHT / 2.0f;
+
+    mat4_t view_matrices[SCENE_NUM_VIEWS];
+    for (int v = 0; v < SCENE_NUM_VIEWS; v++) {
+        float yaw = 2 * M_PI * v / SCENE_NUM_VIEWS;
+        vec3_t eye = { 0, 2.0f, 0 };
+        vec3_t target = { sinf(yaw), 2.0f, cosf(yaw) };
+        vec3_t up = { 0, 1, 0 };
+        view_matrices[v] = mat4_look_at(eye, target, up);
+    }
+
+    printf("\n%-22s %10s %10s %10s %10s %12s %9s\n", "scene", "instances", "visible", "us/scan", "us/bvh",
+        "us/1% moved", "mismatch");
+    for (int n = 0; n < (int)(sizeof(num_instances) / sizeof(num_instances[0])); n++) {
+        scene_t grid = { .instances = NULL, .visible = NULL };
+        int mesh_index;
+        if (!load_obj_mesh("./assets/efa.obj", add_scene_mesh(&grid, &mesh_index))) {
+            free_scene(&grid);
+            continue;
+        }
+        compute_mesh_bounds(&grid.meshes[mesh_index]);
+
+        int side = (int)ceilf(sqrtf(num_instances[n]));
+        for (int i = 0; i < num_instances[n]; i++) {
+            vec3_t translation = { (i % side - side / 2) * SCENE_SPACING, 0, (i / side - side / 2) * SCENE_SPACING };
+            add_scene_instance(&grid, mesh_index, -1, -1, translation);
+        }
+        update_scene(&grid, view_matrices[0], projection_scale);
+
+        int num_scanned = 0;
+        double start = now_seconds();
+        for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+            num_scanned += scan_scene(&grid, view_matrices[j % SCENE_NUM_VIEWS]);
+        }
+        double scan_seconds = now_seconds() - start;
+
+        int num_queried = 0;
+        start = now_seconds();
+        for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+            grid.candidates = query_bvh_frustum(&grid.bvh, view_matrices[j % SCENE_NUM_VIEWS], grid.candidates);
+            num_queried += array_length(grid.candidates);
+        }
+        double bvh_seconds = now_seconds() - start;
+
+        int num_moved = num_instances[n] / 100;
+        vec3_t up_axis = { 0, 1, 0 };
+        start = now_seconds();
+        for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+            for (int k = 0; k < num_moved; k++) {
+                int index = (j * num_moved + k) * 7919 % num_instances[n];
+                int node = grid.instances[index].transform;
+                transform_t* transform = &grid.transforms.nodes[node];
+                vec3_t translation = { transform->translation.x, 0.5f * sinf(j * 0.1f), transform->translation.z };
+                set_transform_rotation(&grid.transforms, node, quat_mul(transform->rotation, quat_from_axis_angle(up_axis, 0.1f)));
+                set_transform_translation(&grid.transforms, node, translation);
+            }
+            update_scene(&grid, view_matrices[j % SCENE_NUM_VIEWS], projection_scale);
+        }
+        double moved_seconds = now_seconds() - start;
+
+        printf("%-22s %10d %10.1f %10.1f %10.1f %12.1f %9d\n", "./assets/efa.obj", num_instances[n],
+            (float)num_queried / SCENE_NUM_ITERATIONS, scan_seconds * 1e6 / SCENE_NUM_ITERATIONS,
+            bvh_seconds * 1e6 / SCENE_NUM_ITERATIONS, moved_seconds * 1e6 / SCENE_NUM_ITERATIONS,
+            num_queried - num_scanned);
+        free_scene(&grid);
+    }
+}
+
+//
+// Count the faces the visible instances of a scene submit to the render loop
+//
+static int count_visible_faces(const scene_t* scene) {
+    int num_faces = 0;
+    int num_visible = array_length(scene->visible);
+    for (int i = 0; i < num_visible; i++) {
+        const instance_t* instance = &scene->instances[scene->visible[i].instance];
+        num_faces += get_mesh_num_faces(&scene->meshes[instance->mesh], instance->lod);
+    }
+    return num_faces;
+}
+
+//
+// Stand the camera in a grid of instances behind a ring of large walls with
+// gaps between them, and count the instances and faces occlusion culling
+// removes while the camera turns around, next to what the pass costs
+//
+static void run_occlusion_benchmark(void) {
+    const int num_instances = 10000;
+    float fov_y = M_PI / 3.0f;
+    float fov_x = atanf(tanf(fov_y / 2) * LOD_WINDOW_WIDTH / LOD_WINDOW_HEIGHT) * 2;
+    init_frustum_planes(fov_x, fov_y, 0.1f, 100.0f);
+    mat4_t projection_matrix = mat4_make_perspective(fov_y, (float)LOD_WINDOW_HEIGHT / LOD_WINDOW_WIDTH, 0.1f, 100.0f);
+    float projection_scale = projection_matrix.m[1][1] * LOD_WINDOW_HEIGHT / 2.0f;
+
+    scene_t grid = { .instances = NULL, .visible = NULL };
+    int aircraft, wall;
+    if (!load_obj_mesh("./assets/efa.obj", add_scene_mesh(&grid, &aircraft)) ||
+        !load_obj_mesh("./assets/cube.obj", add_scene_mesh(&grid, &wall))) {
+        free_scene(&grid);
+        return;
+    }
+    compute_mesh_bounds(&grid.meshes[aircraft]);
+    compute_mesh_bounds(&grid.meshes[wall]);
+
+    int side = (int)ceilf(sqrtf(num_instances));
+    for (int i = 0; i < num_instances; i++) {
+        vec3_t translation = { (i % side - side / 2) * SCENE_SPACING, 0, (i / side - side / 2) * SCENE_SPACING };
+        // Leave the inside of the ring free for the camera
+        if (fabsf(translation.x) < OCCLUSION_WALL_DISTANCE && fabsf(translation.z) < OCCLUSION_WALL_DISTANCE)
+            continue;
+        add_scene_instance(&grid, aircraft, -1, -1, translation);
+    }
+    for (int i = 0; i < OCCLUSION_NUM_WALLS; i++) {
+        float angle = 2 * M_PI * i / OCCLUSION_NUM_WALLS;
+        vec3_t translation = { OCCLUSION_WALL_DISTANCE * sinf(angle), 2.0f, OCCLUSION_WALL_DISTANCE * cosf(angle) };
+        int node = add_scene_instance(&grid, wall, -1, -1, translation)->transform;
+        vec3_t up = { 0, 1, 0 };
+        set_transform_rotation(&grid.transforms, node, quat_from_axis_angle(up, angle));
+        set_transform_scale(&grid.transforms, node, vec3_new(OCCLUSION_WALL_WIDTH, 3.0f, 0.5f));
+    }
+
+    int num_visible = 0, num_culled = 0, num_faces = 0, num_faces_culled = 0;
+    double seconds = 0;
+    for (int v = 0; v < SCENE_NUM_VIEWS; v++) {
+        float yaw = 2 * M_PI * (v + 0.5f) / SCENE_NUM_VIEWS;
+        vec3_t eye = { 0, 2.0f, 0 };
+        vec3_t target = { sinf(yaw), 2.0f, cosf(yaw) };
+        vec3_t up = { 0, 1, 0 };
+        mat4_t view_matrix = mat4_look_at(eye, target, up);
+
+        update_scene(&grid, view_matrix, projection_scale);
+        int num_view_faces = count_visible_faces(&grid);
+        num_visible += array_length(grid.visible);
+        num_faces += num_view_faces;
+
+        double start = now_seconds();
+        cull_occluded_instances(&grid, projection_matrix);
+        seconds += now_seconds() - start;
+        num_culled += occlusion_stats.num_culled;
+        num_faces_culled += num_view_faces - count_visible_faces(&grid);
+    }
+
+    printf("\n%-22s %10s %10s %10s %10s %12s\n", "occlusion", "instances", "visible", "culled", "faces cut", "ms/pass");
+    printf("%-22s %10d %10.1f %9.1f%% %9.1f%% %12.3f\n", "./assets/efa.obj", array_length(grid.instances),
+        (float)num_visible / SCENE_NUM_VIEWS, 100.0f * num_culled / num_visible, 100.0f * num_faces_culled / num_faces,
+        seconds * 1000.0 / SCENE_NUM_VIEWS);
+    free_scene(&grid);
+}
+
+//
+// Time composing the world matrices of a scene's worth of transforms by
+// chaining a scale, three rotation and a translation matrix, the way every
+// frame did before transform nodes, against building each from a quaternion
+// in one step, and against reading them back from an unchanged hierarchy
+//
+static void run_transform_benchmark(void) {
+    const int num_transforms = 10000;
+    transform_graph_t graph = { .nodes = NULL, .changed = NULL };
+    for (int i = 0; i < num_transforms; i++) {
+        vec3_t translation = { i % 100, 0, i / 100 };
+        int node = add_transform(&graph, -1, translation);
+        vec3_t rotation = { i * 0.1f, i * 0.2f, i * 0.3f };
+        set_transform_rotation(&graph, node, quat_from_euler(rotation));
+    }
+
+    float sum = 0;
+    double start = now_seconds();
+    for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+        for (int i = 0; i < num_transforms; i++) {
+            vec3_t rotation = { i * 0.1f, i * 0.2f, i * 0.3f + j };
+            mat4_t world_matrix = mat4_make_scale(1, 1, 1);
+            world_matrix = mat4_mul_mat4(mat4_make_rotation_z(rotation.z), world_matrix);
+            world_matrix = mat4_mul_mat4(mat4_make_rotation_y(rotation.y), world_matrix);
+            world_matrix = mat4_mul_mat4(mat4_make_rotation_x(rotation.x), world_matrix);
+            world_matrix = mat4_mul_mat4(mat4_make_translation(i % 100, 0, i / 100), world_matrix);
+            sum += world_matrix.m[0][3];
+        }
+    }
+    double chained_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+        for (int i = 0; i < num_transforms; i++) {
+            mark_transform_dirty(&graph, i);
+            sum += get_world_matrix(&graph, i).m[0][3];
+        }
+        array_clear(graph.changed);
+    }
+    double quaternion_seconds = now_seconds() - start;
+
+    start = now_seconds();
+    for (int j = 0; j < SCENE_NUM_ITERATIONS; j++) {
+        for (int i = 0; i < num_transforms; i++) {
+            sum += get_world_matrix(&graph, i).m[0][3];
+        }
+    }
+    double cached_seconds = now_seconds() - start;
+
+    printf("\n%-22s %10s %12s %12s %12s\n", "transforms", "nodes", "ns/chained", "ns/one step", "ns/cached");
+    printf("%-22s %10d %12.1f %12.1f %12.1f\n", sum != 0 ? "world matrices" : "", num_transforms,
+        chained_seconds * 1e9 / SCENE_NUM_ITERATIONS / num_transforms,
+        quaternion_seconds * 1e9 / SCENE_NUM_ITERATIONS / num_transforms,
+        cached_seconds * 1e9 / SCENE_NUM_ITERATIONS / num_transforms);
+    free_transform_graph(&graph);
+}
+
+#endif
+
+int main(void) {
+#if defined(OBJ_LEGACY_PARSER)
+    printf("OBJ load benchmark (legacy sscanf parser)\n");
+#else
+    printf("OBJ load benchmark (mapped parser)\n");
+#endif
+    printf("%-22s %10s %10s %10s %10s\n", "file", "bytes", "faces", "ms/load", "MB/s");
+
+    double total_seconds = 0;
+    double total_bytes = 0;
+    int num_files = sizeof(obj_files) / sizeof(obj_files[0]);
+
+    for (int i = 0; i < num_files; i++) {
+        struct stat st;
+        if (stat(obj_files[i], &st) != 0) {
+            fprintf(stderr, "Error: could not read %s\n", obj_files[i]);
+            continue;
+        }
+
+        int num_faces = 0;
+        double start = now_seconds();
+        for (int j = 0; j < NUM_ITERATIONS; j++) {
+            mesh_t mesh = { .vertices = NULL, .faces = NULL };
+            load_obj_mesh(obj_files[i], &mesh);
+            num_faces = array_length(mesh.faces);
+            array_free(mesh.vertices);
+            array_free(mesh.faces);
+        }
+        double seconds = now_seconds() - start;
+
+        double bytes = (double)st.st_size * NUM_ITERATIONS;
+        printf("%-22s %10ld %10d %10.3f %10.1f\n", obj_files[i], (long)st.st_size, num_faces,
+            seconds * 1000.0 / NUM_ITERATIONS, bytes / seconds / 1e6);
+
+        total_seconds += seconds;
+        total_bytes += bytes;
+    }
+
+    printf("%-22s %10s %10s %10s %10.1f\n", "total", "", "", "", total_bytes / total_seconds / 1e6);
+
+#if !defined(OBJ_LEGACY_PARSER)
+    run_scaling_benchmark();
+    run_cache_benchmark(num_files);
+    run_vertex_cache_benchmark(num_files);
+    run_compact_benchmark(num_files);
+    run_lod_benchmark(num_files);
+    run_meshlet_benchmark(num_files);
+    run_transform_benchmark();
+    run_scene_benchmark();
+    run_occlusion_benchmark();
+#endif
+    return 0;
+}
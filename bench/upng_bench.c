@@ -0,0 +1,152 @@
+//
+// PNG decode throughput benchmark
+//
+// Decodes every bundled texture from memory into a preallocated buffer a number
+// of times and reports the decoded bytes per second and the heap scratch memory
+// upng needed on top of the source and the image. Build it with -DUPNG_LEGACY_INFLATE to measure the
+// original bit-at-a-time inflater instead of the table driven one.
+// Then loads all textures one after the other and as one thread pool batch, and
+// finally compares a cold start that writes the texture cache with a warm one.
+//
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/upng.h"
+#include "../src/texture.h"
+#include "../src/texture_cache.h"
+#include "../src/thread_pool.h"
+#include "../src/kernels.h"
+
+#define NUM_ITERATIONS 20
+
+static const char* png_files[] = {
+    "./assets/cube.png",
+    "./assets/f22.png",
+    "./assets/f117.png",
+    "./assets/efa.png",
+    "./assets/crab.png",
+    "./assets/drone.png"
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char* read_file(const char* filename, unsigned long* size) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    unsigned char* buffer = malloc(*size);
+    if (buffer != NULL && fread(buffer, 1, *size, file) != *size) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    return buffer;
+}
+
+int main(void) {
+    // The unfilters and the texel expansion follow RENDERER_CPU_LEVEL too
+    cpu_level_t level = init_kernels();
+#if defined(UPNG_LEGACY_INFLATE)
+    printf("upng decode benchmark (legacy tree inflater, %s kernels)\n", get_cpu_level_name(level));
+#else
+    printf("upng decode benchmark (table driven inflater, %s kernels)\n", get_cpu_level_name(level));
+#endif
+    printf("%-20s %10s %10s %10s %10s\n", "file", "bytes", "ms/decode", "MB/s", "scratch");
+
+    double total_seconds = 0;
+    double total_bytes = 0;
+    int num_files = sizeof(png_files) / sizeof(png_files[0]);
+
+    for (int i = 0; i < num_files; i++) {
+        unsigned long size;
+        unsigned char* source = read_file(png_files[i], &size);
+        if (source == NULL) {
+            fprintf(stderr, "Error: could not read %s\n", png_files[i]);
+            continue;
+        }
+
+        upng_t* header = upng_new_from_bytes(source, size);
+        upng_header(header);
+        unsigned long buffer_size = upng_get_decode_size(header);
+        unsigned char* buffer = malloc(buffer_size);
+        upng_free(header);
+
+        unsigned decoded_size = 0;
+        unsigned long scratch = 0;
+        double start = now_seconds();
+        for (int j = 0; j < NUM_ITERATIONS; j++) {
+            upng_t* png = upng_new_from_bytes(source, size);
+            if (upng_decode_into(png, buffer, buffer_size) != UPNG_EOK) {
+                fprintf(stderr, "Error: decoding %s failed (%d)\n", png_files[i], upng_get_error(png));
+            }
+            decoded_size = upng_get_size(png);
+            scratch = upng_get_scratch_peak(png);
+            upng_free(png);
+        }
+        double seconds = now_seconds() - start;
+
+        double bytes = (double)decoded_size * NUM_ITERATIONS;
+        printf("%-20s %10u %10.3f %10.1f %10lu\n", png_files[i], decoded_size,
+            seconds * 1000.0 / NUM_ITERATIONS, bytes / seconds / 1e6, scratch);
+
+        total_seconds += seconds;
+        total_bytes += bytes;
+        free(buffer);
+        free(source);
+    }
+
+    printf("%-20s %10s %10s %10.1f\n", "total", "", "", total_bytes / total_seconds / 1e6);
+
+    // Time loading every texture serially against one batch on the thread pool
+    texture_t textures[sizeof(png_files) / sizeof(png_files[0])];
+    use_texture_cache = false;
+    for (int pass = 0; pass < 2; pass++) {
+        thread_pool_init(pass == 0 ? 1 : 0);
+
+        double start = now_seconds();
+        for (int j = 0; j < NUM_ITERATIONS; j++) {
+            load_png_textures((char**)png_files, textures, num_files);
+            for (int i = 0; i < num_files; i++) {
+                free_texture(&textures[i]);
+            }
+        }
+        double seconds = now_seconds() - start;
+
+        printf("batch load, %2d thread(s): %8.3f ms\n", thread_pool_size(), seconds * 1000.0 / NUM_ITERATIONS);
+        thread_pool_destroy();
+    }
+
+    // Time a cold start, which decodes and writes the cache files, against a warm one that maps them
+    use_texture_cache = true;
+    thread_pool_init(0);
+    for (int i = 0; i < num_files; i++) {
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s%s", png_files[i], CACHE_EXTENSION);
+        remove(filename);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        double start = now_seconds();
+        load_png_textures((char**)png_files, textures, num_files);
+        double seconds = now_seconds() - start;
+
+        int num_mapped = 0;
+        for (int i = 0; i < num_files; i++) {
+            num_mapped += textures[i].mapping != NULL;
+            free_texture(&textures[i]);
+        }
+        printf("%s texture cache: %8.3f ms (%d of %d mapped)\n", pass == 0 ? "cold" : "warm", seconds * 1000.0, num_mapped, num_files);
+    }
+    thread_pool_destroy();
+
+    return 0;
+}
@@ -1,40 +1,204 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "array.h"
 
-#define ARRAY_RAW_DATA(array) ((int*)(array) - 2)
-#define ARRAY_CAPACITY(array) (ARRAY_RAW_DATA(array)[0])
-#define ARRAY_OCCUPIED(array) (ARRAY_RAW_DATA(array)[1])
+//
+// Every array has this header right in front of its items. Counts are ints,
+// but sizes in bytes are computed as size_t so large arrays do not overflow.
+// The header is 16 bytes on 64-bit targets, so items stay 16 byte aligned.
+//
+typedef struct {
+    array_arena_t* arena;   // Arena the array lives in, NULL for the heap
+    int capacity;
+    int occupied;
+} array_header_t;
 
-void* array_hold(void* array, int count, int item_size) {
+#define ARRAY_HEADER(array) ((array_header_t*)(array) - 1)
+
+// Arena allocations are aligned like malloc ones
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct array_block {
+    array_block_t* next;
+    size_t size;
+    size_t used;
+};
+
+static size_t array_size(int capacity, int item_size) {
+    return sizeof(array_header_t) + (size_t)item_size * capacity;
+}
+
+//
+// Take size bytes from the newest block, or from a new one if they do not fit.
+// Returns NULL when a new block cannot be allocated.
+//
+static void* arena_alloc(array_arena_t* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    array_block_t* block = arena->blocks;
+    if (block == NULL || block->used + size > block->size) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        block = (array_block_t*)malloc(ARENA_ALIGN(sizeof(array_block_t)) + block_size);
+        if (block == NULL)
+            return NULL;
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+    void* memory = (unsigned char*)block + ARENA_ALIGN(sizeof(array_block_t)) + block->used;
+    block->used += size;
+    return memory;
+}
+
+//
+// Move an array to storage for the given capacity. Heap arrays are reallocated;
+// arena arrays are copied to new arena space, leaving the old space unused
+// until the arena is freed. Returns NULL when out of memory, and the array is
+// then left as it was.
+//
+static void* array_grow(void* array, int capacity, int item_size) {
+    array_header_t* header;
     if (array == NULL) {
-        int raw_size = (sizeof(int) * 2) + (item_size * count);
-        int* base = (int*)malloc(raw_size);
-        base[0] = count;  // capacity
-        base[1] = count;  // occupied
-        return base + 2;
-    } else if (ARRAY_OCCUPIED(array) + count <= ARRAY_CAPACITY(array)) {
-        ARRAY_OCCUPIED(array) += count;
-        return array;
+        header = (array_header_t*)malloc(array_size(capacity, item_size));
+        if (header == NULL)
+            return NULL;
+        header->arena = NULL;
+        header->occupied = 0;
+    } else if (ARRAY_HEADER(array)->arena != NULL) {
+        array_header_t* old_header = ARRAY_HEADER(array);
+        header = (array_header_t*)arena_alloc(old_header->arena, array_size(capacity, item_size));
+        if (header == NULL)
+            return NULL;
+        memcpy(header, old_header, array_size(old_header->occupied, item_size));
     } else {
-        int needed_size = ARRAY_OCCUPIED(array) + count;
-        int float_curr = ARRAY_CAPACITY(array) * 2;
-        int capacity = needed_size > float_curr ? needed_size : float_curr;
-        int occupied = needed_size;
-        int raw_size = sizeof(int) * 2 + item_size * capacity;
-        int* base = (int*)realloc(ARRAY_RAW_DATA(array), raw_size);
-        base[0] = capacity;
-        base[1] = occupied;
-        return base + 2;
+        header = (array_header_t*)realloc(ARRAY_HEADER(array), array_size(capacity, item_size));
+        if (header == NULL)
+            return NULL;
     }
+    header->capacity = capacity;
+    return header + 1;
+}
+
+//
+// Make room for count more items without changing the length, at least
+// doubling the capacity when the array has to grow. Like the functions that
+// add items, it returns NULL when out of memory and leaves the array as it
+// was, so callers keep the old pointer until they have checked the new one.
+// A count that is negative or would take the length past INT_MAX fails too.
+//
+void* array_reserve(void* array, int count, int item_size) {
+    int occupied = array_length(array);
+    int capacity = array_capacity(array);
+    if (count < 0 || count > INT_MAX - occupied)
+        return NULL;
+    int needed = occupied + count;
+    if (array != NULL && needed <= capacity)
+        return array;
+
+    int doubled = capacity <= INT_MAX / 2 ? capacity * 2 : INT_MAX;
+    return array_grow(array, needed > doubled ? needed : doubled, item_size);
+}
+
+//
+// Append count items with undefined values, the caller fills them in
+//
+void* array_hold(void* array, int count, int item_size) {
+    array = array_reserve(array, count, item_size);
+    if (array == NULL)
+        return NULL;
+    ARRAY_HEADER(array)->occupied += count;
+    return array;
+}
+
+//
+// Append count items copied from items
+//
+void* array_append(void* array, const void* items, int count, int item_size) {
+    int first = array_length(array);
+    array = array_hold(array, count, item_size);
+    if (array == NULL)
+        return NULL;
+    memcpy((unsigned char*)array + (size_t)first * item_size, items, (size_t)count * item_size);
+    return array;
 }
 
 int array_length(void* array) {
-    return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
+    return (array != NULL) ? ARRAY_HEADER(array)->occupied : 0;
 }
 
+int array_capacity(void* array) {
+    return (array != NULL) ? ARRAY_HEADER(array)->capacity : 0;
+}
+
+void array_truncate(void* array, int length) {
+    if (array != NULL && length < ARRAY_HEADER(array)->occupied) {
+        ARRAY_HEADER(array)->occupied = length;
+    }
+}
+
+//
+// Empty an array but keep its storage, so refilling it does not allocate
+//
+void array_clear(void* array) {
+    array_truncate(array, 0);
+}
+
+//
+// Free a heap array; arena arrays are released with their arena
+//
 void array_free(void* array) {
-    if (array != NULL) {
-        free(ARRAY_RAW_DATA(array));
+    if (array != NULL && ARRAY_HEADER(array)->arena == NULL) {
+        free(ARRAY_HEADER(array));
+    }
+}
+
+//
+// Arrays whose items live in memory managed elsewhere, such as a mapped cache
+// file, carry the same header in front of their items so array_length works on
+// them. They must not be grown, truncated or freed.
+//
+int array_header_size(void) {
+    return sizeof(array_header_t);
+}
+
+void array_init_header(void* header, int count) {
+    array_header_t* base = (array_header_t*)header;
+    memset(base, 0, sizeof(array_header_t));
+    base->capacity = count;
+    base->occupied = count;
+}
+
+void array_arena_init(array_arena_t* arena, size_t block_size) {
+    arena->blocks = NULL;
+    arena->block_size = block_size;
+}
+
+//
+// Create an empty array in an arena with room for capacity items, NULL when
+// out of memory
+//
+void* array_arena_new(array_arena_t* arena, int capacity, int item_size) {
+    array_header_t* header = (array_header_t*)arena_alloc(arena, array_size(capacity, item_size));
+    if (header == NULL)
+        return NULL;
+    header->arena = arena;
+    header->capacity = capacity;
+    header->occupied = 0;
+    return header + 1;
+}
+
+//
+// Release every array created in the arena at once
+//
+void array_arena_free(array_arena_t* arena) {
+    array_block_t* block = arena->blocks;
+    while (block != NULL) {
+        array_block_t* next = block->next;
+        free(block);
+        block = next;
     }
+    arena->blocks = NULL;
 }
@@ -1,14 +1,42 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+#include <stddef.h>
+
+// Append a value, or leave the array as it was when out of memory
 #define array_push(array, value)                                              \
     do {                                                                      \
-        (array) = array_hold((array), 1, sizeof(*(array)));                   \
-        (array)[array_length(array) - 1] = (value);                           \
+        void* pushed = array_hold((array), 1, sizeof(*(array)));              \
+        if (pushed != NULL) {                                                 \
+            (array) = pushed;                                                 \
+            (array)[array_length(array) - 1] = (value);                       \
+        }                                                                     \
     } while (0);
 
+//
+// A block allocator many arrays can share. Arrays created in an arena grow by
+// moving to new space in it and are all released together by array_arena_free.
+//
+typedef struct array_block array_block_t;
+
+typedef struct {
+    array_block_t* blocks;  // Newest block first
+    size_t block_size;      // Minimum size of a new block
+} array_arena_t;
+
 void* array_hold(void* array, int count, int item_size);
+void* array_reserve(void* array, int count, int item_size);
+void* array_append(void* array, const void* items, int count, int item_size);
 int array_length(void* array);
+int array_capacity(void* array);
+void array_truncate(void* array, int length);
+void array_clear(void* array);
 void array_free(void* array);
+int array_header_size(void);
+void array_init_header(void* header, int count);
+
+void array_arena_init(array_arena_t* arena, size_t block_size);
+void* array_arena_new(array_arena_t* arena, int capacity, int item_size);
+void array_arena_free(array_arena_t* arena);
 
 #endif
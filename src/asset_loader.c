@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include "asset_loader.h"
+#include "thread_pool.h"
+#include "profile.h"
+
+enum asset_type {
+    ASSET_OBJ_MESH,
+    ASSET_PNG_TEXTURE
+};
+
+//
+// An asset being loaded on the thread pool. The job only writes the request's
+// own mesh or texture, which the main thread installs into the target once the
+// group is done.
+//
+typedef struct {
+    enum asset_type type;
+    char* filename;
+    mesh_load_options_t options;    // Taken when queued, the job reads no global settings
+    mesh_t* target_mesh;
+    texture_t* target_texture;
+    job_group_t group;
+    bool is_loaded;
+    mesh_t mesh;
+    texture_t texture;
+} asset_request_t;
+
+// Jobs hold pointers into the array, so slots are only reused once every request is installed
+static asset_request_t requests[MAX_ASSET_REQUESTS];
+static int num_requests = 0;
+static int num_installed = 0;
+
+static void load_asset_job(void* data) {
+    asset_request_t* request = (asset_request_t*)data;
+    PROFILE_TRACE_SCOPE(request->type == ASSET_OBJ_MESH ? "load_mesh" : "load_texture", "job") {
+        if (request->type == ASSET_OBJ_MESH)
+            request->is_loaded = load_obj_file(request->filename, &request->mesh, &request->options);
+        else
+            request->is_loaded = load_png_texture_file(request->filename, &request->texture);
+    }
+}
+
+static asset_request_t* push_request(enum asset_type type, char* filename, mesh_t* target_mesh, texture_t* target_texture) {
+    // With every slot taken, make room by waiting for the requests in flight
+    if (num_requests == MAX_ASSET_REQUESTS)
+        finish_asset_requests();
+
+    asset_request_t* request = &requests[num_requests++];
+    asset_request_t empty = {
+        .type = type,
+        .filename = filename,
+        .options = get_mesh_load_options(),
+        .target_mesh = target_mesh,
+        .target_texture = target_texture
+    };
+    *request = empty;
+    thread_pool_push(&request->group, load_asset_job, request);
+    return request;
+}
+
+//
+// Queue an OBJ file to replace the geometry of a mesh once it has loaded
+//
+void request_obj_file(char* filename, mesh_t* mesh) {
+    push_request(ASSET_OBJ_MESH, filename, mesh, NULL);
+}
+
+//
+// Queue a PNG file to replace a texture once it has decoded
+//
+void request_png_texture(char* filename, texture_t* texture) {
+    push_request(ASSET_PNG_TEXTURE, filename, NULL, texture);
+}
+
+static void install_request(asset_request_t* request) {
+    if (!request->is_loaded) {
+        fprintf(stderr, "Error: could not load %s\n", request->filename);
+        if (request->type == ASSET_OBJ_MESH)
+            free_mesh(&request->mesh);
+        return;
+    }
+
+    if (request->type == ASSET_OBJ_MESH)
+        set_mesh_geometry(request->target_mesh, &request->mesh);
+    else
+        set_texture(request->target_texture, &request->texture);
+}
+
+//
+// Install the assets that finished loading, in the order they were requested
+// so that a later request for the same target wins. Called once per frame from
+// the main thread; returns the number of requests installed.
+//
+int poll_asset_requests(void) {
+    int num_polled = 0;
+    while (num_installed < num_requests && thread_pool_is_done(&requests[num_installed].group)) {
+        install_request(&requests[num_installed]);
+        num_installed++;
+        num_polled++;
+    }
+    if (num_installed == num_requests) {
+        num_requests = 0;
+        num_installed = 0;
+    }
+    return num_polled;
+}
+
+//
+// Block until every requested asset has loaded and install them
+//
+void finish_asset_requests(void) {
+    for (int i = num_installed; i < num_requests; i++) {
+        thread_pool_wait(&requests[i].group);
+    }
+    poll_asset_requests();
+}
+
+bool is_loading_assets(void) {
+    return num_requests > 0;
+}
@@ -0,0 +1,16 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "texture.h"
+
+#define MAX_ASSET_REQUESTS 16
+
+void request_obj_file(char* filename, mesh_t* mesh);
+void request_png_texture(char* filename, texture_t* texture);
+int poll_asset_requests(void);
+void finish_asset_requests(void);
+bool is_loading_assets(void);
+
+#endif
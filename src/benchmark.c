@@ -0,0 +1,164 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "benchmark.h"
+
+static const char* stage_names[NUM_BENCHMARK_STAGES] = { "update", "rasterize", "present", "clear" };
+
+//
+// Milliseconds of the monotonic clock, which only differences make sense of
+//
+double get_benchmark_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void init_benchmark_run(benchmark_run_t* run, const char* model, const char* render_method, int num_frames) {
+    benchmark_run_t empty = { .model = model, .render_method = render_method, .num_frames = num_frames };
+    *run = empty;
+    run->stage_ms = (float*) calloc((size_t) num_frames * NUM_BENCHMARK_STAGES, sizeof(float));
+}
+
+void add_benchmark_frame(benchmark_run_t* run, int frame, const double stage_ms[NUM_BENCHMARK_STAGES], int num_triangles, long num_pixels) {
+    for (int i = 0; i < NUM_BENCHMARK_STAGES; i++) {
+        run->stage_ms[frame * NUM_BENCHMARK_STAGES + i] = stage_ms[i];
+    }
+    run->num_triangles += num_triangles;
+    run->num_pixels += num_pixels;
+}
+
+//
+// FNV-1a over the pixels, so builds can check they still draw the same frames
+//
+uint64_t hash_frame(const uint32_t* pixels, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < count; i++) {
+        hash ^= pixels[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int compare_floats(const void* a, const void* b) {
+    float x = *(const float*) a;
+    float y = *(const float*) b;
+    return (x > y) - (x < y);
+}
+
+//
+// Mean, median and 99th percentile of a sorted array, the percentiles by
+// nearest rank
+//
+typedef struct {
+    double mean;
+    double p50;
+    double p99;
+    double total;
+} summary_t;
+
+static summary_t summarize(float* values, int count) {
+    summary_t summary = { 0 };
+    if (count == 0)
+        return summary;
+
+    qsort(values, count, sizeof(float), compare_floats);
+    for (int i = 0; i < count; i++) {
+        summary.total += values[i];
+    }
+    summary.mean = summary.total / count;
+    summary.p50 = values[(int) ceil(0.50 * count) - 1];
+    summary.p99 = values[(int) ceil(0.99 * count) - 1];
+    return summary;
+}
+
+static double per_second(double amount, double milliseconds) {
+    return milliseconds > 0 ? amount * 1000.0 / milliseconds : 0;
+}
+
+//
+// Write the times, and the triangles or pixels per second of them for the
+// stages that do the work they count
+//
+static void write_summary(FILE* file, summary_t summary, const benchmark_run_t* run, bool has_triangle_rate, bool has_pixel_rate) {
+    fprintf(file, "\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f", summary.mean, summary.p50, summary.p99);
+    if (has_triangle_rate)
+        fprintf(file, ", \"triangles_per_second\": %.0f", per_second(run->num_triangles, summary.total));
+    if (has_pixel_rate)
+        fprintf(file, ", \"pixels_per_second\": %.0f", per_second(run->num_pixels, summary.total));
+}
+
+static void write_run(FILE* file, const benchmark_run_t* run) {
+    float* values = (float*) malloc(sizeof(float) * (run->num_frames > 0 ? run->num_frames : 1));
+
+    // Whole frames are the sum of their stages
+    for (int frame = 0; frame < run->num_frames; frame++) {
+        values[frame] = 0;
+        for (int i = 0; i < NUM_BENCHMARK_STAGES; i++) {
+            values[frame] += run->stage_ms[frame * NUM_BENCHMARK_STAGES + i];
+        }
+    }
+    summary_t frame_summary = summarize(values, run->num_frames);
+
+    fprintf(file, "    {\n");
+    fprintf(file, "      \"model\": \"%s\", \"render_method\": \"%s\", \"frames\": %d,\n", run->model, run->render_method, run->num_frames);
+    fprintf(file, "      \"triangles_per_frame\": %.1f, \"pixels_per_frame\": %.1f, \"frame_hash\": \"%016llx\",\n",
+        run->num_frames > 0 ? (double) run->num_triangles / run->num_frames : 0,
+        run->num_frames > 0 ? (double) run->num_pixels / run->num_frames : 0,
+        (unsigned long long) run->frame_hash);
+    fprintf(file, "      \"frame\": { ");
+    write_summary(file, frame_summary, run, true, true);
+    fprintf(file, " },\n");
+    fprintf(file, "      \"stages\": {\n");
+    for (int i = 0; i < NUM_BENCHMARK_STAGES; i++) {
+        for (int frame = 0; frame < run->num_frames; frame++) {
+            values[frame] = run->stage_ms[frame * NUM_BENCHMARK_STAGES + i];
+        }
+        fprintf(file, "        \"%s\": { ", stage_names[i]);
+        write_summary(file, summarize(values, run->num_frames), run, i == STAGE_UPDATE, i == STAGE_RASTERIZE);
+        fprintf(file, " }%s\n", i + 1 < NUM_BENCHMARK_STAGES ? "," : "");
+    }
+    fprintf(file, "      }\n");
+    fprintf(file, "    }");
+    free(values);
+}
+
+//
+// Write the runs as JSON, each with the mean, median and 99th percentile time
+// of whole frames and of every stage. Whole frames also get the triangles and
+// pixels drawn per second, the update stage the triangles projected per second
+// of its time and the rasterize stage the pixels filled per second of its time.
+//
+bool write_benchmark_json(const char* filename, const benchmark_info_t* info, const benchmark_run_t* runs, int num_runs) {
+    FILE* file = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error writing benchmark results '%s'.\n", filename);
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"width\": %d, \"height\": %d, \"frames\": %d, \"cpu_level\": \"%s\",\n",
+        info->width, info->height, info->num_frames, info->cpu_level);
+#ifdef __VERSION__
+    fprintf(file, "  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    fprintf(file, "  \"runs\": [\n");
+    for (int i = 0; i < num_runs; i++) {
+        write_run(file, &runs[i]);
+        fprintf(file, "%s\n", i + 1 < num_runs ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (file != stdout)
+        fclose(file);
+    return true;
+}
+
+void free_benchmark_run(benchmark_run_t* run) {
+    free(run->stage_ms);
+    run->stage_ms = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The parts of a frame the benchmark times one by one
+typedef enum {
+    STAGE_UPDATE,       // Culling, transforming, clipping and projecting
+    STAGE_RASTERIZE,    // Drawing the grid and the triangles into the color buffer
+    STAGE_PRESENT,      // Handing the color buffer to the display
+    STAGE_CLEAR,        // Clearing the color and z-buffers
+    NUM_BENCHMARK_STAGES
+} benchmark_stage_t;
+
+//
+// The timings of one model drawn in one render method, frame by frame
+//
+typedef struct {
+    const char* model;
+    const char* render_method;
+    int num_frames;
+    float* stage_ms;            // num_frames rows of NUM_BENCHMARK_STAGES times
+    long num_triangles;         // Triangles projected over all frames
+    long num_pixels;            // Pixels of filled and textured triangles over all frames
+    uint64_t frame_hash;        // Of the color buffer of the last frame
+} benchmark_run_t;
+
+//
+// What the runs were measured with, to tell builds and machines apart
+//
+typedef struct {
+    int width;
+    int height;
+    int num_frames;
+    const char* cpu_level;
+} benchmark_info_t;
+
+double get_benchmark_ms(void);
+void init_benchmark_run(benchmark_run_t* run, const char* model, const char* render_method, int num_frames);
+void add_benchmark_frame(benchmark_run_t* run, int frame, const double stage_ms[NUM_BENCHMARK_STAGES], int num_triangles, long num_pixels);
+uint64_t hash_frame(const uint32_t* pixels, int count);
+bool write_benchmark_json(const char* filename, const benchmark_info_t* info, const benchmark_run_t* runs, int num_runs);
+void free_benchmark_run(benchmark_run_t* run);
+
+#endif
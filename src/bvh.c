@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <math.h>
+#include "array.h"
+#include "clipping.h"
+#include "bvh.h"
+
+static float get_axis(vec3_t v, int axis) {
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+static vec3_t vec3_min(vec3_t a, vec3_t b) {
+    vec3_t result = { fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z) };
+    return result;
+}
+
+static vec3_t vec3_max(vec3_t a, vec3_t b) {
+    vec3_t result = { fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z) };
+    return result;
+}
+
+//
+// Fit the box of a node around the spheres of its items if it is a leaf, or
+// else around the boxes of its two children
+//
+static void fit_node(bvh_t* bvh, int node_index) {
+    bvh_node_t* node = &bvh->nodes[node_index];
+    if (node->child >= 0) {
+        const bvh_node_t* left = &bvh->nodes[node->child];
+        const bvh_node_t* right = &bvh->nodes[node->child + 1];
+        node->min = vec3_min(left->min, right->min);
+        node->max = vec3_max(left->max, right->max);
+        return;
+    }
+
+    for (int i = 0; i < node->num_items; i++) {
+        int item = bvh->items[node->first_item + i];
+        vec3_t extent = { bvh->radii[item], bvh->radii[item], bvh->radii[item] };
+        vec3_t min = vec3_sub(bvh->centers[item], extent);
+        vec3_t max = vec3_add(bvh->centers[item], extent);
+        node->min = i == 0 ? min : vec3_min(node->min, min);
+        node->max = i == 0 ? max : vec3_max(node->max, max);
+    }
+}
+
+//
+// Partially sort a range of items along an axis so the one at index k has its
+// center where it would be in sorted order, with smaller ones before it
+//
+static void select_items(bvh_t* bvh, int left, int right, int k, int axis) {
+    int* items = bvh->items;
+    while (right > left) {
+        float pivot = get_axis(bvh->centers[items[(left + right) / 2]], axis);
+        int i = left;
+        int j = right;
+        while (i <= j) {
+            while (get_axis(bvh->centers[items[i]], axis) < pivot) i++;
+            while (get_axis(bvh->centers[items[j]], axis) > pivot) j--;
+            if (i <= j) {
+                int swap = items[i];
+                items[i++] = items[j];
+                items[j--] = swap;
+            }
+        }
+        if (k <= j)
+            right = j;
+        else if (k >= i)
+            left = i;
+        else
+            break;
+    }
+}
+
+//
+// Make a node over a range of items, splitting it in half at the median center
+// along the axis the centers spread the most over until few enough are left
+//
+static void build_node(bvh_t* bvh, int node_index, int parent, int first_item, int num_items) {
+    bvh_node_t* node = &bvh->nodes[node_index];
+    node->parent = parent;
+    node->child = -1;
+    node->first_item = first_item;
+    node->num_items = num_items;
+
+    if (num_items <= BVH_MAX_LEAF_ITEMS) {
+        for (int i = 0; i < num_items; i++) {
+            bvh->item_leaves[bvh->items[first_item + i]] = node_index;
+        }
+        fit_node(bvh, node_index);
+        return;
+    }
+
+    vec3_t center_min = bvh->centers[bvh->items[first_item]];
+    vec3_t center_max = center_min;
+    for (int i = 1; i < num_items; i++) {
+        vec3_t center = bvh->centers[bvh->items[first_item + i]];
+        center_min = vec3_min(center_min, center);
+        center_max = vec3_max(center_max, center);
+    }
+    vec3_t spread = vec3_sub(center_max, center_min);
+    int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : spread.y >= spread.z ? 1 : 2;
+
+    int middle = first_item + num_items / 2;
+    select_items(bvh, first_item, first_item + num_items - 1, middle, axis);
+
+    // Growing the node array can move it, so nodes are only referred to by index
+    int child = array_length(bvh->nodes);
+    bvh->nodes = array_hold(bvh->nodes, 2, sizeof(bvh_node_t));
+    bvh->nodes[node_index].child = child;
+    build_node(bvh, child, node_index, first_item, middle - first_item);
+    build_node(bvh, child + 1, node_index, middle, first_item + num_items - middle);
+    fit_node(bvh, node_index);
+}
+
+//
+// Build the hierarchy over the bounding spheres of a number of items, throwing
+// away the one built before
+//
+void build_bvh(bvh_t* bvh, const vec3_t* centers, const float* radii, int num_items) {
+    array_clear(bvh->nodes);
+    array_clear(bvh->items);
+    array_clear(bvh->item_leaves);
+    array_clear(bvh->centers);
+    array_clear(bvh->radii);
+    if (num_items == 0)
+        return;
+
+    bvh->centers = array_append(bvh->centers, centers, num_items, sizeof(vec3_t));
+    bvh->radii = array_append(bvh->radii, radii, num_items, sizeof(float));
+    bvh->item_leaves = array_hold(bvh->item_leaves, num_items, sizeof(int));
+    bvh->items = array_hold(bvh->items, num_items, sizeof(int));
+    for (int i = 0; i < num_items; i++) {
+        bvh->items[i] = i;
+    }
+
+    // A median split tree has fewer than half as many nodes as items per leaf
+    bvh->nodes = array_reserve(bvh->nodes, 2 * num_items / BVH_MAX_LEAF_ITEMS + 1, sizeof(bvh_node_t));
+    bvh->nodes = array_hold(bvh->nodes, 1, sizeof(bvh_node_t));
+    build_node(bvh, 0, -1, 0, num_items);
+}
+
+//
+// Move the bounding sphere of an item and refit the boxes above it, stopping at
+// the first one that stays the same. The tree stays correct however far items
+// move, but gets looser, so it is worth building again after large changes.
+//
+void refit_bvh_item(bvh_t* bvh, int item, vec3_t center, float radius) {
+    bvh->centers[item] = center;
+    bvh->radii[item] = radius;
+
+    int node_index = bvh->item_leaves[item];
+    while (node_index >= 0) {
+        bvh_node_t* node = &bvh->nodes[node_index];
+        vec3_t min = node->min;
+        vec3_t max = node->max;
+        fit_node(bvh, node_index);
+        if (node->min.x == min.x && node->min.y == min.y && node->min.z == min.z &&
+            node->max.x == max.x && node->max.y == max.y && node->max.z == max.z)
+            break;
+        node_index = node->parent;
+    }
+}
+
+static int compare_hits(const void* a, const void* b) {
+    float depth_a = ((const bvh_hit_t*)a)->depth;
+    float depth_b = ((const bvh_hit_t*)b)->depth;
+    return (depth_a > depth_b) - (depth_a < depth_b);
+}
+
+//
+// Find the items whose bounding spheres are at least partly inside the view
+// frustum, and return them in visible sorted from near to far by the depth of
+// their centers. Boxes entirely outside a plane are skipped with everything
+// under them; planes a box is entirely inside are not tested again below it,
+// so subtrees inside the frustum are taken whole without any more tests.
+//
+int* query_bvh_frustum(bvh_t* bvh, mat4_t view_matrix, int* visible) {
+    array_clear(visible);
+    array_clear(bvh->hits);
+    if (array_length(bvh->nodes) == 0)
+        return visible;
+
+    plane_t planes[NUM_PLANES];
+    float offsets[NUM_PLANES];
+    get_world_frustum_planes(view_matrix, planes);
+    for (int i = 0; i < NUM_PLANES; i++) {
+        offsets[i] = -vec3_dot(planes[i].normal, planes[i].point);
+    }
+    vec3_t forward = { view_matrix.m[2][0], view_matrix.m[2][1], view_matrix.m[2][2] };
+    float forward_offset = view_matrix.m[2][3];
+
+    // Every entry is a node and a bit mask of the planes it still has to be tested against
+    int stack_nodes[BVH_MAX_STACK];
+    int stack_masks[BVH_MAX_STACK];
+    int stack_size = 1;
+    stack_nodes[0] = 0;
+    stack_masks[0] = (1 << NUM_PLANES) - 1;
+
+    while (stack_size > 0) {
+        stack_size--;
+        const bvh_node_t* node = &bvh->nodes[stack_nodes[stack_size]];
+        int mask = stack_masks[stack_size];
+
+        bool is_outside = false;
+        for (int i = 0; i < NUM_PLANES && !is_outside; i++) {
+            if (!(mask & (1 << i)))
+                continue;
+            vec3_t normal = planes[i].normal;
+
+            // Corners of the box the farthest along and against the plane normal
+            vec3_t far_corner = {
+                normal.x >= 0 ? node->max.x : node->min.x,
+                normal.y >= 0 ? node->max.y : node->min.y,
+                normal.z >= 0 ? node->max.z : node->min.z
+            };
+            vec3_t near_corner = {
+                normal.x >= 0 ? node->min.x : node->max.x,
+                normal.y >= 0 ? node->min.y : node->max.y,
+                normal.z >= 0 ? node->min.z : node->max.z
+            };
+            if (vec3_dot(normal, far_corner) + offsets[i] < 0)
+                is_outside = true;
+            else if (vec3_dot(normal, near_corner) + offsets[i] >= 0)
+                mask &= ~(1 << i);
+        }
+        if (is_outside)
+            continue;
+
+        if (mask == 0 || node->child < 0) {
+            int first_hit = array_length(bvh->hits);
+            bvh->hits = array_hold(bvh->hits, node->num_items, sizeof(bvh_hit_t));
+            int num_hits = 0;
+            for (int j = 0; j < node->num_items; j++) {
+                int item = bvh->items[node->first_item + j];
+                vec3_t center = bvh->centers[item];
+
+                // Items of leaves cut by a plane are tested with their own spheres
+                bool is_item_outside = false;
+                for (int i = 0; i < NUM_PLANES && mask != 0; i++) {
+                    if ((mask & (1 << i)) && vec3_dot(planes[i].normal, center) + offsets[i] < -bvh->radii[item]) {
+                        is_item_outside = true;
+                        break;
+                    }
+                }
+                if (is_item_outside)
+                    continue;
+
+                bvh_hit_t hit = { .depth = vec3_dot(forward, center) + forward_offset, .item = item };
+                bvh->hits[first_hit + num_hits++] = hit;
+            }
+            array_truncate(bvh->hits, first_hit + num_hits);
+            continue;
+        }
+
+        // Visit the nearer child first, so the results come out roughly sorted
+        const bvh_node_t* left = &bvh->nodes[node->child];
+        const bvh_node_t* right = &bvh->nodes[node->child + 1];
+        float left_depth = vec3_dot(forward, vec3_add(left->min, left->max));
+        float right_depth = vec3_dot(forward, vec3_add(right->min, right->max));
+        int near_child = left_depth <= right_depth ? node->child : node->child + 1;
+        stack_nodes[stack_size] = near_child == node->child ? node->child + 1 : node->child;
+        stack_masks[stack_size++] = mask;
+        stack_nodes[stack_size] = near_child;
+        stack_masks[stack_size++] = mask;
+    }
+
+    int num_hits = array_length(bvh->hits);
+    qsort(bvh->hits, num_hits, sizeof(bvh_hit_t), compare_hits);
+    visible = array_hold(visible, num_hits, sizeof(int));
+    for (int i = 0; i < num_hits; i++) {
+        visible[i] = bvh->hits[i].item;
+    }
+    return visible;
+}
+
+int get_bvh_num_items(const bvh_t* bvh) {
+    return array_length(bvh->centers);
+}
+
+void free_bvh(bvh_t* bvh) {
+    array_free(bvh->nodes);
+    array_free(bvh->items);
+    array_free(bvh->item_leaves);
+    array_free(bvh->centers);
+    array_free(bvh->radii);
+    array_free(bvh->hits);
+    bvh->nodes = NULL;
+    bvh->items = NULL;
+    bvh->item_leaves = NULL;
+    bvh->centers = NULL;
+    bvh->radii = NULL;
+    bvh->hits = NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "vector.h"
+#include "matrix.h"
+
+// Leaves hold at most this many items
+#define BVH_MAX_LEAF_ITEMS 4
+
+// Nodes waiting to be visited by a query, enough for any tree that fits in memory
+#define BVH_MAX_STACK 64
+
+//
+// A box around the bounding spheres of a range of items. Inner nodes have two
+// children next to each other in the node array; every node covers the items
+// of its subtree, which are next to each other in the item array.
+//
+typedef struct {
+    vec3_t min;
+    vec3_t max;
+    int parent;             // -1 for the root
+    int child;              // First of the two children, -1 for leaves
+    int first_item;
+    int num_items;
+} bvh_node_t;
+
+//
+// An item that passed a query, with its distance along the view direction
+//
+typedef struct {
+    float depth;
+    int item;
+} bvh_hit_t;
+
+//
+// Bounding volume hierarchy over items with bounding spheres, such as the
+// instances of a scene
+//
+typedef struct {
+    bvh_node_t* nodes;      // Dynamic array, the root first
+    int* items;             // Dynamic array of item indices, grouped by leaf
+    int* item_leaves;       // Dynamic array, the leaf of every item
+    vec3_t* centers;        // Dynamic array, bounding sphere of every item
+    float* radii;           // Dynamic array
+    bvh_hit_t* hits;        // Dynamic array the queries sort their results in
+} bvh_t;
+
+void build_bvh(bvh_t* bvh, const vec3_t* centers, const float* radii, int num_items);
+void refit_bvh_item(bvh_t* bvh, int item, vec3_t center, float radius);
+int* query_bvh_frustum(bvh_t* bvh, mat4_t view_matrix, int* visible);
+int get_bvh_num_items(const bvh_t* bvh);
+void free_bvh(bvh_t* bvh);
+
+#endif
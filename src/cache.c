@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+uint64_t cache_align(uint64_t offset) {
+    return (offset + CACHE_ALIGNMENT - 1) & ~(uint64_t)(CACHE_ALIGNMENT - 1);
+}
+
+//
+// Map a whole file read-only, returns NULL for missing or empty files
+//
+static void* map_file(const char* filename, size_t* size, struct stat* st) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    void* mapping = NULL;
+    if (fstat(fd, st) == 0 && st->st_size > 0) {
+        mapping = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            mapping = NULL;
+        *size = (size_t)st->st_size;
+    }
+    close(fd);
+    return mapping;
+}
+
+//
+// FNV-1a style hash over 64-bit words in four independent lanes, so validating
+// a cache costs a fraction of the work it saves
+//
+static uint64_t hash_bytes(const unsigned char* bytes, size_t size) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t lanes[4] = { 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, 0xcbf29ce4ull, 0x84222325ull };
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+        }
+    }
+
+    uint64_t hash = lanes[0];
+    for (int lane = 1; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash;
+}
+
+//
+// Size, modification time and hash of a source file
+//
+bool cache_get_source(const char* filename, cache_source_t* source) {
+    struct stat st;
+    size_t size = 0;
+    const unsigned char* bytes = (const unsigned char*)map_file(filename, &size, &st);
+    if (bytes == NULL)
+        return false;
+
+    source->size = size;
+    source->mtime = (int64_t)st.st_mtime;
+    source->hash = hash_bytes(bytes, size);
+    munmap((void*)bytes, size);
+    return true;
+}
+
+bool cache_is_same_source(const cache_source_t* a, const cache_source_t* b) {
+    return a->size == b->size && a->mtime == b->mtime && a->hash == b->hash;
+}
+
+static void cache_filename(char* buffer, size_t buffer_size, const char* source_filename) {
+    snprintf(buffer, buffer_size, "%s%s", source_filename, CACHE_EXTENSION);
+}
+
+//
+// Map the cache file of a source file, the mapping starts page aligned
+//
+void* cache_map(const char* source_filename, size_t* size) {
+    char filename[1024];
+    cache_filename(filename, sizeof(filename), source_filename);
+
+    struct stat st;
+    return map_file(filename, size, &st);
+}
+
+void cache_unmap(void* mapping, size_t size) {
+    if (mapping != NULL)
+        munmap(mapping, size);
+}
+
+//
+// Cache files are written under a temporary name and renamed when complete, so
+// a concurrent or interrupted run never maps a partial file
+//
+bool cache_begin_write(cache_writer_t* writer, const char* source_filename) {
+    cache_filename(writer->filename, sizeof(writer->filename), source_filename);
+    snprintf(writer->temp_filename, sizeof(writer->temp_filename), "%s.%ld", writer->filename, (long)getpid());
+    writer->position = 0;
+    writer->file = fopen(writer->temp_filename, "wb");
+    writer->is_written = writer->file != NULL;
+    return writer->is_written;
+}
+
+void cache_write(cache_writer_t* writer, const void* data, size_t size) {
+    if (writer->is_written && size > 0) {
+        writer->is_written = fwrite(data, 1, size, writer->file) == size;
+        writer->position += size;
+    }
+}
+
+//
+// Write data at an offset past the current position, zero padding the gap
+//
+void cache_write_at(cache_writer_t* writer, uint64_t offset, const void* data, size_t size) {
+    static const unsigned char padding[CACHE_ALIGNMENT] = { 0 };
+    while (writer->is_written && writer->position < offset) {
+        uint64_t gap = offset - writer->position;
+        cache_write(writer, padding, gap < sizeof(padding) ? (size_t)gap : sizeof(padding));
+    }
+    cache_write(writer, data, size);
+}
+
+bool cache_end_write(cache_writer_t* writer) {
+    bool is_written = writer->file != NULL && fclose(writer->file) == 0 && writer->is_written;
+    writer->file = NULL;
+
+    if (!is_written || rename(writer->temp_filename, writer->filename) != 0) {
+        remove(writer->temp_filename);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Cache files are written next to their source file with this extension
+#define CACHE_EXTENSION ".cache"
+
+// Sections of a cache file start at offsets aligned for SIMD loads
+#define CACHE_ALIGNMENT 64
+
+//
+// Identifies the source file a cache file was built from
+//
+typedef struct {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;  // Hash of the file contents
+} cache_source_t;
+
+//
+// A cache file being written under a temporary name
+//
+typedef struct {
+    FILE* file;
+    uint64_t position;
+    bool is_written;
+    char filename[1024];
+    char temp_filename[1040];
+} cache_writer_t;
+
+uint64_t cache_align(uint64_t offset);
+bool cache_get_source(const char* filename, cache_source_t* source);
+bool cache_is_same_source(const cache_source_t* a, const cache_source_t* b);
+
+void* cache_map(const char* source_filename, size_t* size);
+void cache_unmap(void* mapping, size_t size);
+
+bool cache_begin_write(cache_writer_t* writer, const char* source_filename);
+void cache_write(cache_writer_t* writer, const void* data, size_t size);
+void cache_write_at(cache_writer_t* writer, uint64_t offset, const void* data, size_t size);
+bool cache_end_write(cache_writer_t* writer);
+
+#endif
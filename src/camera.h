@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <stdbool.h>
 #include "vector.h"
 
 typedef struct {
@@ -8,6 +9,7 @@ typedef struct {
     vec3_t direction;
     vec3_t forward_velocity;
     float yaw;
+    bool is_dirty;          // Set after moving the camera, the view matrix is stale
 } camera_t;
 
 extern camera_t camera;
@@ -1,7 +1,6 @@
 #include <math.h>
 #include "clipping.h"
 
-#define NUM_PLANES 6
 plane_t frustum_planes[NUM_PLANES];
 
 /*
@@ -10,10 +9,10 @@ plane_t frustum_planes[NUM_PLANES];
 ///////////////////////////////////////////////////////////////////////////////
 // Near plane   :  P=(0, 0, znear), N=(0, 0,  1)
 // Far plane    :  P=(0, 0, zfar),  N=(0, 0, -1)
-// Top plane    :  P=(0, 0, 0),     N=(0, -cos(fov/2), sin(fov/2))
-// Bottom plane :  P=(0, 0, 0),     N=(0, cos(fov/2), sin(fov/2))
-// Left plane   :  P=(0, 0, 0),     N=(cos(fov/2), 0, sin(fov/2))
-// Right plane  :  P=(0, 0, 0),     N=(-cos(fov/2), 0, sin(fov/2))
+// Top plane    :  P=(0, 0, 0),     N=(0, -cos(fov_y/2), sin(fov_y/2))
+// Bottom plane :  P=(0, 0, 0),     N=(0, cos(fov_y/2), sin(fov_y/2))
+// Left plane   :  P=(0, 0, 0),     N=(cos(fov_x/2), 0, sin(fov_x/2))
+// Right plane  :  P=(0, 0, 0),     N=(-cos(fov_x/2), 0, sin(fov_x/2))
 ///////////////////////////////////////////////////////////////////////////////
 //
 //           /|\
@@ -28,29 +27,31 @@ plane_t frustum_planes[NUM_PLANES];
 //
 ///////////////////////////////////////////////////////////////////////////////
 */
-void init_frustum_planes(float fov, float z_near, float z_far) {
-	float cos_half_fov = cos(fov / 2);
-	float sin_half_fov = sin(fov / 2);
+void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far) {
+	float cos_half_fov_x = cos(fov_x / 2);
+	float sin_half_fov_x = sin(fov_x / 2);
+	float cos_half_fov_y = cos(fov_y / 2);
+	float sin_half_fov_y = sin(fov_y / 2);
 
 	frustum_planes[LEFT_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
-	frustum_planes[LEFT_FRUSTUM_PLANE].normal.x = cos_half_fov;
+	frustum_planes[LEFT_FRUSTUM_PLANE].normal.x = cos_half_fov_x;
 	frustum_planes[LEFT_FRUSTUM_PLANE].normal.y = 0;
-	frustum_planes[LEFT_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[LEFT_FRUSTUM_PLANE].normal.z = sin_half_fov_x;
 
 	frustum_planes[RIGHT_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
-	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.x = -cos_half_fov;
+	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.x = -cos_half_fov_x;
 	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.y = 0;
-	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.z = sin_half_fov_x;
 
 	frustum_planes[TOP_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
 	frustum_planes[TOP_FRUSTUM_PLANE].normal.x = 0;
-	frustum_planes[TOP_FRUSTUM_PLANE].normal.y = -cos_half_fov;
-	frustum_planes[TOP_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[TOP_FRUSTUM_PLANE].normal.y = -cos_half_fov_y;
+	frustum_planes[TOP_FRUSTUM_PLANE].normal.z = sin_half_fov_y;
 
 	frustum_planes[BOTTOM_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
 	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.x = 0;
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.y = cos_half_fov;
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.y = cos_half_fov_y;
+	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.z = sin_half_fov_y;
 
 	frustum_planes[NEAR_FRUSTUM_PLANE].point = vec3_new(0, 0, z_near);
 	frustum_planes[NEAR_FRUSTUM_PLANE].normal.x = 0;
@@ -61,4 +62,42 @@ void init_frustum_planes(float fov, float z_near, float z_far) {
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.x = 0;
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.y = 0;
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.z = -1;
-}
\ No newline at end of file
+}
+
+//
+// A view space sphere is outside the frustum if it lies completely behind one
+// of the planes, whose normals point inside
+//
+bool is_sphere_outside_frustum(vec3_t center, float radius) {
+	for (int i = 0; i < NUM_PLANES; i++) {
+		float distance = vec3_dot(vec3_sub(center, frustum_planes[i].point), frustum_planes[i].normal);
+		if (distance < -radius)
+			return true;
+	}
+	return false;
+}
+
+//
+// Rotate a vector by the transpose of the rotation of a matrix, which undoes
+// the rotation when there is no scale
+//
+static vec3_t rotate_transposed(mat4_t m, vec3_t v) {
+	vec3_t result = {
+		m.m[0][0] * v.x + m.m[1][0] * v.y + m.m[2][0] * v.z,
+		m.m[0][1] * v.x + m.m[1][1] * v.y + m.m[2][1] * v.z,
+		m.m[0][2] * v.x + m.m[1][2] * v.y + m.m[2][2] * v.z
+	};
+	return result;
+}
+
+//
+// Move the frustum planes into world space, so world space bounds can be tested
+// without moving each of them into view space first
+//
+void get_world_frustum_planes(mat4_t view_matrix, plane_t planes[NUM_PLANES]) {
+	vec3_t translation = { view_matrix.m[0][3], view_matrix.m[1][3], view_matrix.m[2][3] };
+	for (int i = 0; i < NUM_PLANES; i++) {
+		planes[i].point = rotate_transposed(view_matrix, vec3_sub(frustum_planes[i].point, translation));
+		planes[i].normal = rotate_transposed(view_matrix, frustum_planes[i].normal);
+	}
+}
@@ -1,7 +1,11 @@
 #ifndef CLIPPING_H
 #define CLIPPING_H
 
+#include <stdbool.h>
 #include "vector.h"
+#include "matrix.h"
+
+#define NUM_PLANES 6
 
 enum {
     LEFT_FRUSTUM_PLANE,
@@ -17,6 +21,8 @@ typedef struct {
     vec3_t normal;
 } plane_t;
 
-void init_frustum_planes(float fov, float znear, float zfar);
+void init_frustum_planes(float fov_x, float fov_y, float znear, float zfar);
+bool is_sphere_outside_frustum(vec3_t center, float radius);
+void get_world_frustum_planes(mat4_t view_matrix, plane_t planes[NUM_PLANES]);
 
 #endif
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "display.h"
+#include "kernels.h"
+#include "profile.h"
+
+enum cull_method cull_method;
+enum render_method render_method;
 
-SDL_Window* window = NULL;
-SDL_Renderer* renderer = NULL;
 int window_width = 800;
 int window_height = 600;
 
@@ -9,10 +12,14 @@ int window_height = 600;
 uint32_t* color_buffer = NULL;
 float* z_buffer = NULL;
 
+#ifndef DISPLAY_NO_SDL
+SDL_Window* window = NULL;
+SDL_Renderer* renderer = NULL;
+
 // SDL Texture
 SDL_Texture* color_buffer_texture = NULL;
 
-bool initialize_window(void) {
+static bool initialize_sdl_window(void) {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         fprintf(stderr, "Error initializing SDL.\n");
         return false;
@@ -49,9 +56,75 @@ bool initialize_window(void) {
 
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
+    // Creating a SDL texture that is used to display the color buffer
+    color_buffer_texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_RGBA32,
+        SDL_TEXTUREACCESS_STREAMING,
+        window_width,
+        window_height
+    );
+
     return true;
 }
 
+static void present_sdl_window(void) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    PROFILE_SCOPE(TIMER_UPLOAD) {
+        SDL_UpdateTexture(
+            color_buffer_texture,
+            NULL,
+            color_buffer,
+            (int) (window_width * sizeof(uint32_t))
+        );
+    }
+    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+static uint32_t get_sdl_ticks(void) {
+    return SDL_GetTicks();
+}
+
+static void delay_sdl(uint32_t milliseconds) {
+    SDL_Delay(milliseconds);
+}
+
+static void destroy_sdl_window(void) {
+    SDL_DestroyTexture(color_buffer_texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+const display_backend_t sdl_backend = {
+    .name = "SDL",
+    .has_input = true,
+    .initialize = initialize_sdl_window,
+    .present = present_sdl_window,
+    .get_ticks = get_sdl_ticks,
+    .delay = delay_sdl,
+    .destroy = destroy_sdl_window
+};
+
+const display_backend_t* display_backend = &sdl_backend;
+#else
+const display_backend_t* display_backend = &headless_backend;
+#endif
+
+bool initialize_window(void) {
+    return display_backend->initialize();
+}
+
+uint32_t get_ticks(void) {
+    return display_backend->get_ticks();
+}
+
+void delay_ticks(uint32_t milliseconds) {
+    display_backend->delay(milliseconds);
+}
+
 void draw_grid(void) {
     // Draw a background grid that fills the entire window.
     // Lines should be rendedered at every row/col multiple of 10.
@@ -106,33 +179,20 @@ void draw_rect(int x, int y, int width, int height, uint32_t color) {
 }
 
 void render_color_buffer(void) {
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int) (window_width * sizeof(uint32_t))
-    );
-    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+    PROFILE_SCOPE(TIMER_PRESENT) {
+        display_backend->present();
+    }
 }
 
 void clear_color_buffer(uint32_t color) {
-    for (int y = 0; y < window_height; y++) {
-        for (int x = 0; x < window_width; x++) {
-            color_buffer[(window_width * y) + x] = color;
-        }
-    }    
+    kernels.fill_u32(color_buffer, color, window_width * window_height);
 }
 
 void clear_z_buffer() {
-    for (int y = 0; y < window_height; y++) {
-        for (int x = 0; x < window_width; x++) {
-            z_buffer[(window_width * y) + x] = 1.0; // every time you start with z, start with 1 (1 is deepest) in left-handed coords system
-        }
-    }
+    // every time you start with z, start with 1 (1 is deepest) in left-handed coords system
+    kernels.fill_f32(z_buffer, 1.0, window_width * window_height);
 }
 
 void destroy_window(void) {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    display_backend->destroy();
 }
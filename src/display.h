@@ -4,8 +4,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+
+// Builds with -DDISPLAY_NO_SDL only have the headless backend and need no SDL
+#ifndef DISPLAY_NO_SDL
 #define SDL_DISABLE_IMMINTRIN_H
 #include <SDL.h>
+#endif
 
 #define FPS 60
 #define FRAME_TARGET_TIME (1000 / FPS)
@@ -13,7 +17,7 @@
 enum cull_method {
     CULL_NONE,
     CULL_BACKFACE
-} cull_method;
+};
 
 enum render_method {
     RENDER_WIRE,
@@ -22,17 +26,50 @@ enum render_method {
     RENDER_FILL_TRIANGLE_WIRE,
     RENDER_TEXTURED,
     RENDER_TEXTURE_WIRE
-} render_method;
+};
+
+// What the headless backend does with every frame
+typedef enum {
+    FRAME_OUTPUT_NONE,      // Drop it
+    FRAME_OUTPUT_PPM,       // Write it to a binary PPM image
+    FRAME_OUTPUT_RAW        // Write the RGBA bytes of the color buffer
+} frame_output_t;
+
+//
+// Where the color buffer goes once a frame is drawn. The SDL backend shows it
+// in a fullscreen window, the headless one keeps it in memory at the size it
+// was given and writes it to a file or drops it.
+//
+typedef struct {
+    const char* name;
+    bool has_input;                             // Keys and window events can be polled
+    bool (*initialize)(void);
+    void (*present)(void);
+    uint32_t (*get_ticks)(void);                // Milliseconds since it was initialized
+    void (*delay)(uint32_t milliseconds);
+    void (*destroy)(void);
+} display_backend_t;
 
+extern enum cull_method cull_method;
+extern enum render_method render_method;
+
+#ifndef DISPLAY_NO_SDL
 extern SDL_Window* window;
 extern SDL_Renderer* renderer;
+extern SDL_Texture* color_buffer_texture;
+extern const display_backend_t sdl_backend;
+#endif
+extern const display_backend_t headless_backend;
+extern const display_backend_t* display_backend;
 extern uint32_t* color_buffer;
 extern float* z_buffer;
-extern SDL_Texture* color_buffer_texture;
 extern int window_width;
 extern int window_height;
 
+void set_headless_display(int width, int height, frame_output_t output, const char* directory);
 bool initialize_window(void);
+uint32_t get_ticks(void);
+void delay_ticks(uint32_t milliseconds);
 void draw_grid(void);
 void draw_pixel(int x, int y, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "display.h"
+
+//
+// Offscreen display for machines without one. Frames stay in the color buffer
+// and are written to a file each or dropped. Its clock advances by exactly one
+// frame target time per frame and never waits, so frames run as fast as they
+// are drawn and an animation looks the same on every machine.
+//
+static frame_output_t frame_output = FRAME_OUTPUT_NONE;
+static const char* output_directory = ".";
+static unsigned char* row_bytes = NULL;     // One PPM row of RGB bytes
+static uint32_t ticks = 0;
+static int num_frames = 0;
+
+//
+// Use the headless backend at the given resolution, writing every frame to a
+// file in the directory, which is created when it does not exist yet
+//
+void set_headless_display(int width, int height, frame_output_t output, const char* directory) {
+    display_backend = &headless_backend;
+    window_width = width;
+    window_height = height;
+    frame_output = output;
+    if (directory != NULL)
+        output_directory = directory;
+}
+
+static bool initialize_headless(void) {
+    if (frame_output == FRAME_OUTPUT_NONE)
+        return true;
+
+    if (mkdir(output_directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating frame directory '%s'.\n", output_directory);
+        return false;
+    }
+    if (frame_output == FRAME_OUTPUT_PPM)
+        row_bytes = (unsigned char*) malloc(window_width * 3);
+    return true;
+}
+
+//
+// The color buffer holds RGBA bytes, of which a PPM row takes the first three
+//
+static void write_ppm(FILE* file) {
+    fprintf(file, "P6\n%d %d\n255\n", window_width, window_height);
+    for (int y = 0; y < window_height; y++) {
+        const unsigned char* rgba = (const unsigned char*) &color_buffer[window_width * y];
+        for (int x = 0; x < window_width; x++) {
+            row_bytes[x * 3 + 0] = rgba[x * 4 + 0];
+            row_bytes[x * 3 + 1] = rgba[x * 4 + 1];
+            row_bytes[x * 3 + 2] = rgba[x * 4 + 2];
+        }
+        fwrite(row_bytes, 3, window_width, file);
+    }
+}
+
+static void present_headless(void) {
+    ticks += FRAME_TARGET_TIME;
+    num_frames++;
+    if (frame_output == FRAME_OUTPUT_NONE)
+        return;
+
+    char filename[1024];
+    const char* extension = frame_output == FRAME_OUTPUT_PPM ? "ppm" : "raw";
+    snprintf(filename, sizeof(filename), "%s/frame_%05d.%s", output_directory, num_frames, extension);
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error writing frame '%s'.\n", filename);
+        return;
+    }
+    if (frame_output == FRAME_OUTPUT_PPM)
+        write_ppm(file);
+    else
+        fwrite(color_buffer, sizeof(uint32_t), (size_t) window_width * window_height, file);
+    fclose(file);
+}
+
+static uint32_t get_headless_ticks(void) {
+    return ticks;
+}
+
+static void delay_headless(uint32_t milliseconds) {
+    (void) milliseconds;
+}
+
+static void destroy_headless(void) {
+    free(row_bytes);
+    row_bytes = NULL;
+}
+
+const display_backend_t headless_backend = {
+    .name = "headless",
+    .has_input = false,
+    .initialize = initialize_headless,
+    .present = present_headless,
+    .get_ticks = get_headless_ticks,
+    .delay = delay_headless,
+    .destroy = destroy_headless
+};
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <string.h>
+#include "display.h"
+#include "hud.h"
+
+// Glyphs are 5x7 pixels in cells of 6x9, every pixel drawn as a square this size
+#define HUD_SCALE 2
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define CHAR_WIDTH ((GLYPH_WIDTH + 1) * HUD_SCALE)
+#define LINE_HEIGHT ((GLYPH_HEIGHT + 2) * HUD_SCALE)
+
+#define HUD_MARGIN 10
+#define HUD_PADDING 8
+#define HUD_COLUMNS 26
+#define GRAPH_HEIGHT 60
+#define GRAPH_BAR_WIDTH 2
+
+#define TEXT_COLOR 0xFFFFFFFF
+#define GRAPH_COLOR 0xFF00FF00      // Green, frames within the target time
+#define GRAPH_SLOW_COLOR 0xFF0000FF // Red, frames over the target time
+#define GRAPH_TARGET_COLOR 0xFF808080
+
+bool is_hud_visible = false;
+
+//
+// A row of bits per glyph row, the leftmost pixel in bit 4, for the characters
+// from space to underscore. Lower case letters are drawn as upper case ones.
+//
+static const uint8_t font_glyphs[64][GLYPH_HEIGHT] = {
+    ['%' - ' '] = { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },
+    ['(' - ' '] = { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },
+    [')' - ' '] = { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },
+    ['-' - ' '] = { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },
+    ['.' - ' '] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },
+    ['/' - ' '] = { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },
+    ['0' - ' '] = { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },
+    ['1' - ' '] = { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    ['2' - ' '] = { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+    ['3' - ' '] = { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+    ['4' - ' '] = { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+    ['5' - ' '] = { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+    ['6' - ' '] = { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+    ['7' - ' '] = { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+    ['8' - ' '] = { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+    ['9' - ' '] = { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+    [':' - ' '] = { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },
+    ['=' - ' '] = { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },
+    ['A' - ' '] = { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+    ['B' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+    ['C' - ' '] = { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },
+    ['D' - ' '] = { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+    ['E' - ' '] = { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },
+    ['F' - ' '] = { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+    ['G' - ' '] = { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },
+    ['H' - ' '] = { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+    ['I' - ' '] = { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    ['J' - ' '] = { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+    ['K' - ' '] = { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },
+    ['L' - ' '] = { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+    ['M' - ' '] = { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },
+    ['N' - ' '] = { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+    ['O' - ' '] = { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+    ['P' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+    ['Q' - ' '] = { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },
+    ['R' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+    ['S' - ' '] = { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },
+    ['T' - ' '] = { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+    ['U' - ' '] = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+    ['V' - ' '] = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+    ['W' - ' '] = { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },
+    ['X' - ' '] = { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+    ['Y' - ' '] = { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },
+    ['Z' - ' '] = { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }
+};
+
+// The last frames, the newest at frames[(num_frames - 1) % HUD_GRAPH_FRAMES]
+static frame_stats_t frames[HUD_GRAPH_FRAMES];
+static int num_frames = 0;
+
+void add_hud_frame(const frame_stats_t* stats) {
+    frames[num_frames % HUD_GRAPH_FRAMES] = *stats;
+    num_frames++;
+}
+
+static double get_frame_ms(const frame_stats_t* stats) {
+    double total = 0;
+    for (int i = 0; i < NUM_BENCHMARK_STAGES; i++) {
+        total += stats->stage_ms[i];
+    }
+    return total;
+}
+
+static void draw_glyph(int x, int y, char c, uint32_t color) {
+    if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (c < ' ' || c > '_')
+        return;
+
+    const uint8_t* rows = font_glyphs[c - ' '];
+    for (int row = 0; row < GLYPH_HEIGHT; row++) {
+        for (int column = 0; column < GLYPH_WIDTH; column++) {
+            if (rows[row] & (0x10 >> column))
+                draw_rect(x + column * HUD_SCALE, y + row * HUD_SCALE, HUD_SCALE, HUD_SCALE, color);
+        }
+    }
+}
+
+//
+// Draw a line of text with its top left corner at x and y
+//
+void draw_text(int x, int y, const char* text, uint32_t color) {
+    for (int i = 0; text[i] != '\0'; i++) {
+        draw_glyph(x + i * CHAR_WIDTH, y, text[i], color);
+    }
+}
+
+//
+// Halve the brightness of a rectangle, clipped to the screen, so the text
+// over it reads on any background
+//
+static void darken_rect(int x, int y, int width, int height) {
+    int x_start = x < 0 ? 0 : x;
+    int y_start = y < 0 ? 0 : y;
+    int x_end = x + width > window_width ? window_width : x + width;
+    int y_end = y + height > window_height ? window_height : y + height;
+    for (int row = y_start; row < y_end; row++) {
+        uint32_t* pixels = &color_buffer[window_width * row];
+        for (int column = x_start; column < x_end; column++) {
+            pixels[column] = ((pixels[column] >> 1) & 0x7F7F7F7F) | 0xFF000000;
+        }
+    }
+}
+
+//
+// Bars of the frame times of the last frames, oldest on the left, up to twice
+// the frame target time, with a line at the target time
+//
+static void draw_frame_graph(int x, int y) {
+    double max_ms = 2.0 * FRAME_TARGET_TIME;
+    int first_frame = num_frames > HUD_GRAPH_FRAMES ? num_frames - HUD_GRAPH_FRAMES : 0;
+    for (int frame = first_frame; frame < num_frames; frame++) {
+        double frame_ms = get_frame_ms(&frames[frame % HUD_GRAPH_FRAMES]);
+        int height = (int)(GRAPH_HEIGHT * (frame_ms < max_ms ? frame_ms : max_ms) / max_ms);
+        if (height < 1)
+            height = 1;
+        uint32_t color = frame_ms > FRAME_TARGET_TIME ? GRAPH_SLOW_COLOR : GRAPH_COLOR;
+        draw_rect(x + (frame - first_frame) * GRAPH_BAR_WIDTH, y + GRAPH_HEIGHT - height, GRAPH_BAR_WIDTH, height, color);
+    }
+    draw_rect(x, y + GRAPH_HEIGHT / 2, HUD_GRAPH_FRAMES * GRAPH_BAR_WIDTH, 1, GRAPH_TARGET_COLOR);
+}
+
+//
+// Draw the stats of the last frame and the frame time graph over the top left
+// corner of the color buffer
+//
+void draw_hud(void) {
+    if (num_frames == 0)
+        return;
+
+    const frame_stats_t* stats = &frames[(num_frames - 1) % HUD_GRAPH_FRAMES];
+    char lines[12][HUD_COLUMNS + 1];
+    int num_lines = 0;
+    double frame_ms = get_frame_ms(stats);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, "FPS %.1f", frame_ms > 0 ? 1000.0 / frame_ms : 0.0);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, "FRAME %.2f MS", frame_ms);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " UPDATE %.2f MS", stats->stage_ms[STAGE_UPDATE]);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " RASTERIZE %.2f MS", stats->stage_ms[STAGE_RASTERIZE]);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " PRESENT %.2f MS", stats->stage_ms[STAGE_PRESENT]);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " CLEAR %.2f MS", stats->stage_ms[STAGE_CLEAR]);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, "TRIANGLES %d", stats->num_submitted);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " CULLED %d", stats->num_culled);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " CLIPPED %d", stats->num_clipped);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, " RASTERIZED %d", stats->num_rasterized);
+    snprintf(lines[num_lines++], HUD_COLUMNS + 1, "PIXELS %ld", stats->num_pixels);
+
+    int width = HUD_PADDING * 2 + HUD_COLUMNS * CHAR_WIDTH;
+    int height = HUD_PADDING * 3 + num_lines * LINE_HEIGHT + GRAPH_HEIGHT;
+    darken_rect(HUD_MARGIN, HUD_MARGIN, width, height);
+
+    int x = HUD_MARGIN + HUD_PADDING;
+    int y = HUD_MARGIN + HUD_PADDING;
+    for (int i = 0; i < num_lines; i++) {
+        draw_text(x, y + i * LINE_HEIGHT, lines[i], TEXT_COLOR);
+    }
+    draw_frame_graph(x, y + num_lines * LINE_HEIGHT + HUD_PADDING);
+}
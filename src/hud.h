@@ -0,0 +1,31 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "benchmark.h"
+
+// Frames the frame time graph shows
+#define HUD_GRAPH_FRAMES 120
+
+//
+// What the HUD shows of a frame. The stage times leave out waiting for the
+// frame target time and drawing the HUD itself, and the frame rate shown is
+// the one their sum allows.
+//
+typedef struct {
+    double stage_ms[NUM_BENCHMARK_STAGES];
+    int num_submitted;      // Faces of the visible instances
+    int num_culled;         // Faces skipped by cluster and backface culling
+    int num_clipped;        // Faces dropped for reaching in front of the near plane
+    int num_rasterized;     // Filled and textured triangles drawn
+    long num_pixels;        // Pixels of their spans on the screen
+} frame_stats_t;
+
+extern bool is_hud_visible;
+
+void add_hud_frame(const frame_stats_t* stats);
+void draw_text(int x, int y, const char* text, uint32_t color);
+void draw_hud(void);
+
+#endif
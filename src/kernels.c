@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The scalar kernels use the scalar versions of the inline math as well
+#ifndef SIMD_MATH_SCALAR
+#define SIMD_MATH_SCALAR
+#endif
+#include "upng.h"
+#include "kernels.h"
+
+static void fill_u32_scalar(uint32_t* buffer, uint32_t value, int count) {
+    for (int i = 0; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+static void fill_f32_scalar(float* buffer, float value, int count) {
+    for (int i = 0; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+static void transform_points_scalar(const mat4a_t* matrix, const vec4a_t* points, vec4a_t* results, int count) {
+    mat4a_mul_vec4a_array(matrix, points, results, count);
+}
+
+// Every kernel starts out scalar, so they work before init_kernels is called
+kernels_t kernels = {
+    .fill_u32 = fill_u32_scalar,
+    .fill_f32 = fill_f32_scalar,
+    .transform_points = transform_points_scalar,
+    .draw_filled_span = draw_filled_span_scalar,
+    .draw_textured_span = draw_textured_span_scalar,
+    .expand_rgb_texels = expand_rgb_texels_scalar
+};
+
+cpu_level_t cpu_level = CPU_LEVEL_SCALAR;
+
+static const char* cpu_level_names[NUM_CPU_LEVELS] = { "scalar", "sse2", "avx2", "avx512" };
+
+/*
+// Return the barycentric weights alpha, beta, and gamma for point p
+//
+//
+//          A
+//         /|\
+//        / | \
+//       /  |  \
+//      /  (p)  \
+//     /  /   \  \
+//    / /       \ \
+//   B-------------C
+//
+*/
+static vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
+    // Find the vectors between the vertices ABC and point p
+    vec2_t ab = vec2_sub(b, a);
+    vec2_t bc = vec2_sub(c, b);
+    vec2_t ac = vec2_sub(c, a);
+    vec2_t ap = vec2_sub(p, a);
+    vec2_t bp = vec2_sub(p, b);
+
+    // Calcualte the area of the full triangle ABC using cross product (area of parallelogram)
+    float area_triangle_abc = (ab.x * ac.y - ab.y * ac.x);
+
+    // Weight alpha is the area of subtriangle BCP divided by the area of the full triangle ABC
+    float alpha = (bc.x * bp.y - bp.x * bc.y) / area_triangle_abc;
+
+    // Weight beta is the area of subtriangle ACP divided by the area of the full triangle ABC
+    float beta = (ap.x * ac.y - ac.x * ap.y) / area_triangle_abc;
+
+    // Weight gamma is easily found since barycentric cooordinates always add up to 1
+    float gamma = 1 - alpha - beta;
+
+    vec3_t weights = { alpha, beta, gamma };
+    return weights;
+}
+
+//
+// Draw a span of a solid triangle, each pixel only where it is nearer than the
+// depth buffer
+//
+void draw_filled_span_scalar(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c
+) {
+    vec2_t a = vec2_from_vec4(point_a);
+    vec2_t b = vec2_from_vec4(point_b);
+    vec2_t c = vec2_from_vec4(point_c);
+
+    for (int x = x_start; x < x_end; x++) {
+        vec2_t p = { x, y };
+        vec3_t weights = barycentric_weights(a, b, c, p);
+
+        float alpha = weights.x;
+        float beta = weights.y;
+        float gamma = weights.z;
+
+        // Interpolate the value of 1/w for the current pixel
+        float interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
+
+        // Adjust 1/w so that pixels that are close to the camera have smaller values
+        interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
+
+        // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
+        if (interpolated_reciprocal_w < depths[x]) {
+            colors[x] = color;
+            depths[x] = interpolated_reciprocal_w;
+        }
+    }
+}
+
+//
+// Draw a span of a textured triangle, with the texture coordinates
+// interpolated perspective correct
+//
+void draw_textured_span_scalar(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+) {
+    vec2_t a = vec2_from_vec4(point_a);
+    vec2_t b = vec2_from_vec4(point_b);
+    vec2_t c = vec2_from_vec4(point_c);
+    int texture_width = texture->width;
+    int texture_height = texture->height;
+
+    for (int x = x_start; x < x_end; x++) {
+        vec2_t p = { x, y };
+        vec3_t weights = barycentric_weights(a, b, c, p);
+
+        float alpha = weights.x;
+        float beta = weights.y;
+        float gamma = weights.z;
+
+        // Perform interpolation of all U/w and V/w values using barycentric weights and a factor of 1/w
+        // P = (alpha * A) + (beta * B) + (gamme * C)
+        float interpolated_u = (a_uv.u / point_a.w) * alpha + (b_uv.u / point_b.w) * beta + (c_uv.u / point_c.w) * gamma;
+        float interpolated_v = (a_uv.v / point_a.w) * alpha + (b_uv.v / point_b.w) * beta + (c_uv.v / point_c.w) * gamma;
+
+        // Interpolate the value of 1/w for the current pixel
+        float interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
+
+        // Now we can divide back both interpolated values by 1/w
+        interpolated_u /= interpolated_reciprocal_w;
+        interpolated_v /= interpolated_reciprocal_w;
+
+        // Map the UV coordinate to the full texture width and height
+        int tex_x = abs((int)(interpolated_u * texture_width));
+        int tex_y = abs((int)(interpolated_v * texture_height));
+
+        // Use modulo function to prevent texture buffer overflow
+        int tex_index = ((texture_width * tex_y) + tex_x) % (texture_width * texture_height);
+
+        // Adjust 1/w so that pixels that are close to the camera have smaller values
+        interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
+
+        // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
+        if (interpolated_reciprocal_w < depths[x]) {
+            colors[x] = texture->texels[tex_index];
+            depths[x] = interpolated_reciprocal_w;
+        }
+    }
+}
+
+//
+// Expand 24-bit RGB texels in place to 32-bit RGBA ones with an opaque alpha.
+// Walking backwards never overwrites a texel that has not been read yet.
+//
+void expand_rgb_texels_scalar(unsigned char* texels, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        unsigned char r = texels[i * 3 + 0];
+        unsigned char g = texels[i * 3 + 1];
+        unsigned char b = texels[i * 3 + 2];
+        texels[i * 4 + 0] = r;
+        texels[i * 4 + 1] = g;
+        texels[i * 4 + 2] = b;
+        texels[i * 4 + 3] = 0xFF;
+    }
+}
+
+//
+// The widest level the CPU and the operating system support
+//
+cpu_level_t get_supported_cpu_level(void) {
+#if KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return CPU_LEVEL_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return CPU_LEVEL_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return CPU_LEVEL_SSE2;
+#endif
+    return CPU_LEVEL_SCALAR;
+}
+
+//
+// Point every kernel at the widest version the CPU runs, or at most the level
+// named by the CPU_LEVEL_VARIABLE environment variable, and return the level
+//
+cpu_level_t init_kernels(void) {
+    cpu_level_t level = get_supported_cpu_level();
+
+    const char* forced = getenv(CPU_LEVEL_VARIABLE);
+    if (forced != NULL && forced[0] != '\0') {
+        int forced_level = -1;
+        for (int i = 0; i < NUM_CPU_LEVELS; i++) {
+            if (strcmp(forced, cpu_level_names[i]) == 0)
+                forced_level = i;
+        }
+        if (forced_level < 0)
+            fprintf(stderr, "Error: unknown %s '%s', using %s\n", CPU_LEVEL_VARIABLE, forced, cpu_level_names[level]);
+        else if (forced_level > (int)level)
+            fprintf(stderr, "Error: this CPU does not support %s, using %s\n", forced, cpu_level_names[level]);
+        else
+            level = (cpu_level_t)forced_level;
+    }
+
+    set_kernels_level(level);
+    return level;
+}
+
+//
+// Point every kernel at its version for a level the CPU supports
+//
+void set_kernels_level(cpu_level_t level) {
+    kernels.fill_u32 = fill_u32_scalar;
+    kernels.fill_f32 = fill_f32_scalar;
+    kernels.transform_points = transform_points_scalar;
+    kernels.draw_filled_span = draw_filled_span_scalar;
+    kernels.draw_textured_span = draw_textured_span_scalar;
+    kernels.expand_rgb_texels = expand_rgb_texels_scalar;
+#if KERNELS_X86
+    if (level >= CPU_LEVEL_SSE2)
+        set_sse2_kernels(&kernels);
+    if (level >= CPU_LEVEL_AVX2)
+        set_avx2_kernels(&kernels);
+    if (level >= CPU_LEVEL_AVX512)
+        set_avx512_kernels(&kernels);
+#endif
+    upng_set_sse2(level >= CPU_LEVEL_SSE2);
+    cpu_level = level;
+}
+
+const char* get_cpu_level_name(cpu_level_t level) {
+    return cpu_level_names[level];
+}
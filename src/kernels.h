@@ -0,0 +1,74 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include "vector.h"
+#include "simd_math.h"
+#include "texture.h"
+
+// Kernels with SSE2, AVX2 and AVX-512 versions are built on x86 with GCC or
+// Clang, every version with its own target, and picked when the CPU has it
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__TINYC__)
+#define KERNELS_X86 1
+#else
+#define KERNELS_X86 0
+#endif
+
+// Environment variable forcing a lower level: scalar, sse2, avx2 or avx512
+#define CPU_LEVEL_VARIABLE "RENDERER_CPU_LEVEL"
+
+typedef enum {
+    CPU_LEVEL_SCALAR,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_AVX512,
+    NUM_CPU_LEVELS
+} cpu_level_t;
+
+//
+// The hot loops, each pointing at the widest version the CPU runs. Every
+// version gives the same results as the scalar one, down to the last bit.
+// Spans are the pixels x_start to x_end - 1 of row y, all on the screen, and
+// colors and depths point at the start of that row.
+//
+typedef struct {
+    void (*fill_u32)(uint32_t* buffer, uint32_t value, int count);
+    void (*fill_f32)(float* buffer, float value, int count);
+    void (*transform_points)(const mat4a_t* matrix, const vec4a_t* points, vec4a_t* results, int count);
+    void (*draw_filled_span)(
+        uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+        vec4_t point_a, vec4_t point_b, vec4_t point_c
+    );
+    void (*draw_textured_span)(
+        uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+        vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+    );
+    void (*expand_rgb_texels)(unsigned char* texels, int count);
+} kernels_t;
+
+extern kernels_t kernels;
+extern cpu_level_t cpu_level;
+
+cpu_level_t init_kernels(void);
+cpu_level_t get_supported_cpu_level(void);
+void set_kernels_level(cpu_level_t level);
+const char* get_cpu_level_name(cpu_level_t level);
+
+//
+// The scalar versions, which the wider ones finish their spans with, and the
+// functions replacing the kernels a level has its own versions of
+//
+void draw_filled_span_scalar(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c
+);
+void draw_textured_span_scalar(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+);
+void expand_rgb_texels_scalar(unsigned char* texels, int count);
+void set_sse2_kernels(kernels_t* table);
+void set_avx2_kernels(kernels_t* table);
+void set_avx512_kernels(kernels_t* table);
+
+#endif
@@ -0,0 +1,207 @@
+#include "kernels.h"
+
+#if KERNELS_X86
+#include <immintrin.h>
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+static TARGET_AVX2 void fill_u32_avx2(uint32_t* buffer, uint32_t value, int count) {
+    __m256i values = _mm256_set1_epi32((int)value);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(buffer + i), values);
+    }
+    for (; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+static TARGET_AVX2 void fill_f32_avx2(float* buffer, float value, int count) {
+    __m256 values = _mm256_set1_ps(value);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(buffer + i, values);
+    }
+    for (; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+//
+// Two points at a time, each in its own half of the register with the columns
+// repeated in both halves
+//
+static TARGET_AVX2 void transform_points_avx2(const mat4a_t* matrix, const vec4a_t* points, vec4a_t* results, int count) {
+    const __m256 c0 = _mm256_broadcast_ps((const __m128*)&matrix->columns[0]);
+    const __m256 c1 = _mm256_broadcast_ps((const __m128*)&matrix->columns[1]);
+    const __m256 c2 = _mm256_broadcast_ps((const __m128*)&matrix->columns[2]);
+    const __m256 c3 = _mm256_broadcast_ps((const __m128*)&matrix->columns[3]);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m256 p = _mm256_loadu_ps(&points[i].x);
+        __m256 result = _mm256_mul_ps(c0, _mm256_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0)));
+        result = _mm256_add_ps(result, _mm256_mul_ps(c1, _mm256_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1))));
+        result = _mm256_add_ps(result, _mm256_mul_ps(c2, _mm256_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2))));
+        result = _mm256_add_ps(result, _mm256_mul_ps(c3, _mm256_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm256_storeu_ps(&results[i].x, result);
+    }
+    for (; i < count; i++) {
+        results[i] = mat4a_mul_vec4a(matrix, points[i]);
+    }
+}
+
+//
+// What the barycentric weights of the pixels of a row share, worked out once
+// in the order the scalar kernel works them out for each pixel
+//
+typedef struct {
+    __m256 a_x, b_x;
+    __m256 alpha_row, beta_row;     // bc.x * bp.y and ac.x * ap.y
+    __m256 bc_y, ac_y, area;
+    __m256 reciprocal_w[3];
+} span_setup_avx2_t;
+
+static TARGET_AVX2 span_setup_avx2_t setup_span_avx2(int y, vec4_t a, vec4_t b, vec4_t c) {
+    span_setup_avx2_t setup;
+    float ab_x = b.x - a.x, ab_y = b.y - a.y;
+    float bc_x = c.x - b.x, bc_y = c.y - b.y;
+    float ac_x = c.x - a.x, ac_y = c.y - a.y;
+    float p_y = y;
+    setup.a_x = _mm256_set1_ps(a.x);
+    setup.b_x = _mm256_set1_ps(b.x);
+    setup.alpha_row = _mm256_set1_ps(bc_x * (p_y - b.y));
+    setup.beta_row = _mm256_set1_ps(ac_x * (p_y - a.y));
+    setup.bc_y = _mm256_set1_ps(bc_y);
+    setup.ac_y = _mm256_set1_ps(ac_y);
+    setup.area = _mm256_set1_ps(ab_x * ac_y - ab_y * ac_x);
+    setup.reciprocal_w[0] = _mm256_set1_ps(1 / a.w);
+    setup.reciprocal_w[1] = _mm256_set1_ps(1 / b.w);
+    setup.reciprocal_w[2] = _mm256_set1_ps(1 / c.w);
+    return setup;
+}
+
+// The weights alpha, beta and gamma of eight pixels starting at x
+static TARGET_AVX2 void get_weights_avx2(const span_setup_avx2_t* setup, int x, __m256 weights[3]) {
+    __m256 p_x = _mm256_add_ps(_mm256_set1_ps((float)x), _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0));
+    __m256 ap_x = _mm256_sub_ps(p_x, setup->a_x);
+    __m256 bp_x = _mm256_sub_ps(p_x, setup->b_x);
+    weights[0] = _mm256_div_ps(_mm256_sub_ps(setup->alpha_row, _mm256_mul_ps(bp_x, setup->bc_y)), setup->area);
+    weights[1] = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(ap_x, setup->ac_y), setup->beta_row), setup->area);
+    weights[2] = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1), weights[0]), weights[1]);
+}
+
+static TARGET_AVX2 __m256 interpolate_avx2(const __m256 values[3], const __m256 weights[3]) {
+    __m256 result = _mm256_add_ps(_mm256_mul_ps(values[0], weights[0]), _mm256_mul_ps(values[1], weights[1]));
+    return _mm256_add_ps(result, _mm256_mul_ps(values[2], weights[2]));
+}
+
+static TARGET_AVX2 void draw_filled_span_avx2(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c
+) {
+    span_setup_avx2_t setup = setup_span_avx2(y, point_a, point_b, point_c);
+    __m256 color_values = _mm256_castsi256_ps(_mm256_set1_epi32((int)color));
+    int x = x_start;
+    for (; x + 8 <= x_end; x += 8) {
+        __m256 weights[3];
+        get_weights_avx2(&setup, x, weights);
+        __m256 depth = _mm256_sub_ps(_mm256_set1_ps(1), interpolate_avx2(setup.reciprocal_w, weights));
+
+        // Keep the old depth and color wherever they are nearer
+        __m256 old_depth = _mm256_loadu_ps(depths + x);
+        __m256 is_nearer = _mm256_cmp_ps(depth, old_depth, _CMP_LT_OQ);
+        __m256 old_colors = _mm256_loadu_ps((const float*)(colors + x));
+        _mm256_storeu_ps(depths + x, _mm256_blendv_ps(old_depth, depth, is_nearer));
+        _mm256_storeu_ps((float*)(colors + x), _mm256_blendv_ps(old_colors, color_values, is_nearer));
+    }
+    draw_filled_span_scalar(colors, depths, y, x, x_end, color, point_a, point_b, point_c);
+}
+
+//
+// The depths and texel indices of eight pixels at a time. The texel index
+// wraps with an integer remainder, which there is no vector instruction for,
+// so the remainder and the fetch are done pixel by pixel.
+//
+static TARGET_AVX2 void draw_textured_span_avx2(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+) {
+    span_setup_avx2_t setup = setup_span_avx2(y, point_a, point_b, point_c);
+    __m256 u[3] = { _mm256_set1_ps(a_uv.u / point_a.w), _mm256_set1_ps(b_uv.u / point_b.w), _mm256_set1_ps(c_uv.u / point_c.w) };
+    __m256 v[3] = { _mm256_set1_ps(a_uv.v / point_a.w), _mm256_set1_ps(b_uv.v / point_b.w), _mm256_set1_ps(c_uv.v / point_c.w) };
+    int texture_width = texture->width;
+    int texture_height = texture->height;
+    int num_texels = texture_width * texture_height;
+    __m256 width = _mm256_set1_ps(texture_width);
+    __m256 height = _mm256_set1_ps(texture_height);
+    __m256i width_values = _mm256_set1_epi32(texture_width);
+
+    int x = x_start;
+    for (; x + 8 <= x_end; x += 8) {
+        __m256 weights[3];
+        get_weights_avx2(&setup, x, weights);
+        __m256 reciprocal_w = interpolate_avx2(setup.reciprocal_w, weights);
+        __m256 interpolated_u = _mm256_div_ps(interpolate_avx2(u, weights), reciprocal_w);
+        __m256 interpolated_v = _mm256_div_ps(interpolate_avx2(v, weights), reciprocal_w);
+        __m256i tex_x = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(interpolated_u, width)));
+        __m256i tex_y = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(interpolated_v, height)));
+
+        float depth[8];
+        int tex_index[8];
+        _mm256_storeu_ps(depth, _mm256_sub_ps(_mm256_set1_ps(1), reciprocal_w));
+        _mm256_storeu_si256((__m256i*)tex_index, _mm256_add_epi32(_mm256_mullo_epi32(width_values, tex_y), tex_x));
+        for (int i = 0; i < 8; i++) {
+            if (depth[i] < depths[x + i]) {
+                colors[x + i] = texture->texels[tex_index[i] % num_texels];
+                depths[x + i] = depth[i];
+            }
+        }
+    }
+    draw_textured_span_scalar(colors, depths, y, x, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
+}
+
+//
+// Eight texels at a time, four from the twelve bytes loaded into each half of
+// the register. Blocks are read before anything is written over them, and
+// written from the last one back, like the scalar kernel walks the texels.
+//
+static TARGET_AVX2 void expand_rgb_texels_avx2(unsigned char* texels, int count) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+    );
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    int num_blocks = count / 8;
+
+    for (int i = count - 1; i >= num_blocks * 8; i--) {
+        unsigned char r = texels[i * 3 + 0];
+        unsigned char g = texels[i * 3 + 1];
+        unsigned char b = texels[i * 3 + 2];
+        texels[i * 4 + 0] = r;
+        texels[i * 4 + 1] = g;
+        texels[i * 4 + 2] = b;
+        texels[i * 4 + 3] = 0xFF;
+    }
+
+    // The second load reads four bytes past the block, which the shuffle drops.
+    // They are still inside the texel storage, which holds four bytes a texel.
+    for (int block = num_blocks - 1; block >= 0; block--) {
+        const unsigned char* rgb = texels + block * 8 * 3;
+        __m128i low = _mm_loadu_si128((const __m128i*)rgb);
+        __m128i high = _mm_loadu_si128((const __m128i*)(rgb + 12));
+        __m256i both = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        __m256i rgba = _mm256_or_si256(_mm256_shuffle_epi8(both, shuffle), alpha);
+        _mm256_storeu_si256((__m256i*)(texels + block * 8 * 4), rgba);
+    }
+}
+
+void set_avx2_kernels(kernels_t* table) {
+    table->fill_u32 = fill_u32_avx2;
+    table->fill_f32 = fill_f32_avx2;
+    table->transform_points = transform_points_avx2;
+    table->draw_filled_span = draw_filled_span_avx2;
+    table->draw_textured_span = draw_textured_span_avx2;
+    table->expand_rgb_texels = expand_rgb_texels_avx2;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "kernels.h"
+
+#if KERNELS_X86
+#include <immintrin.h>
+
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+static TARGET_AVX512 void fill_u32_avx512(uint32_t* buffer, uint32_t value, int count) {
+    __m512i values = _mm512_set1_epi32((int)value);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512(buffer + i, values);
+    }
+    if (i < count)
+        _mm512_mask_storeu_epi32(buffer + i, (__mmask16)((1u << (count - i)) - 1), values);
+}
+
+static TARGET_AVX512 void fill_f32_avx512(float* buffer, float value, int count) {
+    __m512 values = _mm512_set1_ps(value);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_ps(buffer + i, values);
+    }
+    if (i < count)
+        _mm512_mask_storeu_ps(buffer + i, (__mmask16)((1u << (count - i)) - 1), values);
+}
+
+//
+// Four points at a time, each in its own quarter of the register with the
+// columns repeated in every quarter
+//
+static TARGET_AVX512 void transform_points_avx512(const mat4a_t* matrix, const vec4a_t* points, vec4a_t* results, int count) {
+    const __m512 c0 = _mm512_broadcast_f32x4(_mm_load_ps(&matrix->columns[0].x));
+    const __m512 c1 = _mm512_broadcast_f32x4(_mm_load_ps(&matrix->columns[1].x));
+    const __m512 c2 = _mm512_broadcast_f32x4(_mm_load_ps(&matrix->columns[2].x));
+    const __m512 c3 = _mm512_broadcast_f32x4(_mm_load_ps(&matrix->columns[3].x));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m512 p = _mm512_loadu_ps(&points[i].x);
+        __m512 result = _mm512_mul_ps(c0, _mm512_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0)));
+        result = _mm512_add_ps(result, _mm512_mul_ps(c1, _mm512_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1))));
+        result = _mm512_add_ps(result, _mm512_mul_ps(c2, _mm512_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2))));
+        result = _mm512_add_ps(result, _mm512_mul_ps(c3, _mm512_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm512_storeu_ps(&results[i].x, result);
+    }
+    for (; i < count; i++) {
+        results[i] = mat4a_mul_vec4a(matrix, points[i]);
+    }
+}
+
+//
+// What the barycentric weights of the pixels of a row share, worked out once
+// in the order the scalar kernel works them out for each pixel
+//
+typedef struct {
+    __m512 a_x, b_x;
+    __m512 alpha_row, beta_row;     // bc.x * bp.y and ac.x * ap.y
+    __m512 bc_y, ac_y, area;
+    __m512 reciprocal_w[3];
+} span_setup_avx512_t;
+
+static TARGET_AVX512 span_setup_avx512_t setup_span_avx512(int y, vec4_t a, vec4_t b, vec4_t c) {
+    span_setup_avx512_t setup;
+    float ab_x = b.x - a.x, ab_y = b.y - a.y;
+    float bc_x = c.x - b.x, bc_y = c.y - b.y;
+    float ac_x = c.x - a.x, ac_y = c.y - a.y;
+    float p_y = y;
+    setup.a_x = _mm512_set1_ps(a.x);
+    setup.b_x = _mm512_set1_ps(b.x);
+    setup.alpha_row = _mm512_set1_ps(bc_x * (p_y - b.y));
+    setup.beta_row = _mm512_set1_ps(ac_x * (p_y - a.y));
+    setup.bc_y = _mm512_set1_ps(bc_y);
+    setup.ac_y = _mm512_set1_ps(ac_y);
+    setup.area = _mm512_set1_ps(ab_x * ac_y - ab_y * ac_x);
+    setup.reciprocal_w[0] = _mm512_set1_ps(1 / a.w);
+    setup.reciprocal_w[1] = _mm512_set1_ps(1 / b.w);
+    setup.reciprocal_w[2] = _mm512_set1_ps(1 / c.w);
+    return setup;
+}
+
+// The weights alpha, beta and gamma of sixteen pixels starting at x
+static TARGET_AVX512 void get_weights_avx512(const span_setup_avx512_t* setup, int x, __m512 weights[3]) {
+    const __m512 lanes = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m512 p_x = _mm512_add_ps(_mm512_set1_ps((float)x), lanes);
+    __m512 ap_x = _mm512_sub_ps(p_x, setup->a_x);
+    __m512 bp_x = _mm512_sub_ps(p_x, setup->b_x);
+    weights[0] = _mm512_div_ps(_mm512_sub_ps(setup->alpha_row, _mm512_mul_ps(bp_x, setup->bc_y)), setup->area);
+    weights[1] = _mm512_div_ps(_mm512_sub_ps(_mm512_mul_ps(ap_x, setup->ac_y), setup->beta_row), setup->area);
+    weights[2] = _mm512_sub_ps(_mm512_sub_ps(_mm512_set1_ps(1), weights[0]), weights[1]);
+}
+
+static TARGET_AVX512 __m512 interpolate_avx512(const __m512 values[3], const __m512 weights[3]) {
+    __m512 result = _mm512_add_ps(_mm512_mul_ps(values[0], weights[0]), _mm512_mul_ps(values[1], weights[1]));
+    return _mm512_add_ps(result, _mm512_mul_ps(values[2], weights[2]));
+}
+
+static TARGET_AVX512 void draw_filled_span_avx512(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c
+) {
+    span_setup_avx512_t setup = setup_span_avx512(y, point_a, point_b, point_c);
+    __m512i color_values = _mm512_set1_epi32((int)color);
+    int x = x_start;
+    for (; x + 16 <= x_end; x += 16) {
+        __m512 weights[3];
+        get_weights_avx512(&setup, x, weights);
+        __m512 depth = _mm512_sub_ps(_mm512_set1_ps(1), interpolate_avx512(setup.reciprocal_w, weights));
+
+        // Only the nearer pixels are written
+        __mmask16 is_nearer = _mm512_cmp_ps_mask(depth, _mm512_loadu_ps(depths + x), _CMP_LT_OQ);
+        _mm512_mask_storeu_ps(depths + x, is_nearer, depth);
+        _mm512_mask_storeu_epi32(colors + x, is_nearer, color_values);
+    }
+    draw_filled_span_scalar(colors, depths, y, x, x_end, color, point_a, point_b, point_c);
+}
+
+//
+// The depths and texel indices of sixteen pixels at a time, with the
+// remainder wrapping the index and the fetch done pixel by pixel
+//
+static TARGET_AVX512 void draw_textured_span_avx512(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+) {
+    span_setup_avx512_t setup = setup_span_avx512(y, point_a, point_b, point_c);
+    __m512 u[3] = { _mm512_set1_ps(a_uv.u / point_a.w), _mm512_set1_ps(b_uv.u / point_b.w), _mm512_set1_ps(c_uv.u / point_c.w) };
+    __m512 v[3] = { _mm512_set1_ps(a_uv.v / point_a.w), _mm512_set1_ps(b_uv.v / point_b.w), _mm512_set1_ps(c_uv.v / point_c.w) };
+    int texture_width = texture->width;
+    int texture_height = texture->height;
+    int num_texels = texture_width * texture_height;
+    __m512 width = _mm512_set1_ps(texture_width);
+    __m512 height = _mm512_set1_ps(texture_height);
+    __m512i width_values = _mm512_set1_epi32(texture_width);
+
+    int x = x_start;
+    for (; x + 16 <= x_end; x += 16) {
+        __m512 weights[3];
+        get_weights_avx512(&setup, x, weights);
+        __m512 reciprocal_w = interpolate_avx512(setup.reciprocal_w, weights);
+        __m512 depth = _mm512_sub_ps(_mm512_set1_ps(1), reciprocal_w);
+        __mmask16 is_nearer = _mm512_cmp_ps_mask(depth, _mm512_loadu_ps(depths + x), _CMP_LT_OQ);
+        if (is_nearer == 0)
+            continue;
+
+        __m512 interpolated_u = _mm512_div_ps(interpolate_avx512(u, weights), reciprocal_w);
+        __m512 interpolated_v = _mm512_div_ps(interpolate_avx512(v, weights), reciprocal_w);
+        __m512i tex_x = _mm512_abs_epi32(_mm512_cvttps_epi32(_mm512_mul_ps(interpolated_u, width)));
+        __m512i tex_y = _mm512_abs_epi32(_mm512_cvttps_epi32(_mm512_mul_ps(interpolated_v, height)));
+
+        int tex_index[16];
+        _mm512_storeu_si512(tex_index, _mm512_add_epi32(_mm512_mullo_epi32(width_values, tex_y), tex_x));
+        _mm512_mask_storeu_ps(depths + x, is_nearer, depth);
+        for (int i = 0; i < 16; i++) {
+            if (is_nearer & (1 << i))
+                colors[x + i] = texture->texels[tex_index[i] % num_texels];
+        }
+    }
+    draw_textured_span_scalar(colors, depths, y, x, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
+}
+
+//
+// The texel expansion needs byte shuffles across the whole register, which
+// AVX-512F does not have, so it keeps the AVX2 kernel
+//
+void set_avx512_kernels(kernels_t* table) {
+    table->fill_u32 = fill_u32_avx512;
+    table->fill_f32 = fill_f32_avx512;
+    table->transform_points = transform_points_avx512;
+    table->draw_filled_span = draw_filled_span_avx512;
+    table->draw_textured_span = draw_textured_span_avx512;
+}
+
+#endif
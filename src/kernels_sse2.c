@@ -0,0 +1,171 @@
+#include "kernels.h"
+
+#if KERNELS_X86
+#include <emmintrin.h>
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+
+static TARGET_SSE2 void fill_u32_sse2(uint32_t* buffer, uint32_t value, int count) {
+    __m128i values = _mm_set1_epi32((int)value);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(buffer + i), values);
+    }
+    for (; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+static TARGET_SSE2 void fill_f32_sse2(float* buffer, float value, int count) {
+    __m128 values = _mm_set1_ps(value);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(buffer + i, values);
+    }
+    for (; i < count; i++) {
+        buffer[i] = value;
+    }
+}
+
+static TARGET_SSE2 void transform_points_sse2(const mat4a_t* matrix, const vec4a_t* points, vec4a_t* results, int count) {
+    const __m128 c0 = _mm_load_ps(&matrix->columns[0].x);
+    const __m128 c1 = _mm_load_ps(&matrix->columns[1].x);
+    const __m128 c2 = _mm_load_ps(&matrix->columns[2].x);
+    const __m128 c3 = _mm_load_ps(&matrix->columns[3].x);
+    for (int i = 0; i < count; i++) {
+        __m128 p = _mm_load_ps(&points[i].x);
+        __m128 result = _mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)));
+        result = _mm_add_ps(result, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+        result = _mm_add_ps(result, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+        result = _mm_add_ps(result, _mm_mul_ps(c3, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_store_ps(&results[i].x, result);
+    }
+}
+
+//
+// What the barycentric weights of the pixels of a row share, worked out once
+// in the order the scalar kernel works them out for each pixel
+//
+typedef struct {
+    __m128 a_x, b_x;
+    __m128 alpha_row, beta_row;     // bc.x * bp.y and ac.x * ap.y
+    __m128 bc_y, ac_y, area;
+    __m128 reciprocal_w[3];
+} span_setup_sse2_t;
+
+static TARGET_SSE2 span_setup_sse2_t setup_span_sse2(int y, vec4_t a, vec4_t b, vec4_t c) {
+    span_setup_sse2_t setup;
+    float ab_x = b.x - a.x, ab_y = b.y - a.y;
+    float bc_x = c.x - b.x, bc_y = c.y - b.y;
+    float ac_x = c.x - a.x, ac_y = c.y - a.y;
+    float p_y = y;
+    setup.a_x = _mm_set1_ps(a.x);
+    setup.b_x = _mm_set1_ps(b.x);
+    setup.alpha_row = _mm_set1_ps(bc_x * (p_y - b.y));
+    setup.beta_row = _mm_set1_ps(ac_x * (p_y - a.y));
+    setup.bc_y = _mm_set1_ps(bc_y);
+    setup.ac_y = _mm_set1_ps(ac_y);
+    setup.area = _mm_set1_ps(ab_x * ac_y - ab_y * ac_x);
+    setup.reciprocal_w[0] = _mm_set1_ps(1 / a.w);
+    setup.reciprocal_w[1] = _mm_set1_ps(1 / b.w);
+    setup.reciprocal_w[2] = _mm_set1_ps(1 / c.w);
+    return setup;
+}
+
+// The weights alpha, beta and gamma of four pixels starting at x
+static TARGET_SSE2 void get_weights_sse2(const span_setup_sse2_t* setup, int x, __m128 weights[3]) {
+    __m128 p_x = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3, 2, 1, 0));
+    __m128 ap_x = _mm_sub_ps(p_x, setup->a_x);
+    __m128 bp_x = _mm_sub_ps(p_x, setup->b_x);
+    weights[0] = _mm_div_ps(_mm_sub_ps(setup->alpha_row, _mm_mul_ps(bp_x, setup->bc_y)), setup->area);
+    weights[1] = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ap_x, setup->ac_y), setup->beta_row), setup->area);
+    weights[2] = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1), weights[0]), weights[1]);
+}
+
+static TARGET_SSE2 __m128 interpolate_sse2(const __m128 values[3], const __m128 weights[3]) {
+    __m128 result = _mm_add_ps(_mm_mul_ps(values[0], weights[0]), _mm_mul_ps(values[1], weights[1]));
+    return _mm_add_ps(result, _mm_mul_ps(values[2], weights[2]));
+}
+
+static TARGET_SSE2 void draw_filled_span_sse2(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, uint32_t color,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c
+) {
+    span_setup_sse2_t setup = setup_span_sse2(y, point_a, point_b, point_c);
+    __m128i color_values = _mm_set1_epi32((int)color);
+    int x = x_start;
+    for (; x + 4 <= x_end; x += 4) {
+        __m128 weights[3];
+        get_weights_sse2(&setup, x, weights);
+        __m128 depth = _mm_sub_ps(_mm_set1_ps(1), interpolate_sse2(setup.reciprocal_w, weights));
+
+        // Keep the old depth and color wherever they are nearer
+        __m128 old_depth = _mm_loadu_ps(depths + x);
+        __m128 is_nearer = _mm_cmplt_ps(depth, old_depth);
+        __m128i is_nearer_bits = _mm_castps_si128(is_nearer);
+        __m128i old_colors = _mm_loadu_si128((const __m128i*)(colors + x));
+        _mm_storeu_ps(depths + x, _mm_or_ps(_mm_and_ps(is_nearer, depth), _mm_andnot_ps(is_nearer, old_depth)));
+        _mm_storeu_si128((__m128i*)(colors + x),
+            _mm_or_si128(_mm_and_si128(is_nearer_bits, color_values), _mm_andnot_si128(is_nearer_bits, old_colors)));
+    }
+    draw_filled_span_scalar(colors, depths, y, x, x_end, color, point_a, point_b, point_c);
+}
+
+static TARGET_SSE2 __m128i abs_epi32_sse2(__m128i v) {
+    __m128i sign = _mm_srai_epi32(v, 31);
+    return _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+}
+
+//
+// The depths and texel coordinates of four pixels at a time, with the texels
+// fetched one by one since SSE2 has no gathers
+//
+static TARGET_SSE2 void draw_textured_span_sse2(
+    uint32_t* colors, float* depths, int y, int x_start, int x_end, const texture_t* texture,
+    vec4_t point_a, vec4_t point_b, vec4_t point_c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+) {
+    span_setup_sse2_t setup = setup_span_sse2(y, point_a, point_b, point_c);
+    __m128 u[3] = { _mm_set1_ps(a_uv.u / point_a.w), _mm_set1_ps(b_uv.u / point_b.w), _mm_set1_ps(c_uv.u / point_c.w) };
+    __m128 v[3] = { _mm_set1_ps(a_uv.v / point_a.w), _mm_set1_ps(b_uv.v / point_b.w), _mm_set1_ps(c_uv.v / point_c.w) };
+    int texture_width = texture->width;
+    int texture_height = texture->height;
+    int num_texels = texture_width * texture_height;
+    __m128 width = _mm_set1_ps(texture_width);
+    __m128 height = _mm_set1_ps(texture_height);
+
+    int x = x_start;
+    for (; x + 4 <= x_end; x += 4) {
+        __m128 weights[3];
+        get_weights_sse2(&setup, x, weights);
+        __m128 reciprocal_w = interpolate_sse2(setup.reciprocal_w, weights);
+        __m128 interpolated_u = _mm_div_ps(interpolate_sse2(u, weights), reciprocal_w);
+        __m128 interpolated_v = _mm_div_ps(interpolate_sse2(v, weights), reciprocal_w);
+
+        float depth[4];
+        int tex_x[4], tex_y[4];
+        _mm_storeu_ps(depth, _mm_sub_ps(_mm_set1_ps(1), reciprocal_w));
+        _mm_storeu_si128((__m128i*)tex_x, abs_epi32_sse2(_mm_cvttps_epi32(_mm_mul_ps(interpolated_u, width))));
+        _mm_storeu_si128((__m128i*)tex_y, abs_epi32_sse2(_mm_cvttps_epi32(_mm_mul_ps(interpolated_v, height))));
+        for (int i = 0; i < 4; i++) {
+            if (depth[i] < depths[x + i]) {
+                colors[x + i] = texture->texels[((texture_width * tex_y[i]) + tex_x[i]) % num_texels];
+                depths[x + i] = depth[i];
+            }
+        }
+    }
+    draw_textured_span_scalar(colors, depths, y, x, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
+}
+
+//
+// Expanding RGB texels needs byte shuffles SSE2 does not have, so that kernel
+// stays scalar at this level
+//
+void set_sse2_kernels(kernels_t* table) {
+    table->fill_u32 = fill_u32_sse2;
+    table->fill_f32 = fill_f32_sse2;
+    table->transform_points = transform_points_sse2;
+    table->draw_filled_span = draw_filled_span_sse2;
+    table->draw_textured_span = draw_textured_span_sse2;
+}
+
+#endif
@@ -1,40 +1,76 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
-#define SDL_DISABLE_IMMINTRIN_H
-#include <SDL.h>
+#include <string.h>
 #include "upng.h"
 #include "array.h"
 #include "display.h"
 #include "vector.h"
 #include "light.h"
 #include "matrix.h"
+#include "simd_math.h"
+#include "kernels.h"
 #include "camera.h"
 #include "triangle.h"
 #include "texture.h"
 #include "mesh.h"
+#include "mesh_compact.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
 #include "clipping.h"
+#include "thread_pool.h"
+#include "asset_loader.h"
+#include "scene.h"
+#include "occlusion.h"
+#include "benchmark.h"
+#include "profile.h"
+#include "hud.h"
 
 #ifndef M_PI
 #define M_PI (3.14159265358979323846)
 #endif
 
+// Aircraft instances the fleet puts in the scene, in rows going away from the camera
+#define FLEET_ROWS 15
+#define FLEET_COLUMNS 20
+#define FLEET_SPACING 4.0
+#define FLEET_NUM_MODELS 3
+
+// Models the benchmark draws, those without a PNG are drawn untextured
+#define NUM_BENCHMARK_MODELS 7
+#define NUM_RENDER_METHODS 6
+
 //
 // Global variables for execution status and game loop
 //
 bool is_running = false;
+int num_frames_to_run = 0;      // Run until quit when 0
+const char* benchmark_filename = NULL;
 int previous_frame_time = 0;
 float delta_time = 0;
+frame_stats_t frame_stats;      // Stats of the frame being drawn, for the HUD
 bool is_autorotate = false;
 float rotation_rate = 0.05;
 float rotation_increment = 0.01;
 
+//
+// Rotation of the first instance as angles around the x, y and z axes, turned
+// into the quaternion of its transform whenever they change
+//
+vec3_t model_rotation = { 0, 0, 0 };
+
 //
 // Array of triangles that should be rendered frame by frame
 //
-#define MAX_TRIANGLES_PER_MESH 10000
-triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
-int num_triangles_to_render = 0;
+triangle_t* triangles_to_render = NULL;
+
+//
+// Meshes and textures of the fleet, loaded the first time it is shown
+//
+bool is_fleet_loaded = false;
+int fleet_meshes[FLEET_NUM_MODELS];
+int fleet_textures[FLEET_NUM_MODELS];
+int fleet_group = -1;
 
 //
 // Declaration of global transformation matrices
@@ -42,11 +78,49 @@ int num_triangles_to_render = 0;
 mat4_t world_matrix;
 mat4_t proj_matrix;
 mat4_t view_matrix; 
+float z_near = 0.1;
+float z_far = 100.0;
+
+//
+// Add a mesh to the scene and queue its OBJ file to load, returning its index,
+// or -1 when the scene has no room left for it
+//
+int load_scene_mesh(char* filename) {
+    int index;
+    mesh_t* mesh = add_scene_mesh(&scene, &index);
+    if (mesh == NULL) {
+        fprintf(stderr, "Error: no room in the scene for the mesh %s\n", filename);
+        return -1;
+    }
+    request_obj_file(filename, mesh);
+    return index;
+}
+
+//
+// Add a texture to the scene and queue its PNG file to load, returning its
+// index, or -1 for no texture when the scene has no room left for it
+//
+int load_scene_texture(char* filename) {
+    int index;
+    texture_t* texture = add_scene_texture(&scene, &index);
+    if (texture == NULL) {
+        fprintf(stderr, "Error: no room in the scene for the texture %s\n", filename);
+        return -1;
+    }
+    request_png_texture(filename, texture);
+    return index;
+}
 
 //
 // Setup function to initialise variables and game objects
 //
 void setup(void) {
+    // Pick the widest kernels the CPU runs before anything uses them
+    printf("CPU: %s kernels.\n", get_cpu_level_name(init_kernels()));
+
+    // Start one worker thread per CPU for asset loading
+    thread_pool_init(0);
+
     // Initialize render mode and triangle culling method
     render_method = RENDER_TEXTURED;
     cull_method = CULL_BACKFACE;
@@ -55,37 +129,80 @@ void setup(void) {
     color_buffer = (uint32_t*) malloc(sizeof(uint32_t) * window_width * window_height);
     z_buffer = (float*) malloc(sizeof(float) * window_width * window_height);
 
-    // Creating a SDL texture that is used to display the color buffer
-    color_buffer_texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_RGBA32,
-        SDL_TEXTUREACCESS_STREAMING,
-        window_width,
-        window_height
-    );
+    // Render clears the buffers after each frame, so the first one needs them cleared here
+    clear_color_buffer(0xFF000000);
+    clear_z_buffer();
 
     // Inititialize the perspective projection matrix
     float fov = M_PI / 3.0; // in radians - the same as 180 / 3 or 60 degrees
     float aspect = (float) window_height / window_width;
-    float z_near = 0.1;
-    float z_far = 100.0;
     proj_matrix = mat4_make_perspective(fov, aspect, z_near, z_far);
 
-    // Initialize frustum planes with a point and a normal
-    init_frustum_planes(fov, z_near, z_far);
+    // Initialize frustum planes with a point and a normal, the horizontal field
+    // of view is wider by the aspect ratio
+    float fov_x = atan(tan(fov / 2) / aspect) * 2;
+    init_frustum_planes(fov_x, fov, z_near, z_far);
+
+    // Queue the mesh and its PNG texture to load in the background, frames are
+    // drawn with whatever has loaded so far. Its instance is the one the keys rotate,
+    // and the scene is still empty so there is room for its mesh.
+    int mesh_index = load_scene_mesh("./assets/efa.obj");
+    int texture_index = load_scene_texture("./assets/efa.png");
+    vec3_t translation = { 0, 0, 4.0 };
+    add_scene_instance(&scene, mesh_index, texture_index, -1, translation);
+}
 
-    // Loads the cube values in the mesh data structure
-    // load_cube_mesh_data();
-    load_obj_file_data("./assets/efa.obj");
+//
+// Show or hide a fleet of aircraft instances behind the first one, placed in a
+// group of their own. They share three meshes and textures, loaded the first
+// time the fleet is shown.
+//
+void toggle_fleet(void) {
+    if (fleet_group >= 0) {
+        truncate_scene(&scene, 1, fleet_group);
+        fleet_group = -1;
+        printf("Mode: Fleet hidden.\n");
+        return;
+    }
 
-    // Load texture information from an external PNG file
-    load_png_texture_data("./assets/efa.png");
+    if (!is_fleet_loaded) {
+        char* obj_files[FLEET_NUM_MODELS - 1] = { "./assets/f22.obj", "./assets/f117.obj" };
+        char* png_files[FLEET_NUM_MODELS - 1] = { "./assets/f22.png", "./assets/f117.png" };
+        // The last model is the one already loaded for the first instance, and
+        // stands in for the others when the scene has no room for them
+        fleet_meshes[FLEET_NUM_MODELS - 1] = scene.instances[0].mesh;
+        fleet_textures[FLEET_NUM_MODELS - 1] = scene.instances[0].texture;
+        for (int i = 0; i < FLEET_NUM_MODELS - 1; i++) {
+            fleet_meshes[i] = load_scene_mesh(obj_files[i]);
+            fleet_textures[i] = load_scene_texture(png_files[i]);
+            if (fleet_meshes[i] < 0) {
+                fleet_meshes[i] = fleet_meshes[FLEET_NUM_MODELS - 1];
+                fleet_textures[i] = fleet_textures[FLEET_NUM_MODELS - 1];
+            }
+        }
+        is_fleet_loaded = true;
+    }
+
+    vec3_t group_translation = { 0, -2.0, 8.0 };
+    vec3_t up_axis = { 0, 1, 0 };
+    fleet_group = add_scene_group(&scene, -1, group_translation);
+    for (int row = 0; row < FLEET_ROWS; row++) {
+        for (int column = 0; column < FLEET_COLUMNS; column++) {
+            int model = (row + column) % FLEET_NUM_MODELS;
+            vec3_t translation = { (column - (FLEET_COLUMNS - 1) / 2.0) * FLEET_SPACING, 0, row * FLEET_SPACING };
+            instance_t* instance = add_scene_instance(&scene, fleet_meshes[model], fleet_textures[model], fleet_group, translation);
+            quat_t rotation = quat_from_axis_angle(up_axis, (row * FLEET_COLUMNS + column) * 0.7);
+            set_transform_rotation(&scene.transforms, instance->transform, rotation);
+        }
+    }
+    printf("Mode: Fleet of %d instances shown.\n", FLEET_ROWS * FLEET_COLUMNS);
 }
 
 //
 // Poll system events and handle keyboard input
 //
 void process_input(void) {
+#ifndef DISPLAY_NO_SDL
     SDL_Event event;
     SDL_PollEvent(&event);
 
@@ -144,21 +261,58 @@ void process_input(void) {
                     is_autorotate = !is_autorotate;
                     printf("Mode: Automatic rotation is %s.\n", is_autorotate ? "on" : "off");
                     break;
+                case SDLK_l:
+                    // Toggle level of detail selection
+                    use_mesh_lods = !use_mesh_lods;
+                    printf("Mode: Level of detail %s.\n", use_mesh_lods ? "on" : "off");
+                    break;
+                case SDLK_m:
+                    // Toggle culling whole face clusters
+                    use_meshlet_culling = !use_meshlet_culling;
+                    printf("Mode: Cluster culling %s.\n", use_meshlet_culling ? "on" : "off");
+                    break;
+                case SDLK_f:
+                    // Toggle the fleet of aircraft instances
+                    toggle_fleet();
+                    break;
+                case SDLK_o:
+                    // Toggle culling instances hidden behind the nearest large ones
+                    use_occlusion_culling = !use_occlusion_culling;
+                    printf("Mode: Occlusion culling %s.\n", use_occlusion_culling ? "on" : "off");
+                    break;
+                case SDLK_h:
+                    // Toggle the performance HUD over the top left corner
+                    is_hud_visible = !is_hud_visible;
+                    printf("Mode: Performance HUD %s.\n", is_hud_visible ? "shown" : "hidden");
+                    break;
+                case SDLK_i:
+                    // Print the culling counters of the last frame
+                    printf("Culling: %d of %d instances visible; %d of %d clusters outside the frustum, %d facing away; %d of %d faces culled one by one.\n",
+                        array_length(scene.visible), array_length(scene.instances), cull_stats.num_frustum_culled, cull_stats.num_meshlets, cull_stats.num_backface_culled,
+                        cull_stats.num_faces_culled, cull_stats.num_faces);
+                    printf("Occlusion: %d occluders of %d faces hid %d of %d instances in %.3f ms.\n",
+                        occlusion_stats.num_occluders, occlusion_stats.num_occluder_faces, occlusion_stats.num_culled,
+                        occlusion_stats.num_tested, occlusion_stats.milliseconds);
+                    break;
                 case SDLK_UP:
                     // Move camera up
                     camera.position.y += 3.0 * delta_time;
+                    camera.is_dirty = true;
                     break;
                 case SDLK_DOWN:
                     // Move camera down
                     camera.position.y -= 3.0 * delta_time;
+                    camera.is_dirty = true;
                     break;
                 case SDLK_LEFT:
                     // Rotate left
-                    mesh.rotation.y -= rotation_rate * delta_time;
+                    model_rotation.y -= rotation_rate * delta_time;
+                    set_transform_rotation(&scene.transforms, scene.instances[0].transform, quat_from_euler(model_rotation));
                     break;
                 case SDLK_RIGHT:
                     // Rotate right
-                    mesh.rotation.y += rotation_rate * delta_time;
+                    model_rotation.y += rotation_rate * delta_time;
+                    set_transform_rotation(&scene.transforms, scene.instances[0].transform, quat_from_euler(model_rotation));
                     break;
                 case SDLK_PERIOD:
                     // Increase rotation rate
@@ -174,25 +328,179 @@ void process_input(void) {
                     // Move camera forward
                     camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time);
                     camera.position = vec3_add(camera.position, camera.forward_velocity);
+                    camera.is_dirty = true;
                     break;
                 case SDLK_s:
                     // Move camera backward
                     camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time);
                     camera.position = vec3_sub(camera.position, camera.forward_velocity);
+                    camera.is_dirty = true;
                     break;
                 case SDLK_a:
                     // Yaw camera left
                     camera.yaw += 1.0 * delta_time;
+                    camera.is_dirty = true;
                     break;
                 case SDLK_d:
                     // Yaw camera right
                     camera.yaw -= 1.0 * delta_time;
+                    camera.is_dirty = true;
                     break;
 
 
             }
             break;
     }
+#endif
+}
+
+//
+// Transform, cull and project the faces of a visible instance into the array
+// of triangles to render
+//
+void project_instance(const visible_instance_t* visible) {
+    const instance_t* instance = &scene.instances[visible->instance];
+    const mesh_t* mesh = &scene.meshes[instance->mesh];
+    const texture_t* texture = NULL;
+    if (instance->texture >= 0 && scene.textures[instance->texture].texels != NULL)
+        texture = &scene.textures[instance->texture];
+    world_matrix = scene.transforms.nodes[instance->transform].world_matrix;
+    mat4a_t world = mat4a_from_mat4(world_matrix);
+    mat4a_t view = mat4a_from_mat4(view_matrix);
+
+    // Walk the faces cluster by cluster, meshes without clusters as a single one
+    int num_faces = get_mesh_num_faces(mesh, instance->lod);
+    int num_meshlets;
+    const meshlet_t* meshlets = get_mesh_meshlets(mesh, instance->lod, &num_meshlets);
+    meshlet_t all_faces = { .first_face = 0, .num_faces = num_faces };
+    bool is_meshlet_culling = use_meshlet_culling && meshlets != NULL;
+    if (meshlets == NULL) {
+        meshlets = &all_faces;
+        num_meshlets = 1;
+    }
+    meshlet_view_t meshlet_view = make_meshlet_view(visible->world_view_matrix, cull_method == CULL_BACKFACE);
+
+    // Room for every face up front; when out of memory the triangles are still
+    // pushed one by one, keeping those already projected this frame
+    triangle_t* reserved = array_reserve(triangles_to_render, num_faces, sizeof(triangle_t));
+    if (reserved != NULL)
+        triangles_to_render = reserved;
+    cull_stats.num_faces_submitted += num_faces;
+    for (int m = 0; m < num_meshlets; m++) {
+        // Skip clusters outside the frustum or facing away before any per face work
+        if (is_meshlet_culling && is_meshlet_culled(&meshlets[m], &meshlet_view))
+            continue;
+
+        // Move the corners of the faces of a cluster to camera space together,
+        // faces of meshes without clusters as many at a time as a cluster holds
+        int end_face = meshlets[m].first_face + meshlets[m].num_faces;
+        for (int first_face = meshlets[m].first_face; first_face < end_face; first_face += MESHLET_MAX_FACES) {
+            int num_batch_faces = end_face - first_face < MESHLET_MAX_FACES ? end_face - first_face : MESHLET_MAX_FACES;
+            vertex_t batch_vertices[MESHLET_MAX_FACES * 3];
+            vec4a_t batch_points[MESHLET_MAX_FACES * 3];
+
+            // Fetch the face vertices, dequantized if the mesh is compact
+            for (int i = 0; i < num_batch_faces; i++) {
+                get_mesh_face_vertices(mesh, instance->lod, first_face + i, &batch_vertices[i * 3]);
+            }
+            for (int j = 0; j < num_batch_faces * 3; j++) {
+                batch_points[j] = vec4a_from_vec3(batch_vertices[j].position, 1);
+            }
+
+            // Multiply the world matrix by the original vectors, then the view
+            // matrix by them to transform the scene to camera space
+            PROFILE_SCOPE(TIMER_TRANSFORM) {
+                kernels.transform_points(&world, batch_points, batch_points, num_batch_faces * 3);
+                kernels.transform_points(&view, batch_points, batch_points, num_batch_faces * 3);
+            }
+
+            for (int i = 0; i < num_batch_faces; i++) {
+                cull_stats.num_faces++;
+                const vertex_t* face_vertices = &batch_vertices[i * 3];
+                const vec4a_t* transformed_vertices = &batch_points[i * 3];
+
+                // Triangles are not clipped, drop those reaching in front of the near plane
+                if (transformed_vertices[0].z < z_near || transformed_vertices[1].z < z_near || transformed_vertices[2].z < z_near) {
+                    cull_stats.num_faces_clipped++;
+                    continue;
+                }
+        
+        
+                // Get individual vectors from A, B and C vertices to compute normal
+                vec4a_t vector_a = transformed_vertices[0]; /*   A   */
+                vec4a_t vector_b = transformed_vertices[1]; /*  / \  */
+                vec4a_t vector_c = transformed_vertices[2]; /* C---B */
+
+                // Get the vector subtraction (B-A) and (C-A), normalized
+                vec4a_t vector_ab = vec4a_normalize3(vec4a_sub(vector_b, vector_a));
+                vec4a_t vector_ac = vec4a_normalize3(vec4a_sub(vector_c, vector_a));
+
+                // Compute the face normal (using cross product to find perpendicular)
+                // because the coordinate system is left handed the cross product will (AB cross CA)
+                // Normalize the face normal vector
+                vec4a_t normal = vec4a_normalize3(vec4a_cross3(vector_ab, vector_ac));
+
+                // Find the the vector between a point in the triangle and the camera origin
+                vec4a_t camera_ray = vec4a_sub(vec4a_new(0, 0, 0, 0), vector_a);
+
+                // Calculate how aligned the camera ray is with the dot normal (using dot product)
+                float dot_normal_camera = vec4a_dot3(normal, camera_ray);
+
+                // Backface culling test to see if the current face should be projected
+                if (cull_method == CULL_BACKFACE) {
+                    // Bypass triangle that are looking away from the camera
+                    if (dot_normal_camera < 0) {
+                        cull_stats.num_faces_culled++;
+                        continue;
+                    }
+                }
+            
+                vec4_t projected_points[3];
+
+                // Loop all three vertices to perform the projection
+                for (int j = 0; j < 3; j++) {
+                    // Project the current vertex
+                    projected_points[j] = mat4_mul_vec4_project(proj_matrix, vec4_from_vec4a(transformed_vertices[j]));
+
+                    // Flip vertically since the y values of the 3D mesh grow bottom->up and in screen space y values grow top->down
+                    projected_points[j].y *= -1;
+
+                    // Scale into the view
+                    projected_points[j].x *= window_width / 2.0;
+                    projected_points[j].y *= window_height / 2.0;
+
+                    // Translate the projected point to the middle of the screen
+                    projected_points[j].x += (window_width / 2.0);
+                    projected_points[j].y += (window_height / 2.0);
+
+                }
+
+                // Calculate the shade intensity based on how alighen the face normal and the inverse of the light ray
+                float light_intensity_factor = -vec4a_dot3(normal, vec4a_from_vec3(light.direction, 0));
+
+                // Calculate the color based on the light angle
+                uint32_t triangle_color = light_apply_intensity(mesh->color, light_intensity_factor);
+
+                triangle_t projected_triangle = {
+                    .points = {
+                        { projected_points[0].x, projected_points[0].y, projected_points[0].z, projected_points[0].w },
+                        { projected_points[1].x, projected_points[1].y, projected_points[1].z, projected_points[1].w },
+                        { projected_points[2].x, projected_points[2].y, projected_points[2].z, projected_points[2].w }
+                    },
+                    .texcoords = {
+                        { face_vertices[0].uv.u, face_vertices[0].uv.v },
+                        { face_vertices[1].uv.u, face_vertices[1].uv.v },
+                        { face_vertices[2].uv.u, face_vertices[2].uv.v }
+                    },
+                    .color = triangle_color,
+                    .texture = texture
+                };
+       
+                // Save the projected triangle in the array of triangles to render
+                array_push(triangles_to_render, projected_triangle);
+            }
+        }
+    }
 }
 
 //
@@ -200,185 +508,105 @@ void process_input(void) {
 //
 void update(void) {
     // Wait some time until we reach the target frame time in milliseconds
-    int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
+    PROFILE_BEGIN(TIMER_WAIT);
+    int time_to_wait = FRAME_TARGET_TIME - (get_ticks() - previous_frame_time);
     
     // Only delay execution if we are running too fast
     if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
-        SDL_Delay(time_to_wait);
+        delay_ticks(time_to_wait);
     }
+    PROFILE_END(TIMER_WAIT);
+    PROFILE_BEGIN(TIMER_UPDATE);
+    double update_start_ms = get_benchmark_ms();
     
     // Get a delta time factor converted to seconds to be used to update objects
-    delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.00;
+    delta_time = (get_ticks() - previous_frame_time) / 1000.00;
+
+    previous_frame_time = get_ticks();
 
-    previous_frame_time = SDL_GetTicks();
+    // Swap in the assets that finished loading since the last frame, the bounds
+    // of the instances drawing them change with them
+    if (poll_asset_requests() > 0)
+        invalidate_scene(&scene);
 
-    // Initialise the counter of triangles to render for the current frame
-    num_triangles_to_render = 0;
+    // Empty the array of triangles to render but keep its memory for this frame
+    array_clear(triangles_to_render);
     
 
-    // Change the mesh scale, rotation & translation values per animation frame
+    // Change the rotation of the first instance per animation frame
     if (is_autorotate) {
-        mesh.rotation.x -= rotation_rate * delta_time;
-        mesh.rotation.y += rotation_rate * delta_time;
-        mesh.rotation.z += rotation_rate * delta_time;
+        model_rotation.x -= rotation_rate * delta_time;
+        model_rotation.y += rotation_rate * delta_time;
+        model_rotation.z += rotation_rate * delta_time;
+        set_transform_rotation(&scene.transforms, scene.instances[0].transform, quat_from_euler(model_rotation));
     }
-    mesh.translation.z = 4.0;
 
-    
-    vec3_t up_direction = { 0, 1, 0 };
-    
-    // Initialize the target looking at the positive z-axis
-    vec3_t target = { 0, 0, 1 };
-    mat4_t camera_yaw_rotation = mat4_make_rotation_y(camera.yaw);
-    camera.direction = vec3_from_vec4(mat4_mul_vec4(camera_yaw_rotation, vec4_from_vec3(target)));
-
-    // Offset the camera position in the direction where the camera is pointing at
-    target = vec3_add(camera.position, camera.direction);
-
-    // Create the view matrix   
-    view_matrix = mat4_look_at(camera.position, target, up_direction);
-
-    // Create a scale matrix, rotation and translation that will be used to multiply the mesh vertices 
-    mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.z);
-    mat4_t translation_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
-    mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh.rotation.x);
-    mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh.rotation.y);
-    mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh.rotation.z);
-    
-    // Loop all triangle faces of our mesh
-    int num_faces = array_length(mesh.faces);
-    for (int i = 0; i < num_faces; i++) {
-        face_t mesh_face = mesh.faces[i];
-        
-        vec3_t face_vertices[3];
-        face_vertices[0] = mesh.vertices[mesh_face.a];
-        face_vertices[1] = mesh.vertices[mesh_face.b];
-        face_vertices[2] = mesh.vertices[mesh_face.c];
-
-        vec4_t transformed_vertices[3];
-
-        // Loop all three vertices of this current face and apply transformations
-        for (int j = 0; j < 3; j++) {
-            vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
-
-            // Create a World Matrix cominging scale, rptatopm amd translation matrices
-            world_matrix = mat4_identity(); // Start with the eye/identity matix
-            // Graphics pipeline:
-            // Order matters: First scale, then rotate, then translate. [T]*[R]*[S]*v
-
-            // #1 Scale
-            world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-            // #2 Rotate
-            world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-            // #3 Translate
-            world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-            // Multiply the world matrix by the original vector
-            transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
-
-            // Multiply the view matrix by the vector to transform scene to camera space
-            transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
-
-            // Save transformed vertex in the array of transformed vertices
-            transformed_vertices[j] = transformed_vertex;
-        }
-        
-        
-        // Get individual vectors from A, B and C vertices to compute normal
-        vec3_t vector_a = vec3_from_vec4(transformed_vertices[0]); /*   A   */
-        vec3_t vector_b = vec3_from_vec4(transformed_vertices[1]); /*  / \  */
-        vec3_t vector_c = vec3_from_vec4(transformed_vertices[2]); /* C---B */
-
-        // Get the vector subtraction (B-A) and (C-A)
-        vec3_t vector_ab = vec3_sub(vector_b, vector_a);
-        vec3_t vector_ac = vec3_sub(vector_c, vector_a);
-        // Normalize to normal vectors
-        vec3_normalize(&vector_ab);
-        vec3_normalize(&vector_ac);
-
-        // Compute the face normal (using cross product to find perpendicular)
-        // because the coordinate system is left handed the cross product will (AB cross CA)
-        vec3_t normal = vec3_cross(vector_ab, vector_ac);
-
-        // Normalize the face normal vector
-        vec3_normalize(&normal);
-
-        // Find the the vector between a point in the triangle and the camera origin
-        vec3_t origin = { 0, 0, 0 };
-        vec3_t camera_ray = vec3_sub(origin, vector_a);
-
-        // Calculate how aligned the camera ray is with the dot normal (using dot product)
-        float dot_normal_camera = vec3_dot(normal, camera_ray);
-
-        // Backface culling test to see if the current face should be projected
-        if (cull_method == CULL_BACKFACE) {
-            // Bypass triangle that are looking away from the camera
-            if (dot_normal_camera < 0)
-                continue;
-        }
-            
-        vec4_t projected_points[3];
+    // The view matrix only changes when the camera moved
+    if (camera.is_dirty) {
+        vec3_t up_direction = { 0, 1, 0 };
 
-        // Loop all three vertices to perform the projection
-        for (int j = 0; j < 3; j++) {
-            // Project the current vertex
-            projected_points[j] = mat4_mul_vec4_project(proj_matrix, transformed_vertices[j]);
+        // Initialize the target looking at the positive z-axis
+        vec3_t target = { 0, 0, 1 };
+        camera.direction = quat_rotate_vec3(quat_from_axis_angle(up_direction, camera.yaw), target);
 
-            // Flip vertically since the y values of the 3D mesh grow bottom->up and in screen space y values grow top->down
-            projected_points[j].y *= -1;
+        // Offset the camera position in the direction where the camera is pointing at
+        target = vec3_add(camera.position, camera.direction);
 
-            // Scale into the view
-            projected_points[j].x *= window_width / 2.0;
-            projected_points[j].y *= window_height / 2.0;
+        // Create the view matrix
+        view_matrix = mat4_look_at(camera.position, target, up_direction);
+        camera.is_dirty = false;
+    }
 
-            // Translate the projected point to the middle of the screen
-            projected_points[j].x += (window_width / 2.0);
-            projected_points[j].y += (window_height / 2.0);
+    // Cull the instances outside the view and pick the level of detail of the others
+    float projection_scale = proj_matrix.m[1][1] * window_height / 2.0;
+    PROFILE_SCOPE(TIMER_CULL) {
+        update_scene(&scene, view_matrix, projection_scale);
+        if (use_occlusion_culling)
+            cull_occluded_instances(&scene, proj_matrix);
+        else
+            memset(&occlusion_stats, 0, sizeof(occlusion_stats));
+    }
 
+    memset(&cull_stats, 0, sizeof(cull_stats));
+    int num_visible = array_length(scene.visible);
+    PROFILE_SCOPE(TIMER_PROJECT) {
+        for (int i = 0; i < num_visible; i++) {
+            project_instance(&scene.visible[i]);
         }
-
-        // Calculate the shade intensity based on how alighen the face normal and the inverse of the light ray
-        float light_intensity_factor = -vec3_dot(normal, light.direction);
-
-        // Calculate the color based on the light angle
-        uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);
-
-        triangle_t projected_triangle = {
-            .points = {
-                { projected_points[0].x, projected_points[0].y, projected_points[0].z, projected_points[0].w },
-                { projected_points[1].x, projected_points[1].y, projected_points[1].z, projected_points[1].w },
-                { projected_points[2].x, projected_points[2].y, projected_points[2].z, projected_points[2].w }
-            },
-            .texcoords = {
-                { mesh_face.a_uv.u, mesh_face.a_uv.v },
-                { mesh_face.b_uv.u, mesh_face.b_uv.v },
-                { mesh_face.c_uv.u, mesh_face.c_uv.v }
-            },
-            .color = triangle_color
-        };
-       
-        // Save the projected triangle in the array of triangles to render
-        if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH)
-            triangles_to_render[num_triangles_to_render++] = projected_triangle;
     }
+    PROFILE_COUNT(COUNTER_INSTANCES, num_visible);
+    PROFILE_COUNT(COUNTER_FACES, cull_stats.num_faces);
+    PROFILE_COUNT(COUNTER_TRIANGLES, array_length(triangles_to_render));
+
+    // Faces skipped with their cluster never reach the one by one test
+    frame_stats.num_submitted = cull_stats.num_faces_submitted;
+    frame_stats.num_culled = cull_stats.num_faces_submitted - cull_stats.num_faces + cull_stats.num_faces_culled;
+    frame_stats.num_clipped = cull_stats.num_faces_clipped;
+    frame_stats.stage_ms[STAGE_UPDATE] = get_benchmark_ms() - update_start_ms;
+    PROFILE_END(TIMER_UPDATE);
 }
 
 
 
 //
-// Render function to draw objects on the display 
+// Draw the grid and the projected triangles into the color buffer
 //
-void render(void) {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+void draw_frame(void) {
+    memset(&raster_stats, 0, sizeof(raster_stats));
 
     draw_grid();
 
+    bool is_textured_mode = render_method == RENDER_TEXTURED || render_method == RENDER_TEXTURE_WIRE;
+    bool is_filled_mode = render_method == RENDER_FILL_TRIANGLE || render_method == RENDER_FILL_TRIANGLE_WIRE;
+
     // Loop all projected triangles and render them
-    for (int i = 0; i < num_triangles_to_render; i++) {
+    int num_triangles = array_length(triangles_to_render);
+    for (int i = 0; i < num_triangles; i++) {
         triangle_t triangle = triangles_to_render[i];
+
+        // Textured modes draw solid triangles until their texture has loaded
+        bool is_textured = is_textured_mode && triangle.texture != NULL;
+        bool is_filled = is_filled_mode || (is_textured_mode && triangle.texture == NULL);
         
         // Draw vertex points
         if (render_method == RENDER_WIRE_VERTEX) {
@@ -388,7 +616,7 @@ void render(void) {
         }
 
         // Draw filled triangle
-        if (render_method == RENDER_FILL_TRIANGLE || render_method == RENDER_FILL_TRIANGLE_WIRE) {
+        if (is_filled) {
             draw_filled_triangle(
                 triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w,  // vertex A
                 triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w,  // vertex B
@@ -398,12 +626,12 @@ void render(void) {
         }
 
         // Draw textured triangle
-        if (render_method == RENDER_TEXTURED || render_method == RENDER_TEXTURE_WIRE) {
+        if (is_textured) {
             draw_textured_triangle(
                 triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w, triangle.texcoords[0].u, triangle.texcoords[0].v, // vertex A
                 triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w, triangle.texcoords[1].u, triangle.texcoords[1].v, // vertex B
                 triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w, triangle.texcoords[2].u, triangle.texcoords[2].v, // vertex C
-                mesh_texture
+                triangle.texture
             );
         }
 
@@ -422,45 +650,271 @@ void render(void) {
         }
 
     }
-    
+    PROFILE_COUNT(COUNTER_RASTERIZED, raster_stats.num_triangles);
+    PROFILE_COUNT(COUNTER_PIXELS, raster_stats.num_pixels);
+}
+
+//
+// Render function to draw objects on the display 
+//
+void render(void) {
+    double start_ms = get_benchmark_ms();
+    PROFILE_SCOPE(TIMER_RENDER) {
+        draw_frame();
+    }
+    frame_stats.num_rasterized = raster_stats.num_triangles;
+    frame_stats.num_pixels = raster_stats.num_pixels;
+    frame_stats.stage_ms[STAGE_RASTERIZE] = get_benchmark_ms() - start_ms;
+
+    // The HUD shows the last finished frame, drawing it is left out of the stats
+    PROFILE_SCOPE(TIMER_HUD) {
+        if (is_hud_visible)
+            draw_hud();
+    }
+
+    start_ms = get_benchmark_ms();
     render_color_buffer();
+    frame_stats.stage_ms[STAGE_PRESENT] = get_benchmark_ms() - start_ms;
 
-    clear_color_buffer(0xFF000000);
-    clear_z_buffer();
+    start_ms = get_benchmark_ms();
+    PROFILE_SCOPE(TIMER_CLEAR) {
+        clear_color_buffer(0xFF000000);
+        clear_z_buffer();
+    }
+    frame_stats.stage_ms[STAGE_CLEAR] = get_benchmark_ms() - start_ms;
+    add_hud_frame(&frame_stats);
+}
 
-    SDL_RenderPresent(renderer);
+//
+// Move the model and the camera for a frame of a benchmark run: the model
+// turns once around its vertical axis and rocks, while the camera sways and
+// moves in to the given distance and back out
+//
+void play_benchmark_script(int frame, int num_frames, float distance) {
+    float t = 2 * M_PI * frame / num_frames;
+    model_rotation = (vec3_t){ 0.3 * sin(t), t, 0 };
+    set_transform_rotation(&scene.transforms, scene.instances[0].transform, quat_from_euler(model_rotation));
+
+    camera.position = (vec3_t){ 0, 0, distance * (1 - cos(t)) / 2 };
+    camera.yaw = 0.2 * sin(t);
+    camera.is_dirty = true;
+}
+
+//
+// Draw every bundled model in every render method for a number of frames,
+// timing each stage of every frame, and write the results to a JSON file
+//
+bool run_benchmark(const char* filename, int num_frames) {
+    char* names[NUM_BENCHMARK_MODELS] = { "cube", "f22", "f117", "efa", "crab", "drone", "sphere" };
+    char* obj_files[NUM_BENCHMARK_MODELS] = {
+        "./assets/cube.obj", "./assets/f22.obj", "./assets/f117.obj", "./assets/efa.obj",
+        "./assets/crab.obj", "./assets/drone.obj", "./assets/sphere.obj"
+    };
+    char* png_files[NUM_BENCHMARK_MODELS] = {
+        "./assets/cube.png", "./assets/f22.png", "./assets/f117.png", "./assets/efa.png",
+        "./assets/crab.png", "./assets/drone.png", NULL
+    };
+    const char* method_names[NUM_RENDER_METHODS] = { "wire", "wire_vertex", "fill", "fill_wire", "textured", "textured_wire" };
+
+    int meshes[NUM_BENCHMARK_MODELS];
+    int textures[NUM_BENCHMARK_MODELS];
+    for (int i = 0; i < NUM_BENCHMARK_MODELS; i++) {
+        meshes[i] = load_scene_mesh(obj_files[i]);
+        textures[i] = png_files[i] != NULL ? load_scene_texture(png_files[i]) : -1;
+    }
+    finish_asset_requests();
+    is_autorotate = false;
+
+    benchmark_run_t runs[NUM_BENCHMARK_MODELS * NUM_RENDER_METHODS];
+    int num_runs = 0;
+    for (int i = 0; i < NUM_BENCHMARK_MODELS; i++) {
+        // Models the scene had no room for are left out of the results
+        if (meshes[i] < 0)
+            continue;
+
+        // The first instance draws the model, centered far enough away to fit in view
+        const mesh_t* mesh = &scene.meshes[meshes[i]];
+        vec3_t center = vec3_mul(vec3_add(mesh->bounds_min, mesh->bounds_max), 0.5f);
+        float radius = vec3_length(vec3_sub(mesh->bounds_max, mesh->bounds_min)) * 0.5f;
+        float distance = radius * 2.5f;
+        vec3_t translation = { -center.x, -center.y, distance - center.z };
+        scene.instances[0].mesh = meshes[i];
+        scene.instances[0].texture = textures[i];
+        set_transform_translation(&scene.transforms, scene.instances[0].transform, translation);
+        invalidate_scene(&scene);
+
+        for (int method = 0; method < NUM_RENDER_METHODS; method++) {
+            render_method = method;
+            benchmark_run_t* run = &runs[num_runs++];
+            init_benchmark_run(run, names[i], method_names[method], num_frames);
+            double run_ms = 0;
+
+            for (int frame = 0; frame < num_frames; frame++) {
+                play_benchmark_script(frame, num_frames, distance * 0.4f);
+
+                double stage_ms[NUM_BENCHMARK_STAGES];
+                double start = get_benchmark_ms();
+                update();
+                double end = get_benchmark_ms();
+                stage_ms[STAGE_UPDATE] = end - start;
+
+                start = end;
+                draw_frame();
+                end = get_benchmark_ms();
+                stage_ms[STAGE_RASTERIZE] = end - start;
+
+                start = end;
+                render_color_buffer();
+                end = get_benchmark_ms();
+                stage_ms[STAGE_PRESENT] = end - start;
+
+                if (frame == num_frames - 1)
+                    run->frame_hash = hash_frame(color_buffer, window_width * window_height);
+
+                start = get_benchmark_ms();
+                clear_color_buffer(0xFF000000);
+                clear_z_buffer();
+                stage_ms[STAGE_CLEAR] = get_benchmark_ms() - start;
+
+                add_benchmark_frame(run, frame, stage_ms, array_length(triangles_to_render), raster_stats.num_pixels);
+                PROFILE_END_FRAME();
+                for (int stage = 0; stage < NUM_BENCHMARK_STAGES; stage++) {
+                    run_ms += stage_ms[stage];
+                }
+            }
+            printf("Benchmark: %-8s %-14s %8.3f ms/frame\n", names[i], method_names[method], run_ms / num_frames);
+        }
+    }
+
+    benchmark_info_t info = { window_width, window_height, num_frames, get_cpu_level_name(cpu_level) };
+    bool is_written = write_benchmark_json(filename, &info, runs, num_runs);
+    for (int i = 0; i < num_runs; i++) {
+        free_benchmark_run(&runs[i]);
+    }
+    return is_written;
 }
 
 //
 // Free the memory that was dynamically allocated by the program
 //
 void free_resources(void) {
+    finish_asset_requests();
+    array_free(triangles_to_render);
     free(color_buffer);
     free(z_buffer);
-    upng_free(png_texture);
-    array_free(mesh.faces);
-    array_free(mesh.vertices);
+    free_scene(&scene);
+    thread_pool_destroy();
+}
+
+//
+// Read the command line options, returning false when they are not valid
+//
+bool parse_arguments(int argc, char* args[]) {
+    bool is_headless = false;
+    int width = 1280;
+    int height = 720;
+    frame_output_t output = FRAME_OUTPUT_NONE;
+    const char* directory = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(args[i], "--headless") == 0) {
+            is_headless = true;
+            if (has_value && sscanf(args[i + 1], "%dx%d", &width, &height) == 2) {
+                i++;
+                if (width <= 0 || height <= 0) {
+                    fprintf(stderr, "Error: invalid resolution '%s'.\n", args[i]);
+                    return false;
+                }
+            }
+        } else if (strcmp(args[i], "--benchmark") == 0 && has_value) {
+            benchmark_filename = args[++i];
+            is_headless = true;
+        } else if (strcmp(args[i], "--frames") == 0 && has_value) {
+            num_frames_to_run = atoi(args[++i]);
+        } else if (strcmp(args[i], "--output") == 0 && has_value) {
+            directory = args[++i];
+            if (output == FRAME_OUTPUT_NONE)
+                output = FRAME_OUTPUT_PPM;
+        } else if (strcmp(args[i], "--format") == 0 && has_value) {
+            i++;
+            if (strcmp(args[i], "ppm") == 0) {
+                output = FRAME_OUTPUT_PPM;
+            } else if (strcmp(args[i], "raw") == 0) {
+                output = FRAME_OUTPUT_RAW;
+            } else if (strcmp(args[i], "none") == 0) {
+                output = FRAME_OUTPUT_NONE;
+            } else {
+                fprintf(stderr, "Error: unknown frame format '%s'.\n", args[i]);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", args[i]);
+            return false;
+        }
+    }
+
+#ifdef DISPLAY_NO_SDL
+    is_headless = true;
+#endif
+    if (is_headless) {
+        set_headless_display(width, height, output, directory);
+
+        // Without a display there is nobody to press escape
+        if (num_frames_to_run <= 0)
+            num_frames_to_run = FPS;
+    }
+    return true;
 }
 
 //
 // Main function
 //
 int main(int argc, char* args[]) {
-    
-    // Create a SDL window
+    if (!parse_arguments(argc, args)) {
+        fprintf(stderr, "Usage: %s [--headless [WIDTHxHEIGHT]] [--frames N] [--output DIRECTORY] [--format ppm|raw|none] [--benchmark FILE]\n", args[0]);
+        return 1;
+    }
+
+    // Create a SDL window, or the offscreen buffer of the headless display
     is_running = initialize_window();
+    if (!is_running)
+        return 1;
 
     setup();
 
+    // Without input every frame draws the whole scene, not what has loaded by then
+    if (!display_backend->has_input) {
+        finish_asset_requests();
+        invalidate_scene(&scene);
+    }
+
+    // Play the benchmark script instead of the event loop
+    int exit_code = 0;
+    if (benchmark_filename != NULL) {
+        if (!run_benchmark(benchmark_filename, num_frames_to_run))
+            exit_code = 1;
+        is_running = false;
+    }
+
     // Event loop
+    int num_frames = 0;
     while (is_running) {
-        process_input();
+        if (display_backend->has_input)
+            process_input();
         update();
         render();
+        PROFILE_END_FRAME();
+
+        num_frames++;
+        if (num_frames_to_run > 0 && num_frames >= num_frames_to_run)
+            is_running = false;
     }
 
+    PROFILE_WRITE_CSV();
+    PROFILE_WRITE_TRACE();
     destroy_window();
     free_resources();
 
-    return 0;
+    return exit_code;
 }
@@ -101,6 +101,22 @@ mat4_t mat4_make_rotation_z(float angle)  {
     return m;
 }
 
+//
+// Scale, then rotate, then translate in a single matrix, [T]*[R]*[S] without
+// chaining matrix multiplications. The columns of the rotation are scaled by
+// the scale of their axis.
+//
+mat4_t mat4_make_transform(vec3_t scale, quat_t rotation, vec3_t translation) {
+    float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    mat4_t m = {{
+        { (1 - 2 * (y * y + z * z)) * scale.x, 2 * (x * y - w * z) * scale.y, 2 * (x * z + w * y) * scale.z, translation.x },
+        { 2 * (x * y + w * z) * scale.x, (1 - 2 * (x * x + z * z)) * scale.y, 2 * (y * z - w * x) * scale.z, translation.y },
+        { 2 * (x * z - w * y) * scale.x, 2 * (y * z + w * x) * scale.y, (1 - 2 * (x * x + y * y)) * scale.z, translation.z },
+        { 0, 0, 0, 1 }
+    }};
+    return m;
+}
+
 vec4_t mat4_mul_vec4(mat4_t m, vec4_t v) {
     /*  
         | m11   m12   m13   m14 |     |x  |
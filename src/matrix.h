@@ -2,6 +2,7 @@
 #define MATRIX_H
 
 #include "vector.h"
+#include "quaternion.h"
 
 typedef struct {
     float m[4][4];
@@ -13,6 +14,7 @@ mat4_t mat4_make_translation(float tx, float ty, float tz);
 mat4_t mat4_make_rotation_x(float angle);
 mat4_t mat4_make_rotation_y(float angle);
 mat4_t mat4_make_rotation_z(float angle);
+mat4_t mat4_make_transform(vec3_t scale, quat_t rotation, vec3_t translation);
 mat4_t mat4_make_perspective(float fov, float aspect, float znear, float zfar);
 vec4_t mat4_mul_vec4(mat4_t m, vec4_t v);
 mat4_t mat4_mul_mat4(mat4_t a, mat4_t b);
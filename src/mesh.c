@@ -1,80 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "array.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_compact.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "mesh_optimize.h"
+#include "thread_pool.h"
+#include "profile.h"
 
-mesh_t mesh = {
-    .vertices = NULL,
-    .faces = NULL,
-    .rotation = { 0, 0, 0 },
-    .scale = { 1.0, 1.0, 1.0 },
-    .translation = { 0, 0, 0}
-};
+//
+// Create a scratch array of count items with undefined values in an arena, NULL
+// when out of memory
+//
+static void* hold_scratch_array(array_arena_t* scratch, int count, int item_size) {
+    void* array = array_arena_new(scratch, count, item_size);
+    return array != NULL ? array_hold(array, count, item_size) : NULL;
+}
 
-vec3_t cube_vertices[N_CUBE_VERTICES] = {
-    { .x = -1, .y = -1, .z = -1 }, // 1
-    { .x = -1, .y =  1, .z = -1 }, // 2
-    { .x =  1, .y =  1, .z = -1 }, // 3
-    { .x =  1, .y = -1, .z = -1 }, // 4
-    { .x =  1, .y =  1, .z =  1 }, // 5
-    { .x =  1, .y = -1, .z =  1 }, // 6
-    { .x = -1, .y =  1, .z =  1 }, // 7
-    { .x = -1, .y = -1, .z =  1 }  // 8
-};
+//
+// Append faces given by position indices and per corner texture coordinates to
+// a mesh as an indexed mesh. Every distinct position and uv pair becomes one
+// vertex, in the order the faces first use them, and the faces become plain
+// index triples into those vertices. The map from pairs to vertices is keyed
+// directly on the position index, with a short chain of the vertices that share
+// the position, which keeps lookups local as faces use neighbouring positions.
+// Returns false when out of memory, with the mesh left as it was.
+//
+static bool build_indexed_mesh(mesh_t* mesh, const vec3_t* positions, int num_positions, const uv_face_t* faces, int num_faces, array_arena_t* scratch) {
+    int num_corners = num_faces * 3;
+    int* buckets = hold_scratch_array(scratch, num_positions, sizeof(int));
+    int* next = hold_scratch_array(scratch, num_corners, sizeof(int));
+    vertex_t* vertices = hold_scratch_array(scratch, num_corners, sizeof(vertex_t));
+    if (buckets == NULL || next == NULL || vertices == NULL)
+        return false;
+    for (int i = 0; i < num_positions; i++) {
+        buckets[i] = -1;
+    }
 
-face_t cube_faces[N_CUBE_FACES] = {
-    // front
-    { .a = 1, .b = 2, .c = 3, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 1, .b = 3, .c = 4, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
-    // right
-    { .a = 4, .b = 3, .c = 5, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 4, .b = 5, .c = 6, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
-    // back
-    { .a = 6, .b = 5, .c = 7, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 6, .b = 7, .c = 8, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
-    // left
-    { .a = 8, .b = 7, .c = 2, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 8, .b = 2, .c = 1, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
-    // top
-    { .a = 2, .b = 7, .c = 5, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 2, .b = 5, .c = 3, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
-    // bottom
-    { .a = 6, .b = 8, .c = 1, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 6, .b = 1, .c = 4, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF }
-};
+    int first_vertex = array_length(mesh->vertices);
+    int first_face = array_length(mesh->faces);
+    face_t* mesh_faces = array_hold(mesh->faces, num_faces, sizeof(face_t));
+    if (mesh_faces == NULL)
+        return false;
+    mesh->faces = mesh_faces;
 
-void load_cube_mesh_data(void) {    
-    for (int i = 0; i < N_CUBE_VERTICES; i++) {
-        vec3_t cube_vertex = cube_vertices[i];
-        array_push(mesh.vertices, cube_vertex)
+    int num_vertices = 0;
+    for (int i = 0; i < num_faces; i++) {
+        const int indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+        const tex2_t uvs[3] = { faces[i].a_uv, faces[i].b_uv, faces[i].c_uv };
+        int corners[3];
+
+        for (int j = 0; j < 3; j++) {
+            int vertex = buckets[indices[j]];
+            while (vertex >= 0 && memcmp(&vertices[vertex].uv, &uvs[j], sizeof(tex2_t)) != 0) {
+                vertex = next[vertex];
+            }
+            if (vertex < 0) {
+                vertex = num_vertices++;
+                vertices[vertex].position = positions[indices[j]];
+                vertices[vertex].uv = uvs[j];
+                next[vertex] = buckets[indices[j]];
+                buckets[indices[j]] = vertex;
+            }
+            corners[j] = first_vertex + vertex;
+        }
+
+        face_t face = { .a = corners[0], .b = corners[1], .c = corners[2] };
+        mesh->faces[first_face + i] = face;
     }
 
-    for (int i = 0; i < N_CUBE_FACES; i++) {
-        face_t cube_face = cube_faces[i];
-        array_push(mesh.faces, cube_face);
+    vertex_t* mesh_vertices = array_append(mesh->vertices, vertices, num_vertices, sizeof(vertex_t));
+    if (mesh_vertices == NULL) {
+        array_truncate(mesh->faces, first_face);
+        return false;
     }
+    mesh->vertices = mesh_vertices;
+    return true;
 }
 
-void load_obj_file_data(char* filename) {
-    printf("Loading %s\n", filename);
+// Smallest block of the arena that holds the scratch arrays of an OBJ load
+#define OBJ_SCRATCH_BLOCK_SIZE (1 << 20)
+
+#if defined(OBJ_LEGACY_PARSER)
+
+//
+// Original line by line loader using fgets and sscanf
+//
+bool load_obj_mesh(const char* filename, mesh_t* mesh) {
     FILE* file = fopen(filename, "r");
 
     if (file == NULL) {
-        printf("Error: could not open file %s", filename);
-        // return -1;
+        printf("Error: could not open file %s\n", filename);
+        return false;
     }
 
     const unsigned MAX_LENGTH = 1024;
     char line[MAX_LENGTH];
 
-    tex2_t* texcoords = NULL;
+    // Every scratch array lives in one arena that is freed at the end
+    array_arena_t scratch;
+    array_arena_init(&scratch, OBJ_SCRATCH_BLOCK_SIZE);
+    vec3_t* positions = array_arena_new(&scratch, 0, sizeof(vec3_t));
+    tex2_t* texcoords = array_arena_new(&scratch, 0, sizeof(tex2_t));
+    uv_face_t* faces = array_arena_new(&scratch, 0, sizeof(uv_face_t));
+    if (positions == NULL || texcoords == NULL || faces == NULL) {
+        printf("Error: out of memory loading %s\n", filename);
+        array_arena_free(&scratch);
+        fclose(file);
+        return false;
+    }
 
     while (fgets(line, MAX_LENGTH, file)) {
         // Vertex information
         if (strncmp(line, "v ", 2) == 0) {
             vec3_t vertex;
             sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+            array_push(positions, vertex);
         }
 
         // Texture coordinate information
@@ -96,21 +147,659 @@ void load_obj_file_data(char* filename) {
                 &vertex_indices[2], &texture_indices[2], &normal_indices[2]
             );
 
-            face_t face = {
+            uv_face_t face = {
                 .a = vertex_indices[0] - 1,
                 .b = vertex_indices[1] - 1,
                 .c = vertex_indices[2] - 1,
                 .a_uv = texcoords[texture_indices[0] - 1],
                 .b_uv = texcoords[texture_indices[1] - 1],
-                .c_uv = texcoords[texture_indices[2] - 1],
-                .color = 0xFFFFFFFF
+                .c_uv = texcoords[texture_indices[2] - 1]
             };
 
-            array_push(mesh.faces, face);
+            array_push(faces, face);
         }
     }
 
-    array_free(texcoords);
-    if (file != NULL) // close the file
-        fclose(file);
-}
\ No newline at end of file
+    bool is_built = build_indexed_mesh(mesh, positions, array_length(positions), faces, array_length(faces), &scratch);
+    if (!is_built)
+        printf("Error: out of memory loading %s\n", filename);
+
+    array_arena_free(&scratch);
+    fclose(file);
+    return is_built;
+}
+
+#else
+
+//
+// Fast OBJ loader. The file is mapped instead of read line by line, a first
+// pass counts the records so every array is allocated once, and numbers are
+// parsed by hand instead of with sscanf.
+//
+typedef struct {
+    int num_vertices;
+    int num_texcoords;
+    int num_faces;
+} obj_counts_t;
+
+// Files are only split into chunks of at least this size
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+#define OBJ_MAX_CHUNKS 256
+
+// Powers of ten that a double represents exactly
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+//
+// Append a run of decimal digits to a mantissa and count them. Digits past the
+// 19th would overflow the mantissa, they are only counted.
+//
+static const char* parse_digits(const char* p, const char* end, uint64_t* mantissa, int* num_digits) {
+    for (; p < end && is_digit(*p); p++) {
+        if (*num_digits < 19)
+            *mantissa = *mantissa * 10 + (*p - '0');
+        (*num_digits)++;
+    }
+    return p;
+}
+
+//
+// Parse long mantissas, large exponents, inf and nan with strtof, which needs
+// a terminated copy of the number
+//
+static const char* parse_float_slow(const char* start, const char* end, float* value) {
+    char buffer[64];
+    size_t length = 0;
+    while (start + length < end && length < sizeof(buffer) - 1 && start[length] != ' ' && start[length] != '\t' &&
+        start[length] != '\r' && start[length] != '\n') {
+        length++;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    char* parsed_end;
+    *value = strtof(buffer, &parsed_end);
+    return parsed_end != buffer ? start + (parsed_end - buffer) : NULL;
+}
+
+//
+// Parse a decimal float. Mantissas below 2^53 scaled by an exact power of ten
+// are exact in a double, anything else takes the slow path.
+//
+static const char* parse_float(const char* p, const char* end, float* value) {
+    p = skip_spaces(p, end);
+    const char* start = p;
+
+    bool is_negative = p < end && *p == '-';
+    p += p < end && (*p == '-' || *p == '+');
+
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    p = parse_digits(p, end, &mantissa, &num_digits);
+    int num_integer_digits = num_digits;
+    int exponent = 0;
+    if (p < end && *p == '.') {
+        p = parse_digits(p + 1, end, &mantissa, &num_digits);
+        exponent = num_integer_digits - num_digits;
+    }
+    bool has_digits = num_digits > 0;
+
+    if (has_digits && p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool is_exponent_negative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            is_exponent_negative = *q == '-';
+            q++;
+        }
+        if (q < end && is_digit(*q)) {
+            int e = 0;
+            for (; q < end && is_digit(*q); q++) {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += is_exponent_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    if (has_digits && num_digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double)mantissa;
+        result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+        *value = (float)(is_negative ? -result : result);
+        return p;
+    }
+
+    return parse_float_slow(start, end, value);
+}
+
+//
+// Parse an index, rejecting numbers too large for an int
+//
+static const char* parse_int(const char* p, const char* end, int* value) {
+    bool is_negative = p < end && *p == '-';
+    p += p < end && (*p == '-' || *p == '+');
+    if (p >= end || !is_digit(*p))
+        return NULL;
+
+    int result = 0;
+    for (; p < end && is_digit(*p); p++) {
+        int digit = *p - '0';
+        if (result > (INT_MAX - digit) / 10)
+            return NULL;
+        result = result * 10 + digit;
+    }
+    *value = is_negative ? -result : result;
+    return p;
+}
+
+//
+// Parse one face corner in the v, v/vt, v//vn or v/vt/vn form. Missing texture
+// coordinates are returned as 0, normals are skipped.
+//
+static const char* parse_face_corner(const char* p, const char* end, int* vertex, int* texcoord) {
+    p = parse_int(skip_spaces(p, end), end, vertex);
+    if (p == NULL)
+        return NULL;
+
+    *texcoord = 0;
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = parse_int(p, end, texcoord);
+            if (p == NULL)
+                return NULL;
+        }
+        if (p < end && *p == '/') {
+            int normal;
+            const char* q = parse_int(p + 1, end, &normal);
+            p = q != NULL ? q : p + 1;
+        }
+    }
+    return p;
+}
+
+// OBJ indices are 1-based, negative ones count back from the latest record
+static int resolve_index(int index, int count) {
+    return index < 0 ? count + index : index - 1;
+}
+
+static const char* next_line(const char* line, const char* end) {
+    const char* newline = memchr(line, '\n', end - line);
+    return newline != NULL ? newline + 1 : end;
+}
+
+//
+// A range of the file, split at line boundaries, and where its records go. The
+// first counts are the records before the range, which its records are written
+// after and which relative indices are resolved against.
+//
+typedef struct {
+    const char* begin;
+    const char* end;
+    obj_counts_t first;
+    obj_counts_t counts;    // Records in the range
+    int num_parsed_faces;   // Faces that were valid and written
+    unsigned records;       // OBJ_VERTEX_RECORDS and/or OBJ_FACE_RECORDS to parse
+    vec3_t* positions;      // Arrays for the whole file
+    tex2_t* texcoords;
+    uv_face_t* faces;
+    int total_vertices;
+} obj_chunk_t;
+
+#define OBJ_VERTEX_RECORDS 1  // v and vt records
+#define OBJ_FACE_RECORDS 2    // f records
+
+static void count_obj_records(obj_chunk_t* chunk) {
+    obj_counts_t counts = { 0, 0, 0 };
+    const char* end = chunk->end;
+    for (const char* line = chunk->begin; line < end; line = next_line(line, end)) {
+        if (end - line < 3)
+            continue;
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+            counts.num_vertices++;
+        else if (line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t'))
+            counts.num_texcoords++;
+        else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+            counts.num_faces++;
+    }
+    chunk->counts = counts;
+}
+
+//
+// Parse the records of a chunk into the arrays sized by count_obj_records.
+// Records that are not parsed in this pass are still counted, so faces see
+// the same vertex and texcoord numbers as in a single pass over the file.
+//
+static void parse_obj_records(obj_chunk_t* chunk) {
+    const char* end = chunk->end;
+    vec3_t* positions = chunk->positions + chunk->first.num_vertices;
+    tex2_t* texcoords = chunk->texcoords + chunk->first.num_texcoords;
+    uv_face_t* faces = chunk->faces + chunk->first.num_faces;
+    bool is_parsing_vertices = (chunk->records & OBJ_VERTEX_RECORDS) != 0;
+    bool is_parsing_faces = (chunk->records & OBJ_FACE_RECORDS) != 0;
+
+    obj_counts_t counts = { 0, 0, 0 };
+    for (const char* line = chunk->begin; line < end; ) {
+        // Numbers never span lines, so records are parsed against the end of the chunk
+        // and the rest of the line, usually just the newline, is skipped afterwards
+        const char* p = NULL;
+
+        if (end - line >= 3 && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            if (is_parsing_vertices) {
+                vec3_t vertex = { 0, 0, 0 };
+                p = parse_float(line + 2, end, &vertex.x);
+                if (p != NULL) p = parse_float(p, end, &vertex.y);
+                if (p != NULL) p = parse_float(p, end, &vertex.z);
+                positions[counts.num_vertices] = vertex;
+            }
+            counts.num_vertices++;
+        } else if (end - line >= 3 && line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t')) {
+            if (is_parsing_vertices) {
+                tex2_t texcoord = { 0, 0 };
+                p = parse_float(line + 3, end, &texcoord.u);
+                if (p != NULL) p = parse_float(p, end, &texcoord.v);
+                texcoords[counts.num_texcoords] = texcoord;
+            }
+            counts.num_texcoords++;
+        } else if (is_parsing_faces && end - line >= 3 && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            int num_vertices = chunk->first.num_vertices + counts.num_vertices;
+            int num_texcoords = chunk->first.num_texcoords + counts.num_texcoords;
+            int vertex_indices[3];
+            int texture_indices[3];
+            p = line + 2;
+            bool is_valid = true;
+            for (int i = 0; i < 3 && is_valid; i++) {
+                p = parse_face_corner(p, end, &vertex_indices[i], &texture_indices[i]);
+                is_valid = p != NULL;
+                if (is_valid) {
+                    // Positions are only looked up when rendering, so forward references are fine
+                    vertex_indices[i] = resolve_index(vertex_indices[i], num_vertices);
+                    is_valid = vertex_indices[i] >= 0 && vertex_indices[i] < chunk->total_vertices;
+                }
+            }
+
+            if (is_valid) {
+                tex2_t uvs[3] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
+                for (int i = 0; i < 3; i++) {
+                    int index = resolve_index(texture_indices[i], num_texcoords);
+                    if (texture_indices[i] != 0 && index >= 0 && index < num_texcoords)
+                        uvs[i] = chunk->texcoords[index];
+                }
+
+                uv_face_t face = {
+                    .a = vertex_indices[0],
+                    .b = vertex_indices[1],
+                    .c = vertex_indices[2],
+                    .a_uv = uvs[0],
+                    .b_uv = uvs[1],
+                    .c_uv = uvs[2]
+                };
+                faces[counts.num_faces++] = face;
+            }
+        }
+
+        if (p != NULL) {
+            while (p < end && *p != '\n')
+                p++;
+            line = p < end ? p + 1 : end;
+        } else {
+            line = next_line(line, end);
+        }
+    }
+
+    if (is_parsing_faces)
+        chunk->num_parsed_faces = counts.num_faces;
+}
+
+static void count_obj_chunk_job(void* data) {
+    PROFILE_TRACE_SCOPE("count_obj_chunk", "job") {
+        count_obj_records((obj_chunk_t*)data);
+    }
+}
+
+static void parse_obj_chunk_job(void* data) {
+    PROFILE_TRACE_SCOPE("parse_obj_chunk", "job") {
+        parse_obj_records((obj_chunk_t*)data);
+    }
+}
+
+//
+// Split the file into chunks that end after a newline, about chunk_size long
+//
+static int split_obj_chunks(const char* data, const char* end, size_t chunk_size, obj_chunk_t* chunks, int max_chunks) {
+    int num_chunks = 0;
+    const char* begin = data;
+    while (begin < end && num_chunks < max_chunks) {
+        const char* chunk_end = (size_t)(end - begin) > chunk_size && num_chunks < max_chunks - 1 ?
+            next_line(begin + chunk_size, end) : end;
+        memset(&chunks[num_chunks], 0, sizeof(obj_chunk_t));
+        chunks[num_chunks].begin = begin;
+        chunks[num_chunks].end = chunk_end;
+        num_chunks++;
+        begin = chunk_end;
+    }
+    return num_chunks;
+}
+
+//
+// Load the vertices and faces of an OBJ file into a mesh, appending to any
+// geometry the mesh already has. Large files are split into chunks that are
+// counted and parsed on the thread pool: vertex records first, then the faces,
+// which may use texture coordinates from any earlier chunk. Each chunk writes
+// straight into its part of the mesh arrays, so the result matches the serial
+// parse exactly.
+//
+bool load_obj_mesh(const char* filename, mesh_t* mesh) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: could not open file %s\n", filename);
+        return false;
+    }
+
+    // An empty file is a valid mesh without geometry, but cannot be mapped
+    struct stat st;
+    bool has_size = fstat(fd, &st) == 0;
+    if (!has_size || st.st_size == 0) {
+        close(fd);
+        return has_size;
+    }
+    size_t size = (size_t)st.st_size;
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Error: could not map file %s\n", filename);
+        return false;
+    }
+
+    // A few chunks per thread keep the threads busy when chunks parse at different speeds
+    obj_chunk_t chunks[OBJ_MAX_CHUNKS];
+    int num_threads = thread_pool_size();
+    size_t chunk_size = num_threads > 1 ? size / (num_threads * 4) : size;
+    if (chunk_size < OBJ_MIN_CHUNK_SIZE)
+        chunk_size = OBJ_MIN_CHUNK_SIZE;
+    int num_chunks = split_obj_chunks(data, data + size, chunk_size, chunks, OBJ_MAX_CHUNKS);
+    job_group_t group = { 0 };
+
+    if (num_chunks == 1) {
+        count_obj_records(&chunks[0]);
+    } else {
+        for (int i = 0; i < num_chunks; i++) {
+            thread_pool_push(&group, count_obj_chunk_job, &chunks[i]);
+        }
+        thread_pool_wait(&group);
+    }
+
+    obj_counts_t total = { 0, 0, 0 };
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].first = total;
+        total.num_vertices += chunks[i].counts.num_vertices;
+        total.num_texcoords += chunks[i].counts.num_texcoords;
+        total.num_faces += chunks[i].counts.num_faces;
+    }
+
+    // Positions, texture coordinates and faces are parsed into scratch arrays and
+    // indexed afterwards, all of them from one arena
+    array_arena_t scratch;
+    array_arena_init(&scratch, OBJ_SCRATCH_BLOCK_SIZE);
+    vec3_t* positions = hold_scratch_array(&scratch, total.num_vertices, sizeof(vec3_t));
+    tex2_t* texcoords = hold_scratch_array(&scratch, total.num_texcoords, sizeof(tex2_t));
+    uv_face_t* faces = hold_scratch_array(&scratch, total.num_faces, sizeof(uv_face_t));
+    if (positions == NULL || texcoords == NULL || faces == NULL) {
+        printf("Error: out of memory loading %s\n", filename);
+        array_arena_free(&scratch);
+        munmap((void*)data, size);
+        return false;
+    }
+
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].positions = positions;
+        chunks[i].texcoords = texcoords;
+        chunks[i].faces = faces;
+        chunks[i].total_vertices = total.num_vertices;
+    }
+
+    if (num_chunks == 1) {
+        chunks[0].records = OBJ_VERTEX_RECORDS | OBJ_FACE_RECORDS;
+        parse_obj_records(&chunks[0]);
+    } else {
+        for (int records = OBJ_VERTEX_RECORDS; records <= OBJ_FACE_RECORDS; records <<= 1) {
+            for (int i = 0; i < num_chunks; i++) {
+                chunks[i].records = records;
+                thread_pool_push(&group, parse_obj_chunk_job, &chunks[i]);
+            }
+            thread_pool_wait(&group);
+        }
+    }
+
+    // Close the gaps that skipped faces left at the end of their chunks
+    int num_faces = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (num_faces != chunks[i].first.num_faces)
+            memmove(faces + num_faces, faces + chunks[i].first.num_faces, sizeof(uv_face_t) * chunks[i].num_parsed_faces);
+        num_faces += chunks[i].num_parsed_faces;
+    }
+    if (num_faces < total.num_faces) {
+        printf("Warning: skipped %d invalid faces in %s\n", total.num_faces - num_faces, filename);
+    }
+
+    bool is_built = build_indexed_mesh(mesh, positions, total.num_vertices, faces, num_faces, &scratch);
+    if (!is_built)
+        printf("Error: out of memory loading %s\n", filename);
+
+    array_arena_free(&scratch);
+    munmap((void*)data, size);
+    return is_built;
+}
+
+#endif
+
+//
+// The current settings, for loads to take along
+//
+mesh_load_options_t get_mesh_load_options(void) {
+    mesh_load_options_t options = {
+        .use_vertex_cache_order = use_vertex_cache_order,
+        .use_mesh_lods = use_mesh_lods,
+        .use_compact_meshes = use_compact_meshes
+    };
+    return options;
+}
+
+//
+// Load an OBJ file through its mesh cache file. A valid cache is mapped and the
+// mesh arrays point into it; otherwise the OBJ is parsed, its bounds, levels of
+// detail, face clusters and normals computed and the cache written for the next
+// run. The mesh must be empty: clusters reorder all the faces of a mesh, which
+// would leave what was computed for geometry already in it out of line.
+//
+bool load_obj_mesh_cached(const char* filename, mesh_t* mesh, const mesh_load_options_t* options) {
+    if (mesh->vertices != NULL || mesh->faces != NULL || mesh->normals != NULL) {
+        printf("Error: cannot load %s into a mesh that already has geometry\n", filename);
+        return false;
+    }
+    if (mesh_cache_load(filename, mesh, options))
+        return true;
+
+    if (!load_obj_mesh(filename, mesh))
+        return false;
+
+    if (options->use_vertex_cache_order && !optimize_mesh_order(mesh)) {
+        printf("Error: out of memory loading %s\n", filename);
+        return false;
+    }
+    compute_mesh_bounds(mesh);
+    if (options->use_mesh_lods)
+        build_mesh_lods(mesh, options->use_vertex_cache_order);
+    if (!build_mesh_meshlets(mesh) || !compute_mesh_normals(mesh)) {
+        printf("Error: out of memory loading %s\n", filename);
+        return false;
+    }
+    if (!mesh_cache_write(filename, mesh, options))
+        printf("Warning: could not write the mesh cache of %s\n", filename);
+    return true;
+}
+
+//
+// Load an OBJ into a mesh through its cache and report how long it took. Safe
+// to call from a worker thread as long as the mesh is not shared yet.
+//
+bool load_obj_file(const char* filename, mesh_t* mesh, const mesh_load_options_t* options) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool is_loaded = load_obj_mesh_cached(filename, mesh, options);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (is_loaded) {
+        double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        printf("Loaded %s: %d vertices, %d faces in %.2f ms (%s)\n", filename,
+            array_length(mesh->vertices), array_length(mesh->faces), ms, mesh->mapping != NULL ? "mapped from cache" : "parsed");
+    }
+
+    // Optionally render large meshes from a quantized copy that halves the render loop reads
+    if (is_loaded && options->use_compact_meshes && array_length(mesh->faces) >= COMPACT_MESH_MIN_FACES && compact_mesh(mesh)) {
+        printf("Compacted %s: %.1f bytes per triangle, down from %.1f\n", filename,
+            get_mesh_bytes_per_face(mesh, true), get_mesh_bytes_per_face(mesh, false));
+    }
+    return is_loaded;
+}
+
+//
+// Replace the geometry of a mesh with the one loaded into another, keeping its
+// color. The loaded mesh gives up its arrays.
+//
+void set_mesh_geometry(mesh_t* mesh, mesh_t* loaded) {
+    mesh_t geometry = *loaded;
+    geometry.color = mesh->color;
+
+    free_mesh(mesh);
+    *mesh = geometry;
+
+    mesh_t empty = { .vertices = NULL, .faces = NULL };
+    *loaded = empty;
+}
+
+//
+// Compute the model space normal of every face that does not have one yet,
+// with the same winding as the back-face culling in the renderer. Returns false
+// when out of memory.
+//
+bool compute_mesh_normals(mesh_t* mesh) {
+    int num_faces = array_length(mesh->faces);
+    int first_face = array_length(mesh->normals);
+    if (first_face >= num_faces)
+        return true;
+
+    vec3_t* normals = array_hold(mesh->normals, num_faces - first_face, sizeof(vec3_t));
+    if (normals == NULL)
+        return false;
+    mesh->normals = normals;
+    for (int i = first_face; i < num_faces; i++) {
+        vec3_t vector_a = mesh->vertices[mesh->faces[i].a].position;
+        vec3_t vector_ab = vec3_sub(mesh->vertices[mesh->faces[i].b].position, vector_a);
+        vec3_t vector_ac = vec3_sub(mesh->vertices[mesh->faces[i].c].position, vector_a);
+        vec3_t normal = vec3_cross(vector_ab, vector_ac);
+        if (vec3_length(normal) > 0)
+            vec3_normalize(&normal);
+        mesh->normals[i] = normal;
+    }
+    return true;
+}
+
+typedef struct {
+    vec3_t position;
+    int index;
+} sorted_position_t;
+
+static int compare_positions(const void* a, const void* b) {
+    const vec3_t* p = &((const sorted_position_t*)a)->position;
+    const vec3_t* q = &((const sorted_position_t*)b)->position;
+    if (p->x != q->x) return p->x < q->x ? -1 : 1;
+    if (p->y != q->y) return p->y < q->y ? -1 : 1;
+    if (p->z != q->z) return p->z < q->z ? -1 : 1;
+    return ((const sorted_position_t*)a)->index - ((const sorted_position_t*)b)->index;
+}
+
+//
+// Give every vertex the lowest index of the vertices with the same position, so
+// vertices split along uv seams can be told to be the same point. Returns false
+// when out of memory.
+//
+bool compute_position_ids(const vertex_t* vertices, int num_vertices, int* position_ids) {
+    sorted_position_t* sorted = malloc(sizeof(sorted_position_t) * (num_vertices > 0 ? num_vertices : 1));
+    if (sorted == NULL)
+        return false;
+    for (int i = 0; i < num_vertices; i++) {
+        sorted[i].position = vertices[i].position;
+        sorted[i].index = i;
+    }
+    qsort(sorted, num_vertices, sizeof(sorted_position_t), compare_positions);
+    for (int i = 0; i < num_vertices; ) {
+        int end = i + 1;
+        while (end < num_vertices && sorted[end].position.x == sorted[i].position.x &&
+            sorted[end].position.y == sorted[i].position.y && sorted[end].position.z == sorted[i].position.z)
+            end++;
+        for (int j = i; j < end; j++) {
+            position_ids[sorted[j].index] = sorted[i].index;
+        }
+        i = end;
+    }
+    free(sorted);
+    return true;
+}
+
+void compute_mesh_bounds(mesh_t* mesh) {
+    int num_vertices = array_length(mesh->vertices);
+    vec3_t bounds_min = { 0, 0, 0 };
+    vec3_t bounds_max = { 0, 0, 0 };
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_t v = mesh->vertices[i].position;
+        if (i == 0 || v.x < bounds_min.x) bounds_min.x = v.x;
+        if (i == 0 || v.y < bounds_min.y) bounds_min.y = v.y;
+        if (i == 0 || v.z < bounds_min.z) bounds_min.z = v.z;
+        if (i == 0 || v.x > bounds_max.x) bounds_max.x = v.x;
+        if (i == 0 || v.y > bounds_max.y) bounds_max.y = v.y;
+        if (i == 0 || v.z > bounds_max.z) bounds_max.z = v.z;
+    }
+    mesh->bounds_min = bounds_min;
+    mesh->bounds_max = bounds_max;
+}
+
+//
+// Release the mesh arrays, or the cache file they were mapped from
+//
+void free_mesh(mesh_t* mesh) {
+    free_compact_mesh(mesh);
+    if (mesh->mapping != NULL) {
+        cache_unmap(mesh->mapping, mesh->mapping_size);
+    } else {
+        array_free(mesh->vertices);
+        array_free(mesh->faces);
+        array_free(mesh->normals);
+        for (int i = 1; i < mesh->num_lods; i++) {
+            array_free(mesh->lods[i]);
+        }
+        for (int i = 0; i < MESH_MAX_LODS; i++) {
+            array_free(mesh->meshlets[i]);
+        }
+    }
+    for (int i = 0; i < MESH_MAX_LODS; i++) {
+        mesh->meshlets[i] = NULL;
+    }
+    mesh->vertices = NULL;
+    mesh->faces = NULL;
+    mesh->normals = NULL;
+    mesh->num_lods = 0;
+    mesh->mapping = NULL;
+    mesh->mapping_size = 0;
+}
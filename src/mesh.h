@@ -1,29 +1,78 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "vector.h"
 #include "triangle.h"
 
-#define N_CUBE_VERTICES 8
-#define N_CUBE_FACES (6 * 2) // 6 cube faces, 2 traingles per face
+// Levels of detail a mesh can have, including the full detail one
+#define MESH_MAX_LODS 5
 
-extern vec3_t cube_vertices[N_CUBE_VERTICES];
-extern face_t cube_faces[N_CUBE_FACES];
+//
+// A smaller copy of the vertices and faces for the render loop, see mesh_compact.c
+//
+typedef struct {
+	compact_vertex_t* vertices;
+	void* indices;		// three per face, uint16_t or uint32_t
+	int index_size;		// size of an index in bytes
+	int num_vertices;
+	int num_faces;		// 0 when the mesh has no compact copy
+	vec3_t position_min;	// position = position_min + quantized * position_scale
+	vec3_t position_scale;
+	tex2_t uv_min;		// uv = uv_min + quantized * uv_scale
+	tex2_t uv_scale;
+} compact_mesh_t;
+
+//
+// A cluster of neighbouring faces that is culled as a whole, see meshlet.c
+//
+typedef struct {
+	int first_face;		// the faces of a cluster are contiguous in its level
+	int num_faces;
+	vec3_t center;		// bounding sphere in model space
+	float radius;
+	vec3_t cone_axis;	// average face normal
+	float cone_cutoff;	// sine of the widest angle between a face normal and the axis, 1 if too wide to cull
+} meshlet_t;
 
 //
 // Define a struct for dynamic size meshes, witharray of vertices and faces
 //
 typedef struct {
-	vec3_t* vertices;	// dynamic array of vertices
-	face_t* faces;		// dynamic array of faces
-	vec3_t rotation;	// rotation with x, y, z values
-	vec3_t scale;		// scale with x, y and z values
-	vec3_t translation;	// translation with x, y and z values
+	vertex_t* vertices;	// dynamic array of unique position and uv pairs
+	face_t* faces;		// dynamic array of vertex index triples
+	vec3_t* normals;	// dynamic array of model space face normals
+	face_t* lods[MESH_MAX_LODS];	// face arrays from full detail down, lods[0] is faces
+	float lod_errors[MESH_MAX_LODS];	// largest deviation of each level in model units
+	int num_lods;		// levels in lods, 0 until they are built
+	meshlet_t* meshlets[MESH_MAX_LODS];	// dynamic arrays of the face clusters of each level
+	vec3_t bounds_min;	// bounding box of the vertices
+	vec3_t bounds_max;
+	uint32_t color;		// flat color of every face
+	compact_mesh_t compact;	// quantized copy the render loop uses if it has faces
+	void* mapping;		// mesh cache file the arrays live in, NULL when they are owned
+	size_t mapping_size;
 } mesh_t;
 
-extern mesh_t mesh;
+//
+// The settings an OBJ is loaded with. Loads on worker threads get a copy taken
+// when they are queued, as the main thread may change the settings meanwhile.
+//
+typedef struct {
+	bool use_vertex_cache_order;
+	bool use_mesh_lods;
+	bool use_compact_meshes;
+} mesh_load_options_t;
 
-void load_cube_mesh_data(void);
-void load_obj_file_data(char* filename);
+mesh_load_options_t get_mesh_load_options(void);
+bool load_obj_mesh(const char* filename, mesh_t* mesh);
+bool load_obj_mesh_cached(const char* filename, mesh_t* mesh, const mesh_load_options_t* options);
+bool load_obj_file(const char* filename, mesh_t* mesh, const mesh_load_options_t* options);
+void set_mesh_geometry(mesh_t* mesh, mesh_t* loaded);
+bool compute_mesh_normals(mesh_t* mesh);
+void compute_mesh_bounds(mesh_t* mesh);
+bool compute_position_ids(const vertex_t* vertices, int num_vertices, int* position_ids);
+void free_mesh(mesh_t* mesh);
 
 #endif
@@ -0,0 +1,171 @@
+#include <string.h>
+#include "array.h"
+#include "mesh_cache.h"
+
+//
+// Check that a section lies inside the file and that its array header matches
+//
+static bool is_valid_section(const unsigned char* mapping, size_t size, const mesh_cache_section_t* section, size_t item_size) {
+    return section->item_size == item_size &&
+        section->offset % CACHE_ALIGNMENT == 0 &&
+        section->offset >= sizeof(mesh_cache_header_t) + array_header_size() &&
+        section->offset + (uint64_t)section->count * item_size <= size &&
+        array_length((void*)(mapping + section->offset)) == (int)section->count;
+}
+
+static uint32_t get_flags(const mesh_load_options_t* options) {
+    return (options->use_vertex_cache_order ? MESH_CACHE_VERTEX_CACHE_ORDER : 0) |
+        (options->use_mesh_lods ? MESH_CACHE_LODS : 0);
+}
+
+//
+// Check that every face of a section indexes one of the vertices, as the render
+// loop and the compact copy look them up without checking
+//
+static bool is_valid_faces(const unsigned char* mapping, const mesh_cache_section_t* section, uint32_t num_vertices) {
+    const face_t* faces = (const face_t*)(mapping + section->offset);
+    for (uint32_t i = 0; i < section->count; i++) {
+        if ((uint32_t)faces[i].a >= num_vertices || (uint32_t)faces[i].b >= num_vertices || (uint32_t)faces[i].c >= num_vertices)
+            return false;
+    }
+    return true;
+}
+
+//
+// Check that every cluster of a level covers a range of the faces of that level
+//
+static bool is_valid_meshlets(const unsigned char* mapping, const mesh_cache_section_t* section, uint32_t num_faces) {
+    const meshlet_t* meshlets = (const meshlet_t*)(mapping + section->offset);
+    for (uint32_t i = 0; i < section->count; i++) {
+        if (meshlets[i].first_face < 0 || meshlets[i].num_faces < 0 ||
+            (uint64_t)meshlets[i].first_face + (uint64_t)meshlets[i].num_faces > num_faces)
+            return false;
+    }
+    return true;
+}
+
+//
+// Map the cache file of an OBJ and point the mesh arrays into it; fails if the
+// cache is missing, from another version, was written for a different OBJ or
+// with a different face order than the loader would produce now, or its arrays
+// do not fit in the file, its faces index past the vertices or its clusters
+// reach past the faces of their level
+//
+bool mesh_cache_load(const char* obj_filename, mesh_t* mesh, const mesh_load_options_t* options) {
+    size_t size = 0;
+    unsigned char* mapping = (unsigned char*)cache_map(obj_filename, &size);
+    if (mapping == NULL)
+        return false;
+
+    const mesh_cache_header_t* header = (const mesh_cache_header_t*)mapping;
+    cache_source_t source;
+    bool is_valid =
+        size >= sizeof(mesh_cache_header_t) &&
+        header->magic == MESH_CACHE_MAGIC &&
+        header->version == MESH_CACHE_VERSION &&
+        header->flags == get_flags(options) &&
+        is_valid_section(mapping, size, &header->vertices, sizeof(vertex_t)) &&
+        is_valid_section(mapping, size, &header->faces, sizeof(face_t)) &&
+        is_valid_faces(mapping, &header->faces, header->vertices.count) &&
+        is_valid_section(mapping, size, &header->normals, sizeof(vec3_t)) &&
+        header->normals.count == header->faces.count &&
+        header->num_lods >= 1 && header->num_lods <= MESH_MAX_LODS &&
+        cache_get_source(obj_filename, &source) &&
+        cache_is_same_source(&header->source, &source);
+
+    for (uint32_t i = 1; is_valid && i < header->num_lods; i++) {
+        is_valid = is_valid_section(mapping, size, &header->lods[i - 1], sizeof(face_t)) &&
+            is_valid_faces(mapping, &header->lods[i - 1], header->vertices.count);
+    }
+    for (uint32_t i = 0; is_valid && i < header->num_lods; i++) {
+        uint32_t num_faces = i == 0 ? header->faces.count : header->lods[i - 1].count;
+        is_valid = is_valid_section(mapping, size, &header->meshlets[i], sizeof(meshlet_t)) &&
+            is_valid_meshlets(mapping, &header->meshlets[i], num_faces);
+    }
+    if (!is_valid) {
+        cache_unmap(mapping, size);
+        return false;
+    }
+
+    mesh->vertices = (vertex_t*)(mapping + header->vertices.offset);
+    mesh->faces = (face_t*)(mapping + header->faces.offset);
+    mesh->normals = (vec3_t*)(mapping + header->normals.offset);
+    mesh->bounds_min = header->bounds_min;
+    mesh->bounds_max = header->bounds_max;
+    mesh->lods[0] = mesh->faces;
+    mesh->lod_errors[0] = 0;
+    for (uint32_t i = 1; i < header->num_lods; i++) {
+        mesh->lods[i] = (face_t*)(mapping + header->lods[i - 1].offset);
+        mesh->lod_errors[i] = header->lod_errors[i];
+    }
+    mesh->num_lods = header->num_lods;
+    for (uint32_t i = 0; i < header->num_lods; i++) {
+        mesh->meshlets[i] = header->meshlets[i].count > 0 ? (meshlet_t*)(mapping + header->meshlets[i].offset) : NULL;
+    }
+    mesh->mapping = mapping;
+    mesh->mapping_size = size;
+    return true;
+}
+
+//
+// Lay out a section after the previous one, leaving room for its array header
+//
+static uint64_t add_section(mesh_cache_section_t* section, uint64_t offset, int count, size_t item_size) {
+    section->offset = cache_align(offset + array_header_size());
+    section->count = count;
+    section->item_size = item_size;
+    return section->offset + (uint64_t)count * item_size;
+}
+
+static void write_section(cache_writer_t* writer, const mesh_cache_section_t* section, const void* items) {
+    unsigned char array_header[64];
+    array_init_header(array_header, section->count);
+    cache_write_at(writer, section->offset - array_header_size(), array_header, array_header_size());
+    cache_write(writer, items, (size_t)section->count * section->item_size);
+}
+
+//
+// Write the arrays, normals, bounds, levels of detail and face clusters of a
+// loaded mesh next to the OBJ
+//
+bool mesh_cache_write(const char* obj_filename, const mesh_t* mesh, const mesh_load_options_t* options) {
+    mesh_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    if (array_length(mesh->normals) != array_length(mesh->faces) || !cache_get_source(obj_filename, &header.source))
+        return false;
+
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.bounds_min = mesh->bounds_min;
+    header.bounds_max = mesh->bounds_max;
+    header.flags = get_flags(options);
+    header.num_lods = mesh->num_lods > 1 ? mesh->num_lods : 1;
+
+    uint64_t offset = sizeof(header);
+    offset = add_section(&header.vertices, offset, array_length(mesh->vertices), sizeof(vertex_t));
+    offset = add_section(&header.faces, offset, array_length(mesh->faces), sizeof(face_t));
+    offset = add_section(&header.normals, offset, array_length(mesh->normals), sizeof(vec3_t));
+    for (uint32_t i = 1; i < header.num_lods; i++) {
+        offset = add_section(&header.lods[i - 1], offset, array_length(mesh->lods[i]), sizeof(face_t));
+        header.lod_errors[i] = mesh->lod_errors[i];
+    }
+    for (uint32_t i = 0; i < header.num_lods; i++) {
+        offset = add_section(&header.meshlets[i], offset, array_length(mesh->meshlets[i]), sizeof(meshlet_t));
+    }
+
+    cache_writer_t writer;
+    if (!cache_begin_write(&writer, obj_filename))
+        return false;
+
+    cache_write(&writer, &header, sizeof(header));
+    write_section(&writer, &header.vertices, mesh->vertices);
+    write_section(&writer, &header.faces, mesh->faces);
+    write_section(&writer, &header.normals, mesh->normals);
+    for (uint32_t i = 1; i < header.num_lods; i++) {
+        write_section(&writer, &header.lods[i - 1], mesh->lods[i]);
+    }
+    for (uint32_t i = 0; i < header.num_lods; i++) {
+        write_section(&writer, &header.meshlets[i], mesh->meshlets[i]);
+    }
+    return cache_end_write(&writer);
+}
@@ -0,0 +1,49 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cache.h"
+#include "mesh.h"
+
+#define MESH_CACHE_MAGIC 0x4853454D // "MESH"
+#define MESH_CACHE_VERSION 6
+
+// Flags of a mesh cache file
+#define MESH_CACHE_VERTEX_CACHE_ORDER 0x1 // Faces and vertices were reordered by optimize_mesh_order
+#define MESH_CACHE_LODS 0x2 // Levels of detail were built by build_mesh_lods
+
+//
+// An array in a mesh cache file. The header array.c keeps in front of every
+// array is stored right before the items, so the mapped items can be used as
+// dynamic arrays directly.
+//
+typedef struct {
+    uint64_t offset;    // Offset of the first item, CACHE_ALIGNMENT aligned
+    uint32_t count;
+    uint32_t item_size;
+} mesh_cache_section_t;
+
+//
+// Header of a binary mesh cache file, written next to the source OBJ
+//
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    cache_source_t source;
+    vec3_t bounds_min;
+    vec3_t bounds_max;
+    uint32_t flags;
+    mesh_cache_section_t vertices;  // Positions and texture coordinates
+    mesh_cache_section_t faces;     // Vertex index triples
+    mesh_cache_section_t normals;   // One normal per face
+    uint32_t num_lods;              // Levels of detail, the first being the faces
+    float lod_errors[MESH_MAX_LODS];
+    mesh_cache_section_t lods[MESH_MAX_LODS - 1];   // Faces of the coarser levels
+    mesh_cache_section_t meshlets[MESH_MAX_LODS];   // Face clusters of every level
+} mesh_cache_header_t;
+
+bool mesh_cache_load(const char* obj_filename, mesh_t* mesh, const mesh_load_options_t* options);
+bool mesh_cache_write(const char* obj_filename, const mesh_t* mesh, const mesh_load_options_t* options);
+
+#endif
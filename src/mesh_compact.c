@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "array.h"
+#include "mesh_compact.h"
+#include "mesh_lod.h"
+
+// Render large meshes from a compact copy of their vertices and faces. This
+// halves the bytes the render loop reads per triangle, but dequantizing costs
+// more than the cache misses it saves while the vertex stage is scalar, so it
+// is off by default.
+bool use_compact_meshes = false;
+
+static uint16_t quantize(float value, float min, float scale) {
+    if (scale <= 0.0f)
+        return 0;
+    float q = (value - min) / scale + 0.5f;
+    if (q <= 0.0f)
+        return 0;
+    if (q >= COMPACT_MESH_MAX_QUANTIZED)
+        return COMPACT_MESH_MAX_QUANTIZED;
+    return (uint16_t)q;
+}
+
+static float quantize_scale(float min, float max) {
+    return (max - min) / COMPACT_MESH_MAX_QUANTIZED;
+}
+
+//
+// Build the compact copy of a mesh: positions quantized to 16 bits per axis
+// within the mesh bounds, texture coordinates to 16 bits within their own
+// range, and 16 bit indices when there are few enough vertices. This takes
+// 10 bytes per vertex and 6 or 12 per face instead of 20 and 12. The full
+// arrays are kept for everything but the render loop.
+//
+bool compact_mesh(mesh_t* mesh) {
+    free_compact_mesh(mesh);
+
+    int num_vertices = array_length(mesh->vertices);
+    int num_faces = array_length(mesh->faces);
+    if (num_faces == 0)
+        return false;
+
+    compact_mesh_t compact;
+    compact.num_vertices = num_vertices;
+    compact.num_faces = num_faces;
+    compact.index_size = num_vertices <= UINT16_MAX + 1 ? sizeof(uint16_t) : sizeof(uint32_t);
+    compact.vertices = malloc(sizeof(compact_vertex_t) * (num_vertices > 0 ? num_vertices : 1));
+    compact.indices = malloc((size_t)compact.index_size * num_faces * 3);
+    if (compact.vertices == NULL || compact.indices == NULL) {
+        free(compact.vertices);
+        free(compact.indices);
+        return false;
+    }
+
+    tex2_t uv_min = { 0, 0 };
+    tex2_t uv_max = { 0, 0 };
+    for (int i = 0; i < num_vertices; i++) {
+        tex2_t uv = mesh->vertices[i].uv;
+        if (i == 0 || uv.u < uv_min.u) uv_min.u = uv.u;
+        if (i == 0 || uv.v < uv_min.v) uv_min.v = uv.v;
+        if (i == 0 || uv.u > uv_max.u) uv_max.u = uv.u;
+        if (i == 0 || uv.v > uv_max.v) uv_max.v = uv.v;
+    }
+
+    compact.position_min = mesh->bounds_min;
+    compact.position_scale.x = quantize_scale(mesh->bounds_min.x, mesh->bounds_max.x);
+    compact.position_scale.y = quantize_scale(mesh->bounds_min.y, mesh->bounds_max.y);
+    compact.position_scale.z = quantize_scale(mesh->bounds_min.z, mesh->bounds_max.z);
+    compact.uv_min = uv_min;
+    compact.uv_scale.u = quantize_scale(uv_min.u, uv_max.u);
+    compact.uv_scale.v = quantize_scale(uv_min.v, uv_max.v);
+
+    for (int i = 0; i < num_vertices; i++) {
+        vertex_t vertex = mesh->vertices[i];
+        compact_vertex_t* q = &compact.vertices[i];
+        q->x = quantize(vertex.position.x, compact.position_min.x, compact.position_scale.x);
+        q->y = quantize(vertex.position.y, compact.position_min.y, compact.position_scale.y);
+        q->z = quantize(vertex.position.z, compact.position_min.z, compact.position_scale.z);
+        q->u = quantize(vertex.uv.u, compact.uv_min.u, compact.uv_scale.u);
+        q->v = quantize(vertex.uv.v, compact.uv_min.v, compact.uv_scale.v);
+    }
+
+    for (int i = 0; i < num_faces; i++) {
+        face_t face = mesh->faces[i];
+        if (compact.index_size == sizeof(uint16_t)) {
+            uint16_t* indices = (uint16_t*)compact.indices + i * 3;
+            indices[0] = (uint16_t)face.a;
+            indices[1] = (uint16_t)face.b;
+            indices[2] = (uint16_t)face.c;
+        } else {
+            uint32_t* indices = (uint32_t*)compact.indices + (size_t)i * 3;
+            indices[0] = (uint32_t)face.a;
+            indices[1] = (uint32_t)face.b;
+            indices[2] = (uint32_t)face.c;
+        }
+    }
+
+    mesh->compact = compact;
+    return true;
+}
+
+void free_compact_mesh(mesh_t* mesh) {
+    if (mesh->compact.num_faces > 0) {
+        free(mesh->compact.vertices);
+        free(mesh->compact.indices);
+    }
+    mesh->compact.vertices = NULL;
+    mesh->compact.indices = NULL;
+    mesh->compact.num_vertices = 0;
+    mesh->compact.num_faces = 0;
+}
+
+//
+// Faces the render loop draws: those of the compact copy if there is one, which
+// is always at full detail, or else those of the given level of detail
+//
+int get_mesh_num_faces(const mesh_t* mesh, int lod) {
+    if (mesh->compact.num_faces > 0)
+        return mesh->compact.num_faces;
+
+    int num_faces;
+    get_mesh_lod_faces(mesh, lod, &num_faces);
+    return num_faces;
+}
+
+//
+// Fetch the three vertices of a face for the vertex stage, dequantizing them
+// when the mesh has a compact copy
+//
+void get_mesh_face_vertices(const mesh_t* mesh, int lod, int face_index, vertex_t vertices[3]) {
+    const compact_mesh_t* compact = &mesh->compact;
+    if (compact->num_faces == 0) {
+        int num_faces;
+        face_t face = get_mesh_lod_faces(mesh, lod, &num_faces)[face_index];
+        vertices[0] = mesh->vertices[face.a];
+        vertices[1] = mesh->vertices[face.b];
+        vertices[2] = mesh->vertices[face.c];
+        return;
+    }
+
+    uint32_t indices[3];
+    size_t first_corner = (size_t)face_index * 3;
+    if (compact->index_size == sizeof(uint16_t)) {
+        const uint16_t* face = (const uint16_t*)compact->indices + first_corner;
+        indices[0] = face[0];
+        indices[1] = face[1];
+        indices[2] = face[2];
+    } else {
+        const uint32_t* face = (const uint32_t*)compact->indices + first_corner;
+        indices[0] = face[0];
+        indices[1] = face[1];
+        indices[2] = face[2];
+    }
+
+    // Copy the ranges first, the stores to vertices could otherwise alias them
+    vec3_t position_min = compact->position_min;
+    vec3_t position_scale = compact->position_scale;
+    tex2_t uv_min = compact->uv_min;
+    tex2_t uv_scale = compact->uv_scale;
+    for (int j = 0; j < 3; j++) {
+        compact_vertex_t q = compact->vertices[indices[j]];
+        vertices[j].position.x = position_min.x + q.x * position_scale.x;
+        vertices[j].position.y = position_min.y + q.y * position_scale.y;
+        vertices[j].position.z = position_min.z + q.z * position_scale.z;
+        vertices[j].uv.u = uv_min.u + q.u * uv_scale.u;
+        vertices[j].uv.v = uv_min.v + q.v * uv_scale.v;
+    }
+}
+
+//
+// Bytes of vertex and index data the render loop reads per face, for either the
+// full arrays or the compact copy
+//
+float get_mesh_bytes_per_face(const mesh_t* mesh, bool is_compact) {
+    if (is_compact) {
+        if (mesh->compact.num_faces == 0)
+            return 0.0f;
+        return (sizeof(compact_vertex_t) * (float)mesh->compact.num_vertices) / mesh->compact.num_faces +
+            3.0f * mesh->compact.index_size;
+    }
+
+    int num_faces = array_length(mesh->faces);
+    if (num_faces == 0)
+        return 0.0f;
+    return (sizeof(vertex_t) * (float)array_length(mesh->vertices)) / num_faces + sizeof(face_t);
+}
@@ -0,0 +1,21 @@
+#ifndef MESH_COMPACT_H
+#define MESH_COMPACT_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+// Meshes with at least this many faces are rendered from a compact copy
+#define COMPACT_MESH_MIN_FACES 65536
+
+// Largest quantized position and texture coordinate component
+#define COMPACT_MESH_MAX_QUANTIZED 65535
+
+extern bool use_compact_meshes;
+
+bool compact_mesh(mesh_t* mesh);
+void free_compact_mesh(mesh_t* mesh);
+int get_mesh_num_faces(const mesh_t* mesh, int lod);
+void get_mesh_face_vertices(const mesh_t* mesh, int lod, int face_index, vertex_t vertices[3]);
+float get_mesh_bytes_per_face(const mesh_t* mesh, bool is_compact);
+
+#endif
@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "array.h"
+#include "mesh_lod.h"
+#include "mesh_optimize.h"
+
+// Build levels of detail for large meshes and draw the one their screen size needs
+bool use_mesh_lods = true;
+
+//
+// Sum of squared distances to a set of planes, weighted by the area of the
+// faces that lie in them
+//
+typedef struct {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+} quadric_t;
+
+//
+// Moving one vertex onto a neighbour, which removes the faces on their edge
+//
+typedef struct {
+    int from;
+    int to;
+    float cost;     // Squared distance the surface moves, see quadric_error
+} collapse_t;
+
+typedef struct {
+    const vertex_t* vertices;
+    int num_vertices;
+    int* position_ids;      // Lowest index of the vertices with the same position
+    bool* is_locked;        // Vertices on uv seams, borders and non-manifold edges never move
+    quadric_t* quadrics;    // Indexed by position id
+    face_t* faces;
+    int num_faces;
+    float error;            // Largest distance a collapse has moved the surface so far
+
+    // Scratch of a simplification pass
+    int* collapse_to;
+    bool* is_pass_locked;
+    int* adjacency_offsets; // Faces around each vertex
+    int* adjacency;
+    collapse_t* collapses;
+} simplifier_t;
+
+static void quadric_add_plane(quadric_t* q, vec3_t n, float d, float weight) {
+    q->a00 += weight * n.x * n.x;
+    q->a01 += weight * n.x * n.y;
+    q->a02 += weight * n.x * n.z;
+    q->a11 += weight * n.y * n.y;
+    q->a12 += weight * n.y * n.z;
+    q->a22 += weight * n.z * n.z;
+    q->b0 += weight * n.x * d;
+    q->b1 += weight * n.y * d;
+    q->b2 += weight * n.z * d;
+    q->c += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(quadric_t* q, const quadric_t* other) {
+    q->a00 += other->a00;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a11 += other->a11;
+    q->a12 += other->a12;
+    q->a22 += other->a22;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->weight += other->weight;
+}
+
+//
+// Mean squared distance of a point to the planes of two quadrics
+//
+static float quadric_error(const quadric_t* q0, const quadric_t* q1, vec3_t p) {
+    quadric_t q = *q0;
+    quadric_add(&q, q1);
+    if (q.weight <= 0)
+        return 0;
+
+    double error =
+        q.a00 * p.x * p.x + 2 * q.a01 * p.x * p.y + 2 * q.a02 * p.x * p.z +
+        q.a11 * p.y * p.y + 2 * q.a12 * p.y * p.z + q.a22 * p.z * p.z +
+        2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+    return error > 0 ? (float)(error / q.weight) : 0.0f;
+}
+
+static vec3_t face_normal(vec3_t a, vec3_t b, vec3_t c) {
+    return vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+}
+
+static int compare_edges(const void* a, const void* b) {
+    uint64_t p = *(const uint64_t*)a;
+    uint64_t q = *(const uint64_t*)b;
+    return p < q ? -1 : p > q;
+}
+
+static int compare_collapses(const void* a, const void* b) {
+    float p = ((const collapse_t*)a)->cost;
+    float q = ((const collapse_t*)b)->cost;
+    return p < q ? -1 : p > q;
+}
+
+static bool is_degenerate(const simplifier_t* s, face_t face) {
+    int a = s->position_ids[face.a], b = s->position_ids[face.b], c = s->position_ids[face.c];
+    return a == b || b == c || c == a;
+}
+
+//
+// Find the vertices that share a position, lock the ones that have to stay for
+// the mesh to keep its shape and uv layout, and sum the plane quadrics. Returns
+// false when out of memory. The simplifier has to be freed either way.
+//
+static bool init_simplifier(simplifier_t* s, const mesh_t* mesh) {
+    int num_vertices = array_length(mesh->vertices);
+    int num_faces = array_length(mesh->faces);
+    int size = num_vertices > 0 ? num_vertices : 1;
+
+    s->vertices = mesh->vertices;
+    s->num_vertices = num_vertices;
+    s->position_ids = malloc(sizeof(int) * size);
+    s->is_locked = calloc(size, sizeof(bool));
+    s->quadrics = calloc(size, sizeof(quadric_t));
+    s->collapse_to = malloc(sizeof(int) * size);
+    s->is_pass_locked = calloc(size, sizeof(bool));
+    s->adjacency_offsets = malloc(sizeof(int) * (size + 1));
+    s->adjacency = malloc(sizeof(int) * (num_faces * 3 + 1));
+    s->collapses = malloc(sizeof(collapse_t) * (num_faces * 6 + 1));
+    s->faces = malloc(sizeof(face_t) * (num_faces + 1));
+    s->error = 0;
+    if (s->position_ids == NULL || s->is_locked == NULL || s->quadrics == NULL || s->collapse_to == NULL ||
+        s->is_pass_locked == NULL || s->adjacency_offsets == NULL || s->adjacency == NULL || s->collapses == NULL ||
+        s->faces == NULL)
+        return false;
+    for (int i = 0; i < num_vertices; i++) {
+        s->collapse_to[i] = -1;
+    }
+
+    // Vertices with the same position but another uv lie on a seam
+    if (!compute_position_ids(mesh->vertices, num_vertices, s->position_ids))
+        return false;
+    for (int i = 0; i < num_vertices; i++) {
+        if (s->position_ids[i] != i) {
+            s->is_locked[i] = true;
+            s->is_locked[s->position_ids[i]] = true;
+        }
+    }
+
+    // Faces that already are degenerate are dropped
+    s->num_faces = 0;
+    for (int i = 0; i < num_faces; i++) {
+        if (!is_degenerate(s, mesh->faces[i]))
+            s->faces[s->num_faces++] = mesh->faces[i];
+    }
+
+    // An edge that is not shared by exactly two faces is a border or non-manifold
+    uint64_t* edges = malloc(sizeof(uint64_t) * (s->num_faces * 3 + 1));
+    bool* is_position_locked = calloc(size, sizeof(bool));
+    if (edges == NULL || is_position_locked == NULL) {
+        free(is_position_locked);
+        free(edges);
+        return false;
+    }
+    for (int i = 0; i < s->num_faces; i++) {
+        const int corners[3] = { s->faces[i].a, s->faces[i].b, s->faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            uint64_t p = s->position_ids[corners[j]];
+            uint64_t q = s->position_ids[corners[(j + 1) % 3]];
+            edges[i * 3 + j] = p < q ? (p << 32 | q) : (q << 32 | p);
+        }
+    }
+    qsort(edges, s->num_faces * 3, sizeof(uint64_t), compare_edges);
+    for (int i = 0; i < s->num_faces * 3; ) {
+        int end = i + 1;
+        while (end < s->num_faces * 3 && edges[end] == edges[i])
+            end++;
+        if (end - i != 2) {
+            is_position_locked[edges[i] >> 32] = true;
+            is_position_locked[edges[i] & 0xFFFFFFFF] = true;
+        }
+        i = end;
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        s->is_locked[i] = s->is_locked[i] || is_position_locked[s->position_ids[i]];
+    }
+    free(is_position_locked);
+    free(edges);
+
+    for (int i = 0; i < s->num_faces; i++) {
+        face_t face = s->faces[i];
+        vec3_t a = s->vertices[face.a].position;
+        vec3_t normal = face_normal(a, s->vertices[face.b].position, s->vertices[face.c].position);
+        float length = vec3_length(normal);
+        if (length <= 0)
+            continue;
+        normal = vec3_div(normal, length);
+        float d = -vec3_dot(normal, a);
+        quadric_add_plane(&s->quadrics[s->position_ids[face.a]], normal, d, length * 0.5f);
+        quadric_add_plane(&s->quadrics[s->position_ids[face.b]], normal, d, length * 0.5f);
+        quadric_add_plane(&s->quadrics[s->position_ids[face.c]], normal, d, length * 0.5f);
+    }
+    return true;
+}
+
+static void free_simplifier(simplifier_t* s) {
+    free(s->position_ids);
+    free(s->is_locked);
+    free(s->quadrics);
+    free(s->collapse_to);
+    free(s->is_pass_locked);
+    free(s->adjacency_offsets);
+    free(s->adjacency);
+    free(s->collapses);
+    free(s->faces);
+}
+
+static void build_adjacency(simplifier_t* s) {
+    memset(s->adjacency_offsets, 0, sizeof(int) * (s->num_vertices + 1));
+    for (int i = 0; i < s->num_faces; i++) {
+        s->adjacency_offsets[s->faces[i].a + 1]++;
+        s->adjacency_offsets[s->faces[i].b + 1]++;
+        s->adjacency_offsets[s->faces[i].c + 1]++;
+    }
+    for (int i = 0; i < s->num_vertices; i++) {
+        s->adjacency_offsets[i + 1] += s->adjacency_offsets[i];
+    }
+    // Fill using the offsets as cursors, then shift them back
+    for (int i = 0; i < s->num_faces; i++) {
+        s->adjacency[s->adjacency_offsets[s->faces[i].a]++] = i;
+        s->adjacency[s->adjacency_offsets[s->faces[i].b]++] = i;
+        s->adjacency[s->adjacency_offsets[s->faces[i].c]++] = i;
+    }
+    for (int i = s->num_vertices; i > 0; i--) {
+        s->adjacency_offsets[i] = s->adjacency_offsets[i - 1];
+    }
+    s->adjacency_offsets[0] = 0;
+}
+
+//
+// Check that moving a vertex onto another flips none of the faces that stay,
+// and count the faces that collapse with the edge
+//
+static bool is_valid_collapse(const simplifier_t* s, int from, int to, int* num_removed) {
+    vec3_t target = s->vertices[to].position;
+    *num_removed = 0;
+    for (int k = s->adjacency_offsets[from]; k < s->adjacency_offsets[from + 1]; k++) {
+        face_t face = s->faces[s->adjacency[k]];
+        const int corners[3] = { face.a, face.b, face.c };
+        vec3_t before[3], after[3];
+        bool has_target = false;
+        for (int j = 0; j < 3; j++) {
+            has_target = has_target || s->position_ids[corners[j]] == s->position_ids[to];
+            before[j] = s->vertices[corners[j]].position;
+            after[j] = corners[j] == from ? target : before[j];
+        }
+        if (has_target) {
+            (*num_removed)++;
+            continue;
+        }
+        vec3_t normal_before = face_normal(before[0], before[1], before[2]);
+        vec3_t normal_after = face_normal(after[0], after[1], after[2]);
+        if (vec3_dot(normal_before, normal_after) <= 0)
+            return false;
+    }
+    return *num_removed > 0;
+}
+
+//
+// Collapse the cheapest edges whose neighbourhoods do not overlap, so every
+// collapse in a pass is checked against the faces as they end up. Returns the
+// number of collapses.
+//
+static int simplify_pass(simplifier_t* s, int target_faces, float max_error) {
+    build_adjacency(s);
+
+    int num_collapses = 0;
+    for (int i = 0; i < s->num_faces; i++) {
+        const int corners[3] = { s->faces[i].a, s->faces[i].b, s->faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            // Each edge can collapse either way
+            const int ends[2] = { corners[j], corners[(j + 1) % 3] };
+            for (int k = 0; k < 2; k++) {
+                int from = ends[k];
+                int to = ends[1 - k];
+                if (s->is_locked[from] || s->position_ids[from] == s->position_ids[to])
+                    continue;
+                collapse_t collapse = { from, to, quadric_error(&s->quadrics[s->position_ids[from]],
+                    &s->quadrics[s->position_ids[to]], s->vertices[to].position) };
+                s->collapses[num_collapses++] = collapse;
+            }
+        }
+    }
+    qsort(s->collapses, num_collapses, sizeof(collapse_t), compare_collapses);
+
+    int num_removed = 0;
+    int num_done = 0;
+    float max_cost = max_error * max_error;
+    for (int i = 0; i < num_collapses && num_removed < s->num_faces - target_faces; i++) {
+        collapse_t collapse = s->collapses[i];
+        if (collapse.cost > max_cost)
+            break;
+        if (s->is_pass_locked[collapse.from] || s->is_pass_locked[collapse.to])
+            continue;
+
+        int num_collapse_removed;
+        if (!is_valid_collapse(s, collapse.from, collapse.to, &num_collapse_removed))
+            continue;
+
+        s->collapse_to[collapse.from] = collapse.to;
+        quadric_add(&s->quadrics[s->position_ids[collapse.to]], &s->quadrics[s->position_ids[collapse.from]]);
+        s->error = fmaxf(s->error, sqrtf(collapse.cost));
+        num_removed += num_collapse_removed;
+        num_done++;
+
+        // Lock the whole neighbourhood so the next collapses see the faces as they are
+        s->is_pass_locked[collapse.to] = true;
+        for (int k = s->adjacency_offsets[collapse.from]; k < s->adjacency_offsets[collapse.from + 1]; k++) {
+            face_t face = s->faces[s->adjacency[k]];
+            s->is_pass_locked[face.a] = true;
+            s->is_pass_locked[face.b] = true;
+            s->is_pass_locked[face.c] = true;
+        }
+    }
+
+    int num_faces = 0;
+    for (int i = 0; i < s->num_faces; i++) {
+        face_t face = s->faces[i];
+        if (s->collapse_to[face.a] >= 0) face.a = s->collapse_to[face.a];
+        if (s->collapse_to[face.b] >= 0) face.b = s->collapse_to[face.b];
+        if (s->collapse_to[face.c] >= 0) face.c = s->collapse_to[face.c];
+        if (!is_degenerate(s, face))
+            s->faces[num_faces++] = face;
+    }
+    s->num_faces = num_faces;
+
+    for (int i = 0; i < s->num_vertices; i++) {
+        s->collapse_to[i] = -1;
+        s->is_pass_locked[i] = false;
+    }
+    return num_done;
+}
+
+static void simplify(simplifier_t* s, int target_faces, float max_error) {
+    while (s->num_faces > target_faces) {
+        if (simplify_pass(s, target_faces, max_error) == 0)
+            break;
+    }
+}
+
+//
+// Build coarser levels of detail, each with about half the faces of the one
+// before, by quadric error edge collapses. Every level indexes the vertices of
+// the mesh: a collapse moves a vertex onto a neighbour instead of creating a
+// new one, and vertices on uv seams and borders never move, so the uv layout
+// and open edges are kept. Levels stop once the error gets too large. The faces
+// of every level are put in vertex cache order if those of the mesh are.
+//
+void build_mesh_lods(mesh_t* mesh, bool is_vertex_cache_order) {
+    for (int i = 1; i < mesh->num_lods; i++) {
+        array_free(mesh->lods[i]);
+    }
+    int num_faces = array_length(mesh->faces);
+    mesh->lods[0] = mesh->faces;
+    mesh->lod_errors[0] = 0;
+    mesh->num_lods = 1;
+    if (num_faces < LOD_MIN_FACES)
+        return;
+
+    vec3_t extent = vec3_sub(mesh->bounds_max, mesh->bounds_min);
+    float max_error = LOD_MAX_ERROR * vec3_length(extent) * 0.5f;
+
+    // Without memory to simplify, the mesh is drawn at full detail only
+    simplifier_t simplifier;
+    if (!init_simplifier(&simplifier, mesh)) {
+        free_simplifier(&simplifier);
+        return;
+    }
+    for (int level = 1; level < MESH_MAX_LODS; level++) {
+        int previous_faces = array_length(mesh->lods[level - 1]);
+        simplify(&simplifier, num_faces >> level, max_error);
+        if (simplifier.num_faces > previous_faces * LOD_MIN_REDUCTION)
+            break;
+
+        face_t* faces = array_append(NULL, simplifier.faces, simplifier.num_faces, sizeof(face_t));
+        if (faces == NULL)
+            break;
+        if (is_vertex_cache_order)
+            optimize_face_order(faces, simplifier.num_faces, simplifier.num_vertices);
+        mesh->lods[level] = faces;
+        mesh->lod_errors[level] = simplifier.error;
+        mesh->num_lods++;
+    }
+    free_simplifier(&simplifier);
+}
+
+//
+// Pick the coarsest level whose error stays below LOD_PIXEL_ERROR pixels at the
+// near side of the mesh's bounding sphere, with hysteresis around the level it
+// was drawn at last. The projection scale is the pixels per unit at a distance
+// of one.
+//
+int select_mesh_lod(const mesh_t* mesh, int lod, mat4_t world_view_matrix, float projection_scale) {
+    if (mesh->num_lods <= 1)
+        return 0;
+
+    // The largest axis scale of the world matrix turns model units into view ones
+    float scale = 0;
+    for (int j = 0; j < 3; j++) {
+        vec3_t axis = { world_view_matrix.m[0][j], world_view_matrix.m[1][j], world_view_matrix.m[2][j] };
+        scale = fmaxf(scale, vec3_length(axis));
+    }
+
+    vec3_t center = vec3_mul(vec3_add(mesh->bounds_min, mesh->bounds_max), 0.5f);
+    float radius = vec3_length(vec3_sub(mesh->bounds_max, mesh->bounds_min)) * 0.5f * scale;
+    vec4_t view_center = mat4_mul_vec4(world_view_matrix, vec4_from_vec3(center));
+    float distance = view_center.z - radius;
+    if (distance <= 0)
+        return 0;
+
+    float pixels_per_unit = projection_scale * scale / distance;
+    lod = lod < 0 ? 0 : lod < mesh->num_lods ? lod : mesh->num_lods - 1;
+    while (lod > 0 && mesh->lod_errors[lod] * pixels_per_unit > LOD_PIXEL_ERROR)
+        lod--;
+    while (lod + 1 < mesh->num_lods && mesh->lod_errors[lod + 1] * pixels_per_unit <= LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+        lod++;
+    return lod;
+}
+
+//
+// The faces of a level of detail, the full detail ones for a level the mesh lacks
+//
+const face_t* get_mesh_lod_faces(const mesh_t* mesh, int lod, int* num_faces) {
+    const face_t* faces = lod > 0 && lod < mesh->num_lods ? mesh->lods[lod] : mesh->faces;
+    *num_faces = array_length((void*)faces);
+    return faces;
+}
@@ -0,0 +1,30 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "matrix.h"
+
+// Meshes with fewer faces are always drawn at full detail
+#define LOD_MIN_FACES 1024
+
+// A level is only kept if it has at most this share of the faces of the one before
+#define LOD_MIN_REDUCTION 0.8f
+
+// Simplification stops once the error would exceed this share of the mesh radius
+#define LOD_MAX_ERROR 0.05f
+
+// A level is drawn while its error covers at most this many pixels on screen
+#define LOD_PIXEL_ERROR 1.0f
+
+// Switching to a coarser level needs the error to drop below this share of
+// LOD_PIXEL_ERROR, so meshes at the threshold distance do not flicker between levels
+#define LOD_HYSTERESIS 0.75f
+
+extern bool use_mesh_lods;
+
+void build_mesh_lods(mesh_t* mesh, bool is_vertex_cache_order);
+int select_mesh_lod(const mesh_t* mesh, int lod, mat4_t world_view_matrix, float projection_scale);
+const face_t* get_mesh_lod_faces(const mesh_t* mesh, int lod, int* num_faces);
+
+#endif
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "array.h"
+#include "mesh_optimize.h"
+
+// Reorder the faces and vertices of loaded meshes for the vertex cache
+bool use_vertex_cache_order = true;
+
+// Tuning of the vertex scores, from Tom Forsyth's linear-speed vertex cache optimisation
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_FACE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define MAX_VALENCE_SCORES 64
+
+typedef struct {
+    int first_face;     // Offset of the faces using the vertex in the adjacency list
+    int num_active;     // Faces not emitted yet, kept at the front of its list
+    int cache_position; // -1 when the vertex is not in the cache
+    float score;
+} optimize_vertex_t;
+
+typedef struct {
+    optimize_vertex_t* vertices;
+    int* adjacency;
+    float cache_scores[VERTEX_CACHE_SIZE];
+    float valence_scores[MAX_VALENCE_SCORES];
+} optimize_state_t;
+
+//
+// Score a vertex higher the more recently it was used, so its faces are emitted
+// while it is still cached, and the fewer faces it has left, so that vertices
+// are finished off rather than left behind with one lonely face
+//
+static float vertex_score(const optimize_state_t* state, const optimize_vertex_t* vertex) {
+    if (vertex->num_active == 0)
+        return -1.0f;
+
+    float score = vertex->cache_position >= 0 ? state->cache_scores[vertex->cache_position] : 0.0f;
+    if (vertex->num_active < MAX_VALENCE_SCORES)
+        score += state->valence_scores[vertex->num_active];
+    else
+        score += VALENCE_BOOST_SCALE * powf((float)vertex->num_active, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+static void init_scores(optimize_state_t* state) {
+    for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+        // The three vertices of the last face get a fixed score, so the next face
+        // does not strongly prefer reusing exactly two of them
+        if (i < 3)
+            state->cache_scores[i] = LAST_FACE_SCORE;
+        else
+            state->cache_scores[i] = powf(1.0f - (i - 3) / (float)(VERTEX_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    state->valence_scores[0] = 0.0f;
+    for (int i = 1; i < MAX_VALENCE_SCORES; i++) {
+        state->valence_scores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+}
+
+//
+// Take a face off the active part of the adjacency list of a vertex
+//
+static void remove_active_face(optimize_state_t* state, int vertex_index, int face_index) {
+    optimize_vertex_t* vertex = &state->vertices[vertex_index];
+    int* faces = state->adjacency + vertex->first_face;
+    for (int i = 0; i < vertex->num_active; i++) {
+        if (faces[i] == face_index) {
+            faces[i] = faces[vertex->num_active - 1];
+            faces[vertex->num_active - 1] = face_index;
+            vertex->num_active--;
+            return;
+        }
+    }
+}
+
+//
+// Greedily emit faces in the order that keeps a simulated vertex cache hot.
+// Each step emits the face with the highest score, the sum of its vertex scores,
+// and only the vertices in the cache change score, so the next best face is
+// searched among their faces. Fills order with the face indices to emit, or
+// returns false when out of memory.
+//
+static bool order_faces(const face_t* faces, int num_faces, int num_vertices, int* order) {
+    optimize_state_t state;
+    init_scores(&state);
+    state.vertices = calloc(num_vertices > 0 ? num_vertices : 1, sizeof(optimize_vertex_t));
+    state.adjacency = malloc(sizeof(int) * num_faces * 3);
+    float* face_scores = malloc(sizeof(float) * num_faces);
+    bool* is_emitted = calloc(num_faces, sizeof(bool));
+    if (state.vertices == NULL || state.adjacency == NULL || face_scores == NULL || is_emitted == NULL) {
+        free(is_emitted);
+        free(face_scores);
+        free(state.adjacency);
+        free(state.vertices);
+        return false;
+    }
+
+    // Build the list of faces using each vertex
+    for (int i = 0; i < num_faces; i++) {
+        state.vertices[faces[i].a].num_active++;
+        state.vertices[faces[i].b].num_active++;
+        state.vertices[faces[i].c].num_active++;
+    }
+    int offset = 0;
+    for (int i = 0; i < num_vertices; i++) {
+        state.vertices[i].first_face = offset;
+        offset += state.vertices[i].num_active;
+        state.vertices[i].num_active = 0;
+        state.vertices[i].cache_position = -1;
+    }
+    for (int i = 0; i < num_faces; i++) {
+        const int corners[3] = { faces[i].a, faces[i].b, faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            optimize_vertex_t* vertex = &state.vertices[corners[j]];
+            state.adjacency[vertex->first_face + vertex->num_active++] = i;
+        }
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        state.vertices[i].score = vertex_score(&state, &state.vertices[i]);
+    }
+    int best_face = 0;
+    for (int i = 0; i < num_faces; i++) {
+        face_scores[i] = state.vertices[faces[i].a].score + state.vertices[faces[i].b].score + state.vertices[faces[i].c].score;
+        if (face_scores[i] > face_scores[best_face])
+            best_face = i;
+    }
+
+    int cache[VERTEX_CACHE_SIZE + 3];
+    int cache_length = 0;
+    int next_unemitted = 0;
+
+    for (int i = 0; i < num_faces; i++) {
+        // With no face left around the cache, continue with the next one in file order
+        if (best_face < 0) {
+            while (is_emitted[next_unemitted])
+                next_unemitted++;
+            best_face = next_unemitted;
+        }
+
+        const int corners[3] = { faces[best_face].a, faces[best_face].b, faces[best_face].c };
+        order[i] = best_face;
+        is_emitted[best_face] = true;
+        for (int j = 0; j < 3; j++) {
+            remove_active_face(&state, corners[j], best_face);
+        }
+
+        // The vertices of the face move to the front of the cache, pushing the rest back
+        int new_cache[VERTEX_CACHE_SIZE + 3];
+        int new_length = 0;
+        for (int j = 0; j < 3; j++) {
+            if (new_length == 0 || (new_cache[0] != corners[j] && (new_length == 1 || new_cache[1] != corners[j])))
+                new_cache[new_length++] = corners[j];
+        }
+        for (int j = 0; j < cache_length; j++) {
+            if (cache[j] != corners[0] && cache[j] != corners[1] && cache[j] != corners[2])
+                new_cache[new_length++] = cache[j];
+        }
+
+        // Rescore the cached and the evicted vertices and the faces they still have
+        for (int j = 0; j < new_length; j++) {
+            optimize_vertex_t* vertex = &state.vertices[new_cache[j]];
+            vertex->cache_position = j < VERTEX_CACHE_SIZE ? j : -1;
+            float score = vertex_score(&state, vertex);
+            float change = score - vertex->score;
+            vertex->score = score;
+            for (int k = 0; k < vertex->num_active; k++) {
+                face_scores[state.adjacency[vertex->first_face + k]] += change;
+            }
+        }
+
+        cache_length = new_length < VERTEX_CACHE_SIZE ? new_length : VERTEX_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(int) * cache_length);
+
+        best_face = -1;
+        float best_score = -1.0f;
+        for (int j = 0; j < cache_length; j++) {
+            const optimize_vertex_t* vertex = &state.vertices[cache[j]];
+            for (int k = 0; k < vertex->num_active; k++) {
+                int face = state.adjacency[vertex->first_face + k];
+                if (face_scores[face] > best_score) {
+                    best_score = face_scores[face];
+                    best_face = face;
+                }
+            }
+        }
+    }
+
+    free(is_emitted);
+    free(face_scores);
+    free(state.adjacency);
+    free(state.vertices);
+    return true;
+}
+
+//
+// Reorder the faces of a mesh to make the most of a post-transform vertex cache,
+// then its vertices into the order the faces first use them, so vertex fetches
+// walk forward through memory. Face normals, if present, follow their faces.
+// Returns false when out of memory, with the mesh left in the order it had.
+//
+bool optimize_mesh_order(mesh_t* mesh) {
+    int num_faces = array_length(mesh->faces);
+    int num_vertices = array_length(mesh->vertices);
+    if (num_faces == 0)
+        return true;
+
+    bool has_normals = array_length(mesh->normals) == num_faces;
+    int* order = malloc(sizeof(int) * num_faces);
+    face_t* faces = malloc(sizeof(face_t) * num_faces);
+    vec3_t* normals = has_normals ? malloc(sizeof(vec3_t) * num_faces) : NULL;
+    int* remap = malloc(sizeof(int) * (num_vertices > 0 ? num_vertices : 1));
+    vertex_t* vertices = malloc(sizeof(vertex_t) * (num_vertices > 0 ? num_vertices : 1));
+    bool is_allocated = order != NULL && faces != NULL && (normals != NULL || !has_normals) && remap != NULL && vertices != NULL;
+    if (!is_allocated || !order_faces(mesh->faces, num_faces, num_vertices, order)) {
+        free(vertices);
+        free(remap);
+        free(normals);
+        free(faces);
+        free(order);
+        return false;
+    }
+
+    for (int i = 0; i < num_faces; i++) {
+        faces[i] = mesh->faces[order[i]];
+    }
+    if (has_normals) {
+        for (int i = 0; i < num_faces; i++) {
+            normals[i] = mesh->normals[order[i]];
+        }
+        memcpy(mesh->normals, normals, sizeof(vec3_t) * num_faces);
+    }
+
+    // Number the vertices by first use, leaving any unused ones at the end
+    for (int i = 0; i < num_vertices; i++) {
+        remap[i] = -1;
+    }
+    int next_vertex = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int* corners[3] = { &faces[i].a, &faces[i].b, &faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            if (remap[*corners[j]] < 0)
+                remap[*corners[j]] = next_vertex++;
+            *corners[j] = remap[*corners[j]];
+        }
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        if (remap[i] < 0)
+            remap[i] = next_vertex++;
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        vertices[remap[i]] = mesh->vertices[i];
+    }
+    memcpy(mesh->vertices, vertices, sizeof(vertex_t) * num_vertices);
+    memcpy(mesh->faces, faces, sizeof(face_t) * num_faces);
+
+    free(vertices);
+    free(remap);
+    free(normals);
+    free(faces);
+    free(order);
+    return true;
+}
+
+//
+// Reorder only the faces of an index array for the vertex cache, for face
+// arrays that share the vertices of a mesh, such as its levels of detail.
+// When out of memory the faces keep the order they had.
+//
+void optimize_face_order(face_t* faces, int num_faces, int num_vertices) {
+    if (num_faces == 0)
+        return;
+
+    int* order = malloc(sizeof(int) * num_faces);
+    face_t* ordered = malloc(sizeof(face_t) * num_faces);
+    if (order == NULL || ordered == NULL || !order_faces(faces, num_faces, num_vertices, order)) {
+        free(ordered);
+        free(order);
+        return;
+    }
+    for (int i = 0; i < num_faces; i++) {
+        ordered[i] = faces[order[i]];
+    }
+    memcpy(faces, ordered, sizeof(face_t) * num_faces);
+
+    free(ordered);
+    free(order);
+}
+
+//
+// Average cache miss ratio: vertices transformed per face with a first in, first
+// out cache of the given size in front of the vertex stage. It ranges from 3 for
+// no reuse down to about 0.5 for a large regular grid.
+//
+float compute_mesh_acmr(const mesh_t* mesh, int cache_size) {
+    int num_faces = array_length(mesh->faces);
+    int num_vertices = array_length(mesh->vertices);
+    if (num_faces == 0)
+        return 0.0f;
+
+    // A vertex is cached while fewer than cache_size misses happened since its own
+    int* miss_stamps = malloc(sizeof(int) * (num_vertices > 0 ? num_vertices : 1));
+    for (int i = 0; i < num_vertices; i++) {
+        miss_stamps[i] = -cache_size - 1;
+    }
+    int num_misses = 0;
+    for (int i = 0; i < num_faces; i++) {
+        const int corners[3] = { mesh->faces[i].a, mesh->faces[i].b, mesh->faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            if (num_misses - miss_stamps[corners[j]] > cache_size) {
+                miss_stamps[corners[j]] = num_misses++;
+            }
+        }
+    }
+    free(miss_stamps);
+    return (float)num_misses / num_faces;
+}
@@ -0,0 +1,19 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+// Entries of the least recently used cache the face order is tuned for
+#define VERTEX_CACHE_SIZE 32
+
+// Entries of the first in, first out cache the miss ratio is measured with
+#define ACMR_CACHE_SIZE 16
+
+extern bool use_vertex_cache_order;
+
+bool optimize_mesh_order(mesh_t* mesh);
+void optimize_face_order(face_t* faces, int num_faces, int num_vertices);
+float compute_mesh_acmr(const mesh_t* mesh, int cache_size);
+
+#endif
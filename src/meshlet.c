@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "array.h"
+#include "clipping.h"
+#include "meshlet.h"
+
+// Skip whole face clusters that are outside the frustum or face away from the camera
+bool use_meshlet_culling = true;
+
+cull_stats_t cull_stats;
+
+static int compare_ints(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+static vec3_t face_unit_normal(const vertex_t* vertices, face_t face) {
+    vec3_t a = vertices[face.a].position;
+    vec3_t normal = vec3_cross(vec3_sub(vertices[face.b].position, a), vec3_sub(vertices[face.c].position, a));
+    if (vec3_length(normal) > 0)
+        vec3_normalize(&normal);
+    return normal;
+}
+
+//
+// Bounding sphere and normal cone of the faces of a cluster. The cone cutoff is
+// the sine of the widest angle between a face normal and the axis: every face
+// points away from an eye for which dot(center - eye, axis) is at least
+// cutoff * length(center - eye) + radius.
+//
+static meshlet_t make_meshlet(const vertex_t* vertices, const face_t* faces, const vec3_t* normals,
+    const int* order, int first_face, int num_faces) {
+    meshlet_t meshlet = { .first_face = first_face, .num_faces = num_faces };
+
+    vec3_t bounds_min = vertices[faces[order[first_face]].a].position;
+    vec3_t bounds_max = bounds_min;
+    vec3_t normal_sum = { 0, 0, 0 };
+    for (int i = first_face; i < first_face + num_faces; i++) {
+        face_t face = faces[order[i]];
+        const int corners[3] = { face.a, face.b, face.c };
+        for (int j = 0; j < 3; j++) {
+            vec3_t v = vertices[corners[j]].position;
+            bounds_min = vec3_new(fminf(bounds_min.x, v.x), fminf(bounds_min.y, v.y), fminf(bounds_min.z, v.z));
+            bounds_max = vec3_new(fmaxf(bounds_max.x, v.x), fmaxf(bounds_max.y, v.y), fmaxf(bounds_max.z, v.z));
+        }
+        normal_sum = vec3_add(normal_sum, normals[order[i]]);
+    }
+
+    meshlet.center = vec3_mul(vec3_add(bounds_min, bounds_max), 0.5f);
+    meshlet.radius = 0;
+    for (int i = first_face; i < first_face + num_faces; i++) {
+        face_t face = faces[order[i]];
+        const int corners[3] = { face.a, face.b, face.c };
+        for (int j = 0; j < 3; j++) {
+            meshlet.radius = fmaxf(meshlet.radius, vec3_length(vec3_sub(vertices[corners[j]].position, meshlet.center)));
+        }
+    }
+
+    meshlet.cone_cutoff = 1;
+    meshlet.cone_axis = vec3_new(0, 0, 0);
+    if (vec3_length(normal_sum) <= 0)
+        return meshlet;
+    vec3_normalize(&normal_sum);
+
+    // Degenerate faces have no normal and are never visible, they do not widen the cone
+    float min_dot = 1;
+    for (int i = first_face; i < first_face + num_faces; i++) {
+        vec3_t normal = normals[order[i]];
+        if (vec3_length(normal) > 0)
+            min_dot = fminf(min_dot, vec3_dot(normal, normal_sum));
+    }
+    meshlet.cone_axis = normal_sum;
+    if (min_dot > MESHLET_MIN_CONE_DOT)
+        meshlet.cone_cutoff = sqrtf(1 - min_dot * min_dot);
+    return meshlet;
+}
+
+//
+// Grow clusters of up to MESHLET_MAX_FACES faces from the first face not in one
+// yet, each time adding the neighbouring face that shares the most positions
+// with the cluster and whose normal is closest to its average, so clusters stay
+// compact. Faces turned too far from the average start another cluster, which
+// keeps the normal cones narrow enough to cull on hard edged models. Fills
+// order with the faces cluster by cluster and returns the clusters, or NULL
+// when out of memory.
+//
+static meshlet_t* partition_faces(const vertex_t* vertices, int num_vertices, const face_t* faces, int num_faces, int* order) {
+    vec3_t* normals = malloc(sizeof(vec3_t) * (num_faces + 1));
+    int* adjacency_offsets = calloc(num_vertices + 1, sizeof(int));
+    int* adjacency = malloc(sizeof(int) * (num_faces * 3 + 1));
+    int* candidates = malloc(sizeof(int) * (num_faces + 1));
+    int* candidate_ids = calloc(num_faces + 1, sizeof(int));
+    int* vertex_ids = calloc(num_vertices + 1, sizeof(int));  // Indexed by position id
+    bool* is_assigned = calloc(num_faces + 1, sizeof(bool));
+    int* position_ids = malloc(sizeof(int) * (num_vertices + 1));
+    bool is_allocated = normals != NULL && adjacency_offsets != NULL && adjacency != NULL && candidates != NULL &&
+        candidate_ids != NULL && vertex_ids != NULL && is_assigned != NULL && position_ids != NULL;
+    if (!is_allocated || !compute_position_ids(vertices, num_vertices, position_ids)) {
+        free(normals);
+        free(adjacency_offsets);
+        free(adjacency);
+        free(candidates);
+        free(candidate_ids);
+        free(vertex_ids);
+        free(is_assigned);
+        free(position_ids);
+        return NULL;
+    }
+
+    // Faces around each position, so clusters grow across uv seams
+    for (int i = 0; i < num_faces; i++) {
+        normals[i] = face_unit_normal(vertices, faces[i]);
+        adjacency_offsets[position_ids[faces[i].a] + 1]++;
+        adjacency_offsets[position_ids[faces[i].b] + 1]++;
+        adjacency_offsets[position_ids[faces[i].c] + 1]++;
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        adjacency_offsets[i + 1] += adjacency_offsets[i];
+    }
+    for (int i = 0; i < num_faces; i++) {
+        adjacency[adjacency_offsets[position_ids[faces[i].a]]++] = i;
+        adjacency[adjacency_offsets[position_ids[faces[i].b]]++] = i;
+        adjacency[adjacency_offsets[position_ids[faces[i].c]]++] = i;
+    }
+    for (int i = num_vertices; i > 0; i--) {
+        adjacency_offsets[i] = adjacency_offsets[i - 1];
+    }
+    adjacency_offsets[0] = 0;
+
+    meshlet_t* meshlets = NULL;
+    int num_ordered = 0;
+    for (int seed = 0; seed < num_faces; seed++) {
+        if (is_assigned[seed])
+            continue;
+
+        // Stamps tell which cluster a candidate or position was last seen by
+        int id = array_length(meshlets) + 1;
+        int first_face = num_ordered;
+        int num_candidates = 0;
+        vec3_t normal_sum = { 0, 0, 0 };
+        candidates[num_candidates++] = seed;
+        candidate_ids[seed] = id;
+
+        while (num_candidates > 0 && num_ordered - first_face < MESHLET_MAX_FACES) {
+            vec3_t axis = normal_sum;
+            if (vec3_length(axis) > 0)
+                vec3_normalize(&axis);
+            int best = -1;
+            float best_score = -INFINITY;
+            for (int k = 0; k < num_candidates; k++) {
+                face_t face = faces[candidates[k]];
+                vec3_t normal = normals[candidates[k]];
+                float dot = vec3_dot(normal, axis);
+                bool has_normal = vec3_dot(normal, normal) > 0;
+                if (num_ordered > first_face && has_normal && dot < MESHLET_MIN_FACE_DOT)
+                    continue;
+                float score = dot +
+                    (vertex_ids[position_ids[face.a]] == id) + (vertex_ids[position_ids[face.b]] == id) +
+                    (vertex_ids[position_ids[face.c]] == id);
+                if (score > best_score) {
+                    best_score = score;
+                    best = k;
+                }
+            }
+            if (best < 0)
+                break;
+
+            int f = candidates[best];
+            candidates[best] = candidates[--num_candidates];
+            is_assigned[f] = true;
+            order[num_ordered++] = f;
+            normal_sum = vec3_add(normal_sum, normals[f]);
+
+            const int corners[3] = { position_ids[faces[f].a], position_ids[faces[f].b], position_ids[faces[f].c] };
+            for (int j = 0; j < 3; j++) {
+                vertex_ids[corners[j]] = id;
+                for (int k = adjacency_offsets[corners[j]]; k < adjacency_offsets[corners[j] + 1]; k++) {
+                    int g = adjacency[k];
+                    if (!is_assigned[g] && candidate_ids[g] != id) {
+                        candidate_ids[g] = id;
+                        candidates[num_candidates++] = g;
+                    }
+                }
+            }
+        }
+
+        // Keep the faces of the cluster in the order they had, which is tuned for the vertex cache
+        qsort(order + first_face, num_ordered - first_face, sizeof(int), compare_ints);
+        meshlet_t meshlet = make_meshlet(vertices, faces, normals, order, first_face, num_ordered - first_face);
+        array_push(meshlets, meshlet);
+        if (array_length(meshlets) != id) {
+            array_free(meshlets);
+            meshlets = NULL;
+            break;
+        }
+    }
+
+    free(normals);
+    free(adjacency_offsets);
+    free(adjacency);
+    free(candidates);
+    free(candidate_ids);
+    free(vertex_ids);
+    free(is_assigned);
+    free(position_ids);
+    return meshlets;
+}
+
+//
+// Split the faces of every level of detail into clusters, reordering them so
+// each cluster is a contiguous range. Face normals are reordered along or, if
+// they do not cover every face, dropped to be computed again. Returns false
+// when out of memory, leaving the mesh without clusters; the levels already
+// reordered keep their new order, which is as good to draw from.
+//
+bool build_mesh_meshlets(mesh_t* mesh) {
+    for (int level = 0; level < MESH_MAX_LODS; level++) {
+        array_free(mesh->meshlets[level]);
+        mesh->meshlets[level] = NULL;
+    }
+
+    int num_vertices = array_length(mesh->vertices);
+    int num_levels = mesh->num_lods > 1 ? mesh->num_lods : 1;
+    for (int level = 0; level < num_levels; level++) {
+        face_t* faces = level == 0 ? mesh->faces : mesh->lods[level];
+        int num_faces = array_length(faces);
+        if (num_faces == 0)
+            continue;
+
+        bool has_normals = level == 0 && array_length(mesh->normals) == num_faces;
+        int* order = malloc(sizeof(int) * num_faces);
+        face_t* unordered = malloc(sizeof(face_t) * num_faces);
+        vec3_t* normals = has_normals ? malloc(sizeof(vec3_t) * num_faces) : NULL;
+        meshlet_t* meshlets = NULL;
+        if (order != NULL && unordered != NULL && (normals != NULL || !has_normals))
+            meshlets = partition_faces(mesh->vertices, num_vertices, faces, num_faces, order);
+        if (meshlets == NULL) {
+            free(normals);
+            free(unordered);
+            free(order);
+            for (int i = 0; i < level; i++) {
+                array_free(mesh->meshlets[i]);
+                mesh->meshlets[i] = NULL;
+            }
+            return false;
+        }
+        mesh->meshlets[level] = meshlets;
+
+        memcpy(unordered, faces, sizeof(face_t) * num_faces);
+        for (int i = 0; i < num_faces; i++) {
+            faces[i] = unordered[order[i]];
+        }
+        free(unordered);
+
+        if (has_normals) {
+            memcpy(normals, mesh->normals, sizeof(vec3_t) * num_faces);
+            for (int i = 0; i < num_faces; i++) {
+                mesh->normals[i] = normals[order[i]];
+            }
+            free(normals);
+        } else if (level == 0) {
+            array_clear(mesh->normals);
+        }
+        free(order);
+    }
+    return true;
+}
+
+//
+// The clusters of the faces the render loop draws at a level of detail, NULL
+// when the mesh has none
+//
+const meshlet_t* get_mesh_meshlets(const mesh_t* mesh, int lod, int* num_meshlets) {
+    int level = mesh->compact.num_faces == 0 && lod > 0 && lod < mesh->num_lods ? lod : 0;
+    *num_meshlets = array_length(mesh->meshlets[level]);
+    return mesh->meshlets[level];
+}
+
+//
+// Prepare the cluster test for a world view matrix. Normal cones only carry
+// over to view space when the matrix scales every axis alike.
+//
+meshlet_view_t make_meshlet_view(mat4_t world_view_matrix, bool is_backface_culled) {
+    meshlet_view_t view = { .world_view_matrix = world_view_matrix };
+
+    vec3_t axes[3];
+    float min_scale = INFINITY;
+    view.scale = 0;
+    for (int j = 0; j < 3; j++) {
+        axes[j] = vec3_new(world_view_matrix.m[0][j], world_view_matrix.m[1][j], world_view_matrix.m[2][j]);
+        float scale = vec3_length(axes[j]);
+        view.scale = fmaxf(view.scale, scale);
+        min_scale = fminf(min_scale, scale);
+    }
+
+    view.cone_sign = vec3_dot(vec3_cross(axes[0], axes[1]), axes[2]) < 0 ? -1.0f : 1.0f;
+    view.is_cone_culled = is_backface_culled && min_scale > 0 && min_scale >= view.scale * 0.999f;
+    return view;
+}
+
+//
+// Test a cluster against the view frustum and, with backface culling, against
+// its normal cone, counting the result in cull_stats
+//
+bool is_meshlet_culled(const meshlet_t* meshlet, const meshlet_view_t* view) {
+    cull_stats.num_meshlets++;
+
+    vec3_t center = vec3_from_vec4(mat4_mul_vec4(view->world_view_matrix, vec4_from_vec3(meshlet->center)));
+    float radius = meshlet->radius * view->scale;
+    if (is_sphere_outside_frustum(center, radius)) {
+        cull_stats.num_frustum_culled++;
+        return true;
+    }
+
+    if (view->is_cone_culled && meshlet->cone_cutoff < 1) {
+        // The camera sits at the view space origin
+        vec4_t axis = { meshlet->cone_axis.x, meshlet->cone_axis.y, meshlet->cone_axis.z, 0 };
+        vec3_t view_axis = vec3_from_vec4(mat4_mul_vec4(view->world_view_matrix, axis));
+        vec3_normalize(&view_axis);
+        view_axis = vec3_mul(view_axis, view->cone_sign);
+        if (vec3_dot(center, view_axis) >= meshlet->cone_cutoff * vec3_length(center) + radius) {
+            cull_stats.num_backface_culled++;
+            return true;
+        }
+    }
+    return false;
+}
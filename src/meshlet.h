@@ -0,0 +1,50 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "matrix.h"
+
+// Faces a cluster grows to before the next one starts
+#define MESHLET_MAX_FACES 64
+
+// A face only joins a cluster if its normal is within this cosine, about 45
+// degrees, of the average normal of the cluster so far
+#define MESHLET_MIN_FACE_DOT 0.7f
+
+// A cluster whose face normals spread further from its axis than this cosine
+// is never backface culled as a whole
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+//
+// Culling work of the last frame, per cluster and per face
+//
+typedef struct {
+    int num_meshlets;           // clusters tested
+    int num_frustum_culled;     // clusters outside the view frustum
+    int num_backface_culled;    // clusters facing away from the camera as a whole
+    int num_faces;              // faces tested one by one
+    int num_faces_culled;       // faces the one by one test culled
+    int num_faces_submitted;    // faces of the visible instances, before any culling
+    int num_faces_clipped;      // faces dropped for reaching in front of the near plane
+} cull_stats_t;
+
+//
+// What the cluster test needs to know about the mesh transform
+//
+typedef struct {
+    mat4_t world_view_matrix;
+    float scale;            // largest axis scale of the matrix
+    float cone_sign;        // -1 when the matrix mirrors, which flips the face normals
+    bool is_cone_culled;    // backface culling is on and the matrix keeps angles
+} meshlet_view_t;
+
+extern bool use_meshlet_culling;
+extern cull_stats_t cull_stats;
+
+bool build_mesh_meshlets(mesh_t* mesh);
+const meshlet_t* get_mesh_meshlets(const mesh_t* mesh, int lod, int* num_meshlets);
+meshlet_view_t make_meshlet_view(mat4_t world_view_matrix, bool is_backface_culled);
+bool is_meshlet_culled(const meshlet_t* meshlet, const meshlet_view_t* view);
+
+#endif
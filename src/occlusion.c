@@ -0,0 +1,246 @@
+#define _POSIX_C_SOURCE 199309L
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "array.h"
+#include "mesh_compact.h"
+#include "occlusion.h"
+#include "simd_math.h"
+
+// Draw the nearest large instances into a small depth buffer and skip the
+// instances whose bounding boxes are entirely behind what they drew
+bool use_occlusion_culling = true;
+
+occlusion_stats_t occlusion_stats;
+
+// Reciprocal view depth of the nearest occluder at every pixel, 0 where there
+// is none. Rows are a multiple of four floats, so every one starts 16 byte aligned.
+static float occlusion_buffer[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+
+void clear_occlusion_buffer(void) {
+    memset(occlusion_buffer, 0, sizeof(occlusion_buffer));
+}
+
+//
+// Distance of the near plane of a perspective projection matrix
+//
+static float get_near_depth(mat4_t projection_matrix) {
+    return -projection_matrix.m[2][3] / projection_matrix.m[2][2];
+}
+
+//
+// Move a view space point into the occlusion buffer, with its reciprocal depth as z
+//
+static vec3_t project_point(vec3_t point, mat4_t projection_matrix) {
+    vec4_t clip = mat4_mul_vec4(projection_matrix, vec4_from_vec3(point));
+    float inverse_w = 1.0f / clip.w;
+    vec3_t result = {
+        (clip.x * inverse_w + 1.0f) * (OCCLUSION_WIDTH / 2.0f),
+        (1.0f - clip.y * inverse_w) * (OCCLUSION_HEIGHT / 2.0f),
+        inverse_w
+    };
+    return result;
+}
+
+//
+// Draw a triangle into the occlusion buffer at the pixels whose centers it
+// covers, keeping the nearest depth at each. The edge functions and the
+// reciprocal depth are linear in screen space, so they are stepped from pixel
+// to pixel instead of being computed for each.
+//
+static void draw_occluder_triangle(vec3_t a, vec3_t b, vec3_t c) {
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0)
+        return;
+    if (area < 0) {
+        vec3_t swap = b;
+        b = c;
+        c = swap;
+        area = -area;
+    }
+
+    int min_x = (int)ceilf(fminf(a.x, fminf(b.x, c.x)) - 0.5f);
+    int max_x = (int)floorf(fmaxf(a.x, fmaxf(b.x, c.x)) - 0.5f);
+    int min_y = (int)ceilf(fminf(a.y, fminf(b.y, c.y)) - 0.5f);
+    int max_y = (int)floorf(fmaxf(a.y, fmaxf(b.y, c.y)) - 0.5f);
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > OCCLUSION_WIDTH - 1) max_x = OCCLUSION_WIDTH - 1;
+    if (max_y > OCCLUSION_HEIGHT - 1) max_y = OCCLUSION_HEIGHT - 1;
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    // Each edge function is the weight of the opposite vertex times the area,
+    // positive inside the triangle
+    float x = min_x + 0.5f;
+    float y = min_y + 0.5f;
+    float row_a = (c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x);
+    float row_b = (a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x);
+    float row_c = (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    float step_x_a = b.y - c.y, step_y_a = c.x - b.x;
+    float step_x_b = c.y - a.y, step_y_b = a.x - c.x;
+    float step_x_c = a.y - b.y, step_y_c = b.x - a.x;
+    float row_depth = (row_a * a.z + row_b * b.z + row_c * c.z) / area;
+    float step_x_depth = (step_x_a * a.z + step_x_b * b.z + step_x_c * c.z) / area;
+    float step_y_depth = (step_y_a * a.z + step_y_b * b.z + step_y_c * c.z) / area;
+
+    for (int j = min_y; j <= max_y; j++) {
+        float* pixels = &occlusion_buffer[j * OCCLUSION_WIDTH];
+        float edge_a = row_a;
+        float edge_b = row_b;
+        float edge_c = row_c;
+        float depth = row_depth;
+        for (int i = min_x; i <= max_x; i++) {
+            if (edge_a >= 0 && edge_b >= 0 && edge_c >= 0 && depth > pixels[i])
+                pixels[i] = depth;
+            edge_a += step_x_a;
+            edge_b += step_x_b;
+            edge_c += step_x_c;
+            depth += step_x_depth;
+        }
+        row_a += step_y_a;
+        row_b += step_y_b;
+        row_c += step_y_c;
+        row_depth += step_y_depth;
+    }
+}
+
+//
+// Draw the faces of a mesh at a level of detail into the occlusion buffer.
+// Faces are not clipped; leaving out those reaching in front of the near plane
+// only lets more instances through.
+//
+void draw_occluder(const mesh_t* mesh, int lod, mat4_t world_view_matrix, mat4_t projection_matrix) {
+    float near_depth = get_near_depth(projection_matrix);
+    mat4a_t world_view = mat4a_from_mat4(world_view_matrix);
+    int num_faces = get_mesh_num_faces(mesh, lod);
+    for (int i = 0; i < num_faces; i++) {
+        vertex_t vertices[3];
+        get_mesh_face_vertices(mesh, lod, i, vertices);
+        vec4a_t view_points[3];
+        mat4a_transform_points(&world_view, &vertices[0].position, sizeof(vertex_t), view_points, 3);
+
+        vec3_t points[3];
+        bool is_near = false;
+        for (int j = 0; j < 3 && !is_near; j++) {
+            vec3_t point = vec3_from_vec4a(view_points[j]);
+            is_near = point.z < near_depth;
+            points[j] = project_point(point, projection_matrix);
+        }
+        if (!is_near)
+            draw_occluder_triangle(points[0], points[1], points[2]);
+    }
+    occlusion_stats.num_occluder_faces += num_faces;
+}
+
+//
+// Whether an object space box is hidden behind what the occlusion buffer holds:
+// every pixel its screen rectangle touches has to hold an occluder nearer than
+// the nearest corner of the box. Occluders only cover pixels at their centers,
+// so the rectangle is grown by a pixel on every side to stay conservative.
+//
+bool is_box_occluded(vec3_t min, vec3_t max, mat4_t world_view_matrix, mat4_t projection_matrix) {
+    float near_depth = get_near_depth(projection_matrix);
+    mat4a_t world_view = mat4a_from_mat4(world_view_matrix);
+    vec3_t screen_min = { 0, 0, 0 };
+    vec3_t screen_max = { 0, 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        vec4a_t corner = vec4a_new(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1);
+        vec3_t point = vec3_from_vec4a(mat4a_mul_vec4a(&world_view, corner));
+        if (point.z < near_depth)
+            return false;
+
+        vec3_t screen = project_point(point, projection_matrix);
+        if (i == 0 || screen.x < screen_min.x) screen_min.x = screen.x;
+        if (i == 0 || screen.y < screen_min.y) screen_min.y = screen.y;
+        if (i == 0 || screen.x > screen_max.x) screen_max.x = screen.x;
+        if (i == 0 || screen.y > screen_max.y) screen_max.y = screen.y;
+        if (i == 0 || screen.z > screen_max.z) screen_max.z = screen.z;
+    }
+
+    int min_x = (int)floorf(screen_min.x) - 1;
+    int max_x = (int)floorf(screen_max.x) + 1;
+    int min_y = (int)floorf(screen_min.y) - 1;
+    int max_y = (int)floorf(screen_max.y) + 1;
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > OCCLUSION_WIDTH - 1) max_x = OCCLUSION_WIDTH - 1;
+    if (max_y > OCCLUSION_HEIGHT - 1) max_y = OCCLUSION_HEIGHT - 1;
+    if (min_x > max_x || min_y > max_y)
+        return false;
+
+    float nearest = screen_max.z;
+    for (int j = min_y; j <= max_y; j++) {
+        const float* pixels = &occlusion_buffer[j * OCCLUSION_WIDTH];
+        for (int i = min_x; i <= max_x; i++) {
+            if (pixels[i] <= nearest)
+                return false;
+        }
+    }
+    return true;
+}
+
+//
+// Whether an instance covers enough of the screen to be worth drawing as an
+// occluder, always when the camera is inside its bounding sphere
+//
+static bool is_large_occluder(const scene_t* scene, const visible_instance_t* visible, mat4_t projection_matrix) {
+    const instance_t* instance = &scene->instances[visible->instance];
+    const mesh_t* mesh = &scene->meshes[instance->mesh];
+    vec3_t center = vec3_mul(vec3_add(mesh->bounds_min, mesh->bounds_max), 0.5f);
+    float depth = mat4_mul_vec4(visible->world_view_matrix, vec4_from_vec3(center)).z;
+    if (depth <= instance->radius)
+        return true;
+    return projection_matrix.m[1][1] * instance->radius / depth >= OCCLUSION_MIN_OCCLUDER_SIZE;
+}
+
+//
+// Remove the visible instances of a scene hidden behind its nearest large
+// ones. The visible instances come sorted near to far, so the occluders are
+// the first large ones, and they are kept as they are.
+//
+void cull_occluded_instances(scene_t* scene, mat4_t projection_matrix) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&occlusion_stats, 0, sizeof(occlusion_stats));
+
+    int occluders[OCCLUSION_MAX_OCCLUDERS];
+    int num_occluders = 0;
+    int num_visible = array_length(scene->visible);
+    for (int i = 0; i < num_visible && num_occluders < OCCLUSION_MAX_OCCLUDERS; i++) {
+        if (is_large_occluder(scene, &scene->visible[i], projection_matrix))
+            occluders[num_occluders++] = i;
+    }
+    occlusion_stats.num_occluders = num_occluders;
+
+    // Nothing to draw occluders for when they are all there is
+    if (num_occluders > 0 && num_occluders < num_visible) {
+        clear_occlusion_buffer();
+        for (int i = 0; i < num_occluders; i++) {
+            const visible_instance_t* visible = &scene->visible[occluders[i]];
+            const instance_t* instance = &scene->instances[visible->instance];
+            draw_occluder(&scene->meshes[instance->mesh], instance->lod, visible->world_view_matrix, projection_matrix);
+        }
+
+        int num_kept = 0;
+        int next_occluder = 0;
+        for (int i = 0; i < num_visible; i++) {
+            visible_instance_t visible = scene->visible[i];
+            if (next_occluder < num_occluders && occluders[next_occluder] == i) {
+                next_occluder++;
+            } else {
+                const mesh_t* mesh = &scene->meshes[scene->instances[visible.instance].mesh];
+                occlusion_stats.num_tested++;
+                if (is_box_occluded(mesh->bounds_min, mesh->bounds_max, visible.world_view_matrix, projection_matrix)) {
+                    occlusion_stats.num_culled++;
+                    continue;
+                }
+            }
+            scene->visible[num_kept++] = visible;
+        }
+        array_truncate(scene->visible, num_kept);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    occlusion_stats.milliseconds = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
@@ -0,0 +1,38 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "matrix.h"
+#include "scene.h"
+
+// Size of the depth buffer occluders are drawn into, a fraction of the screen
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+
+// The nearest visible instances are drawn as occluders, at most this many
+#define OCCLUSION_MAX_OCCLUDERS 8
+
+// Instances only occlude once their bounding sphere covers this share of the screen height
+#define OCCLUSION_MIN_OCCLUDER_SIZE 0.2f
+
+//
+// Counters of the last occlusion culling pass
+//
+typedef struct {
+    int num_occluders;
+    int num_occluder_faces;
+    int num_tested;
+    int num_culled;
+    double milliseconds;
+} occlusion_stats_t;
+
+extern bool use_occlusion_culling;
+extern occlusion_stats_t occlusion_stats;
+
+void clear_occlusion_buffer(void);
+void draw_occluder(const mesh_t* mesh, int lod, mat4_t world_view_matrix, mat4_t projection_matrix);
+bool is_box_occluded(vec3_t min, vec3_t max, mat4_t world_view_matrix, mat4_t projection_matrix);
+void cull_occluded_instances(scene_t* scene, mat4_t projection_matrix);
+
+#endif
@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "profile.h"
+
+#ifdef PROFILE_ENABLED
+
+static const char* timer_names[NUM_PROFILE_TIMERS] = {
+    "wait", "update", "cull", "project", "transform", "render",
+    "draw_wire", "draw_filled", "draw_textured", "hud", "present", "upload", "clear"
+};
+
+static const char* counter_names[NUM_PROFILE_COUNTERS] = {
+    "instances", "faces", "triangles", "rasterized", "pixels"
+};
+
+// Timers called for every triangle or vertex batch are left out of traces
+static const bool is_timer_traced[NUM_PROFILE_TIMERS] = {
+    true, true, true, true, false, true,
+    false, false, false, true, true, true, true
+};
+
+// The frame being measured, and a ring of the last ones
+profile_frame_t profile_frame;
+static profile_frame_t frames[PROFILE_NUM_FRAMES];
+static int num_frames = 0;
+
+//
+// Trace events are kept in a buffer per thread, which only that thread writes.
+// A thread claims a buffer the first time it records an event, and publishes
+// each event by storing the new count, so the buffers are read without locks.
+//
+typedef struct {
+    const char* name;
+    const char* category;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int frame;
+} trace_event_t;
+
+typedef struct {
+    pthread_t thread;
+    int num_events;
+    trace_event_t events[PROFILE_MAX_TRACE_EVENTS];
+} trace_buffer_t;
+
+#define MAX_TRACE_THREADS 128
+
+static trace_buffer_t* trace_buffers[MAX_TRACE_THREADS];
+static int num_trace_buffers = 0;
+static pthread_key_t trace_buffer_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+// Frames to trace, none while the last is before the first
+static int first_trace_frame = 0;
+static int last_trace_frame = -1;
+
+// The frame being measured as seen by other threads, and when it began
+static int trace_frame = 0;
+static uint64_t frame_start_ns = 0;
+
+uint64_t get_profile_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//
+// Read the traced frame range from the environment, once for all threads
+//
+static void init_trace(void) {
+    pthread_key_create(&trace_buffer_key, NULL);
+    frame_start_ns = get_profile_ns();
+
+    const char* range = getenv(PROFILE_TRACE_FRAMES_VARIABLE);
+    if (range == NULL || range[0] == '\0')
+        return;
+
+    char* end;
+    first_trace_frame = (int) strtol(range, &end, 10);
+    last_trace_frame = first_trace_frame;
+    bool is_valid = end != range;
+    if (is_valid && *end == '-') {
+        const char* last = end + 1;
+        last_trace_frame = (int) strtol(last, &end, 10);
+        is_valid = end != last;
+    }
+    if (!is_valid || *end != '\0' || first_trace_frame < 0 || last_trace_frame < first_trace_frame) {
+        fprintf(stderr, "Error: %s should be a frame or a range like 100-119.\n", PROFILE_TRACE_FRAMES_VARIABLE);
+        last_trace_frame = -1;
+    }
+}
+
+//
+// The buffer of the calling thread, claimed on its first event. Threads past
+// the last buffer are not traced.
+//
+static trace_buffer_t* get_trace_buffer(void) {
+    trace_buffer_t* buffer = (trace_buffer_t*) pthread_getspecific(trace_buffer_key);
+    if (buffer != NULL)
+        return buffer;
+
+    int index = __atomic_fetch_add(&num_trace_buffers, 1, __ATOMIC_RELAXED);
+    if (index >= MAX_TRACE_THREADS)
+        return NULL;
+    buffer = (trace_buffer_t*) malloc(sizeof(trace_buffer_t));
+    if (buffer == NULL)
+        return NULL;
+    buffer->thread = pthread_self();
+    buffer->num_events = 0;
+    __atomic_store_n(&trace_buffers[index], buffer, __ATOMIC_RELEASE);
+    pthread_setspecific(trace_buffer_key, buffer);
+    return buffer;
+}
+
+static void record_trace_event(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns) {
+    pthread_once(&trace_once, init_trace);
+    int frame = __atomic_load_n(&trace_frame, __ATOMIC_RELAXED);
+    if (frame < first_trace_frame || frame > last_trace_frame)
+        return;
+
+    trace_buffer_t* buffer = get_trace_buffer();
+    if (buffer == NULL || buffer->num_events == PROFILE_MAX_TRACE_EVENTS)
+        return;
+    trace_event_t event = { name, category, start_ns, end_ns, frame };
+    buffer->events[buffer->num_events] = event;
+    __atomic_store_n(&buffer->num_events, buffer->num_events + 1, __ATOMIC_RELEASE);
+}
+
+//
+// Record an event of the calling thread that began at start_ns and ends now,
+// if the frame being measured is traced
+//
+void add_trace_event(const char* name, const char* category, uint64_t start_ns) {
+    record_trace_event(name, category, start_ns, get_profile_ns());
+}
+
+void add_profile_time(profile_timer_t timer, uint64_t start_ns) {
+    uint64_t end_ns = get_profile_ns();
+    profile_frame.timer_ns[timer] += end_ns - start_ns;
+    profile_frame.timer_calls[timer]++;
+    if (is_timer_traced[timer])
+        record_trace_event(timer_names[timer], "stage", start_ns, end_ns);
+}
+
+//
+// Keep the measurements of the frame in the ring and start the next one
+//
+void end_profile_frame(void) {
+    add_trace_event("frame", "frame", frame_start_ns);
+    frame_start_ns = get_profile_ns();
+
+    frames[num_frames % PROFILE_NUM_FRAMES] = profile_frame;
+    num_frames++;
+    memset(&profile_frame, 0, sizeof(profile_frame));
+    __atomic_store_n(&trace_frame, num_frames, __ATOMIC_RELAXED);
+}
+
+//
+// Write the frames in the ring, oldest first, one row each with the time and
+// calls of every timer and the counters
+//
+void write_profile_csv(void) {
+    const char* filename = getenv(PROFILE_CSV_VARIABLE);
+    if (filename == NULL || filename[0] == '\0')
+        filename = "profile.csv";
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error writing profile '%s'.\n", filename);
+        return;
+    }
+
+    fprintf(file, "frame");
+    for (int i = 0; i < NUM_PROFILE_TIMERS; i++) {
+        fprintf(file, ",%s_ms,%s_calls", timer_names[i], timer_names[i]);
+    }
+    for (int i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+        fprintf(file, ",%s", counter_names[i]);
+    }
+    fprintf(file, "\n");
+
+    int first_frame = num_frames > PROFILE_NUM_FRAMES ? num_frames - PROFILE_NUM_FRAMES : 0;
+    for (int frame = first_frame; frame < num_frames; frame++) {
+        const profile_frame_t* measured = &frames[frame % PROFILE_NUM_FRAMES];
+        fprintf(file, "%d", frame);
+        for (int i = 0; i < NUM_PROFILE_TIMERS; i++) {
+            fprintf(file, ",%.4f,%d", measured->timer_ns[i] / 1e6, measured->timer_calls[i]);
+        }
+        for (int i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+            fprintf(file, ",%lld", (long long) measured->counts[i]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    printf("Profile of the last %d frames written to %s.\n", num_frames - first_frame, filename);
+}
+
+//
+// Write the events of every thread as a Chrome trace, which about:tracing and
+// Perfetto open, with times in microseconds from the first event. Threads
+// still running jobs only have the events they finished so far written. It is
+// called from the main thread, the one that ends frames.
+//
+void write_profile_trace(void) {
+    pthread_once(&trace_once, init_trace);
+    if (last_trace_frame < 0)
+        return;
+
+    const char* filename = getenv(PROFILE_TRACE_JSON_VARIABLE);
+    if (filename == NULL || filename[0] == '\0')
+        filename = "trace.json";
+
+    int num_buffers = __atomic_load_n(&num_trace_buffers, __ATOMIC_RELAXED);
+    if (num_buffers > MAX_TRACE_THREADS)
+        num_buffers = MAX_TRACE_THREADS;
+    trace_buffer_t* buffers[MAX_TRACE_THREADS];
+    int counts[MAX_TRACE_THREADS];
+    uint64_t first_ns = UINT64_MAX;
+    for (int i = 0; i < num_buffers; i++) {
+        buffers[i] = __atomic_load_n(&trace_buffers[i], __ATOMIC_ACQUIRE);
+        counts[i] = buffers[i] != NULL ? __atomic_load_n(&buffers[i]->num_events, __ATOMIC_ACQUIRE) : 0;
+        for (int j = 0; j < counts[i]; j++) {
+            if (buffers[i]->events[j].start_ns < first_ns)
+                first_ns = buffers[i]->events[j].start_ns;
+        }
+    }
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error writing trace '%s'.\n", filename);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int num_events = 0;
+    bool is_first_thread = true;
+    for (int i = 0; i < num_buffers; i++) {
+        if (buffers[i] == NULL)
+            continue;
+        bool is_main = pthread_equal(buffers[i]->thread, pthread_self());
+        char thread_name[32];
+        if (is_main)
+            snprintf(thread_name, sizeof(thread_name), "main");
+        else
+            snprintf(thread_name, sizeof(thread_name), "worker %d", i);
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            is_first_thread ? "" : ",\n", i, thread_name);
+        is_first_thread = false;
+        for (int j = 0; j < counts[i]; j++) {
+            const trace_event_t* event = &buffers[i]->events[j];
+            fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, \"args\": {\"frame\": %d}}",
+                event->name, event->category, (event->start_ns - first_ns) / 1e3, (event->end_ns - event->start_ns) / 1e3, i, event->frame);
+        }
+        num_events += counts[i];
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Trace of frames %d to %d, %d events of %d threads, written to %s.\n",
+        first_trace_frame, last_trace_frame, num_events, num_buffers, filename);
+}
+
+#endif
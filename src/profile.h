@@ -0,0 +1,108 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// Frames kept, the oldest are overwritten
+#define PROFILE_NUM_FRAMES 256
+
+// Environment variable naming the CSV file written on exit, profile.csv by default
+#define PROFILE_CSV_VARIABLE "RENDERER_PROFILE_CSV"
+
+// Environment variables naming the frames traced, as "first-last" or a single
+// frame, and the trace file written on exit, trace.json by default. Nothing is
+// traced without the frame range.
+#define PROFILE_TRACE_FRAMES_VARIABLE "RENDERER_TRACE_FRAMES"
+#define PROFILE_TRACE_JSON_VARIABLE "RENDERER_TRACE_JSON"
+
+// Trace events kept per thread, the later ones are dropped
+#define PROFILE_MAX_TRACE_EVENTS 65536
+
+// Timers, nested ones are also counted in the time of those around them
+typedef enum {
+    TIMER_WAIT,             // Waiting for the frame target time in update()
+    TIMER_UPDATE,           // The rest of update()
+    TIMER_CULL,             // Instances culled against the view and the occluders
+    TIMER_PROJECT,          // Faces of the visible instances culled, clipped and projected
+    TIMER_TRANSFORM,        // Vertices moved to camera space, within project
+    TIMER_RENDER,           // Drawing the grid and the triangles of a frame
+    TIMER_DRAW_WIRE,        // draw_triangle(), within render
+    TIMER_DRAW_FILLED,      // draw_filled_triangle(), within render
+    TIMER_DRAW_TEXTURED,    // draw_textured_triangle(), within render
+    TIMER_HUD,              // Drawing the performance HUD over the frame
+    TIMER_PRESENT,          // render_color_buffer()
+    TIMER_UPLOAD,           // Copying the color buffer to the window texture, within present
+    TIMER_CLEAR,            // Clearing the color and z-buffers
+    NUM_PROFILE_TIMERS
+} profile_timer_t;
+
+typedef enum {
+    COUNTER_INSTANCES,      // Instances left after culling
+    COUNTER_FACES,          // Faces of those tested one by one
+    COUNTER_TRIANGLES,      // Triangles projected
+    COUNTER_RASTERIZED,     // Filled and textured triangles drawn
+    COUNTER_PIXELS,         // Pixels of their spans on the screen
+    NUM_PROFILE_COUNTERS
+} profile_counter_t;
+
+//
+// Timers and counters are only built with -DPROFILE_ENABLED. Otherwise their
+// macros expand to nothing, and a PROFILE_SCOPE block to a plain block.
+//
+//     PROFILE_SCOPE(TIMER_CLEAR) {
+//         clear_color_buffer(0xFF000000);
+//     }
+//
+// PROFILE_BEGIN and PROFILE_END time the statements between them in the same
+// block, for whole function bodies.
+//
+// Timers of whole stages are also traced, as are PROFILE_TRACE_SCOPE blocks,
+// which any thread may run, such as the thread pool jobs. Neither kind of
+// block may be left with return, break or goto.
+//
+//     PROFILE_TRACE_SCOPE("parse_obj_chunk", "job") {
+//         parse_obj_records(chunk);
+//     }
+//
+#ifdef PROFILE_ENABLED
+
+typedef struct {
+    uint64_t timer_ns[NUM_PROFILE_TIMERS];
+    int timer_calls[NUM_PROFILE_TIMERS];
+    int64_t counts[NUM_PROFILE_COUNTERS];
+} profile_frame_t;
+
+extern profile_frame_t profile_frame;
+
+uint64_t get_profile_ns(void);
+void add_profile_time(profile_timer_t timer, uint64_t start_ns);
+void add_trace_event(const char* name, const char* category, uint64_t start_ns);
+void end_profile_frame(void);
+void write_profile_csv(void);
+void write_profile_trace(void);
+
+#define PROFILE_SCOPE(timer) \
+    for (uint64_t profile_start = get_profile_ns(), profile_once = 1; profile_once; profile_once = 0, add_profile_time(timer, profile_start))
+#define PROFILE_BEGIN(timer) uint64_t profile_start_##timer = get_profile_ns()
+#define PROFILE_END(timer) add_profile_time(timer, profile_start_##timer)
+#define PROFILE_TRACE_SCOPE(name, category) \
+    for (uint64_t trace_start = get_profile_ns(), trace_once = 1; trace_once; trace_once = 0, add_trace_event(name, category, trace_start))
+#define PROFILE_COUNT(counter, amount) (profile_frame.counts[counter] += (amount))
+#define PROFILE_END_FRAME() end_profile_frame()
+#define PROFILE_WRITE_CSV() write_profile_csv()
+#define PROFILE_WRITE_TRACE() write_profile_trace()
+
+#else
+
+#define PROFILE_SCOPE(timer)
+#define PROFILE_BEGIN(timer)
+#define PROFILE_END(timer)
+#define PROFILE_TRACE_SCOPE(name, category)
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_END_FRAME()
+#define PROFILE_WRITE_CSV()
+#define PROFILE_WRITE_TRACE()
+
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#include <math.h>
+#include "quaternion.h"
+
+quat_t quat_identity(void) {
+    quat_t q = { 0, 0, 0, 1 };
+    return q;
+}
+
+//
+// Rotation by an angle in radians around a unit length axis
+//
+quat_t quat_from_axis_angle(vec3_t axis, float angle) {
+    float s = sin(angle / 2);
+    quat_t q = { axis.x * s, axis.y * s, axis.z * s, cos(angle / 2) };
+    return q;
+}
+
+//
+// Rotation by angles around the x, y and z axes, in the order the rotation
+// matrices are chained: first around z, then y, then x
+//
+quat_t quat_from_euler(vec3_t rotation) {
+    vec3_t x_axis = { 1, 0, 0 };
+    vec3_t y_axis = { 0, 1, 0 };
+    vec3_t z_axis = { 0, 0, 1 };
+    quat_t q = quat_from_axis_angle(x_axis, rotation.x);
+    q = quat_mul(q, quat_from_axis_angle(y_axis, rotation.y));
+    return quat_mul(q, quat_from_axis_angle(z_axis, rotation.z));
+}
+
+//
+// The rotation by b followed by the rotation by a
+//
+quat_t quat_mul(quat_t a, quat_t b) {
+    quat_t q = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return q;
+}
+
+//
+// Scale a quaternion back to unit length, after rounding errors of repeated
+// multiplications have built up
+//
+void quat_normalize(quat_t* q) {
+    float length = sqrt(q->x * q->x + q->y * q->y + q->z * q->z + q->w * q->w);
+    if (length > 0) {
+        q->x /= length;
+        q->y /= length;
+        q->z /= length;
+        q->w /= length;
+    }
+}
+
+//
+// Rotate a vector, as v + 2w(u x v) + 2u x (u x v) with u the vector part
+//
+vec3_t quat_rotate_vec3(quat_t q, vec3_t v) {
+    vec3_t u = { q.x, q.y, q.z };
+    vec3_t t = vec3_mul(vec3_cross(u, v), 2);
+    return vec3_add(vec3_add(v, vec3_mul(t, q.w)), vec3_cross(u, t));
+}
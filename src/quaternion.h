@@ -0,0 +1,21 @@
+#ifndef QUATERNION_H
+#define QUATERNION_H
+
+#include "vector.h"
+
+//
+// A rotation as a unit quaternion, x, y and z being the axis scaled by the
+// sine of half the angle and w the cosine of half the angle
+//
+typedef struct {
+    float x, y, z, w;
+} quat_t;
+
+quat_t quat_identity(void);
+quat_t quat_from_axis_angle(vec3_t axis, float angle);
+quat_t quat_from_euler(vec3_t rotation);
+quat_t quat_mul(quat_t a, quat_t b);
+void quat_normalize(quat_t* q);
+vec3_t quat_rotate_vec3(quat_t q, vec3_t v);
+
+#endif
@@ -0,0 +1,206 @@
+#include <math.h>
+#include "array.h"
+#include "mesh_lod.h"
+#include "scene.h"
+
+scene_t scene = {
+    .num_meshes = 0,
+    .num_textures = 0,
+    .instances = NULL,
+    .transforms = { .nodes = NULL, .changed = NULL },
+    .transform_instances = NULL,
+    .bvh = { .nodes = NULL },
+    .is_bvh_stale = false,
+    .candidates = NULL,
+    .visible = NULL
+};
+
+//
+// Reserve an empty mesh for the scene to load into, NULL when it is full
+//
+mesh_t* add_scene_mesh(scene_t* scene, int* index) {
+    if (scene->num_meshes == SCENE_MAX_MESHES)
+        return NULL;
+
+    mesh_t empty = {
+        .vertices = NULL,
+        .faces = NULL,
+        .color = 0xFFFFFFFF
+    };
+    *index = scene->num_meshes++;
+    scene->meshes[*index] = empty;
+    return &scene->meshes[*index];
+}
+
+//
+// Reserve an empty texture for the scene to load into, NULL when it is full
+//
+texture_t* add_scene_texture(scene_t* scene, int* index) {
+    if (scene->num_textures == SCENE_MAX_TEXTURES)
+        return NULL;
+
+    texture_t empty = { .texels = NULL };
+    *index = scene->num_textures++;
+    scene->textures[*index] = empty;
+    return &scene->textures[*index];
+}
+
+//
+// Add a transform node placing no instance, which the instances and groups
+// added under it move with, and return its index
+//
+int add_scene_group(scene_t* scene, int parent, vec3_t translation) {
+    int node = add_transform(&scene->transforms, parent, translation);
+    array_push(scene->transform_instances, -1);
+    return node;
+}
+
+//
+// Place a mesh and texture in the scene, under a group or at the root when the
+// parent is -1. The returned instance is only valid until the next one is added.
+//
+instance_t* add_scene_instance(scene_t* scene, int mesh, int texture, int parent, vec3_t translation) {
+    instance_t instance = {
+        .mesh = mesh,
+        .texture = texture,
+        .transform = add_transform(&scene->transforms, parent, translation),
+        .center = translation,
+        .radius = 0,
+        .lod = 0
+    };
+    array_push(scene->transform_instances, array_length(scene->instances));
+    array_push(scene->instances, instance);
+    scene->is_bvh_stale = true;
+    return &scene->instances[array_length(scene->instances) - 1];
+}
+
+//
+// Remove the instances and transform nodes added last, keeping the first ones.
+// The instances removed have to be placed by the transform nodes removed.
+//
+void truncate_scene(scene_t* scene, int num_instances, int num_transforms) {
+    truncate_transforms(&scene->transforms, num_transforms);
+    array_truncate(scene->transform_instances, num_transforms);
+    array_truncate(scene->instances, num_instances);
+    scene->is_bvh_stale = true;
+}
+
+//
+// Recompute every instance's bounds, for when meshes have been loaded since
+//
+void invalidate_scene(scene_t* scene) {
+    scene->is_bvh_stale = true;
+}
+
+//
+// Move the bounding sphere of the mesh of an instance into world space, growing
+// its radius by the largest scale of the world matrix
+//
+static void update_instance_bounds(scene_t* scene, instance_t* instance) {
+    const mesh_t* mesh = &scene->meshes[instance->mesh];
+    mat4_t world_matrix = get_world_matrix(&scene->transforms, instance->transform);
+
+    float scale = 0;
+    for (int j = 0; j < 3; j++) {
+        vec3_t axis = { world_matrix.m[0][j], world_matrix.m[1][j], world_matrix.m[2][j] };
+        scale = fmaxf(scale, vec3_length(axis));
+    }
+    vec3_t center = vec3_mul(vec3_add(mesh->bounds_min, mesh->bounds_max), 0.5f);
+    instance->center = vec3_from_vec4(mat4_mul_vec4(world_matrix, vec4_from_vec3(center)));
+    instance->radius = vec3_length(vec3_sub(mesh->bounds_max, mesh->bounds_min)) * 0.5f * scale;
+}
+
+//
+// Recompute the bounds of every instance and build the hierarchy over them again.
+// When out of memory the old hierarchy is kept and left stale, so the next
+// frame tries again.
+//
+static void rebuild_scene_bvh(scene_t* scene) {
+    int num_instances = array_length(scene->instances);
+    vec3_t* centers = array_reserve(NULL, num_instances, sizeof(vec3_t));
+    float* radii = array_reserve(NULL, num_instances, sizeof(float));
+    if (centers == NULL || radii == NULL) {
+        array_free(centers);
+        array_free(radii);
+        return;
+    }
+    for (int i = 0; i < num_instances; i++) {
+        instance_t* instance = &scene->instances[i];
+        update_instance_bounds(scene, instance);
+        centers[i] = instance->center;
+        radii[i] = instance->radius;
+    }
+    build_bvh(&scene->bvh, centers, radii, num_instances);
+    array_free(centers);
+    array_free(radii);
+    scene->is_bvh_stale = false;
+}
+
+//
+// Find the instances to draw this frame. Only the instances whose transform
+// nodes changed, or are under a group that changed, have their world matrices
+// composed again and their boxes in the hierarchy refitted, and the
+// hierarchy skips whole groups of instances outside the view, so the cost grows
+// with the instances that move or are visible rather than with all of them.
+// The world view matrix and level of detail are only worked out for the visible
+// ones, which come out sorted from near to far.
+//
+void update_scene(scene_t* scene, mat4_t view_matrix, float projection_scale) {
+    array_clear(scene->visible);
+
+    int num_instances = array_length(scene->instances);
+    if (scene->is_bvh_stale || get_bvh_num_items(&scene->bvh) != num_instances) {
+        rebuild_scene_bvh(scene);
+    } else {
+        int num_changed = array_length(scene->transforms.changed);
+        int num_transforms = array_length(scene->transforms.nodes);
+        for (int i = 0; i < num_changed; i++) {
+            // Nodes can have been removed since they changed
+            int node = scene->transforms.changed[i];
+            if (node >= num_transforms || scene->transform_instances[node] < 0)
+                continue;
+            instance_t* instance = &scene->instances[scene->transform_instances[node]];
+            update_instance_bounds(scene, instance);
+            refit_bvh_item(&scene->bvh, scene->transform_instances[node], instance->center, instance->radius);
+        }
+    }
+    array_clear(scene->transforms.changed);
+
+    scene->candidates = query_bvh_frustum(&scene->bvh, view_matrix, scene->candidates);
+    int num_candidates = array_length(scene->candidates);
+    for (int i = 0; i < num_candidates; i++) {
+        // A stale hierarchy can still hold instances removed since it was built
+        if (scene->candidates[i] >= num_instances)
+            continue;
+        instance_t* instance = &scene->instances[scene->candidates[i]];
+        const mesh_t* mesh = &scene->meshes[instance->mesh];
+        if (mesh->faces == NULL)
+            continue;
+
+        mat4_t world_matrix = scene->transforms.nodes[instance->transform].world_matrix;
+        visible_instance_t visible = { .instance = scene->candidates[i], .world_view_matrix = mat4_mul_mat4(view_matrix, world_matrix) };
+        instance->lod = use_mesh_lods ? select_mesh_lod(mesh, instance->lod, visible.world_view_matrix, projection_scale) : 0;
+        array_push(scene->visible, visible);
+    }
+}
+
+void free_scene(scene_t* scene) {
+    for (int i = 0; i < scene->num_meshes; i++) {
+        free_mesh(&scene->meshes[i]);
+    }
+    for (int i = 0; i < scene->num_textures; i++) {
+        free_texture(&scene->textures[i]);
+    }
+    array_free(scene->instances);
+    free_transform_graph(&scene->transforms);
+    array_free(scene->transform_instances);
+    free_bvh(&scene->bvh);
+    array_free(scene->candidates);
+    array_free(scene->visible);
+    scene->num_meshes = 0;
+    scene->num_textures = 0;
+    scene->instances = NULL;
+    scene->transform_instances = NULL;
+    scene->candidates = NULL;
+    scene->visible = NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "texture.h"
+#include "matrix.h"
+#include "bvh.h"
+#include "transform.h"
+
+#define SCENE_MAX_MESHES 16
+#define SCENE_MAX_TEXTURES 16
+
+//
+// A placement of a shared mesh and texture by a transform node of its own
+//
+typedef struct {
+    int mesh;               // Index into the scene meshes
+    int texture;            // Index into the scene textures, -1 for none
+    int transform;          // Index into the scene transform nodes
+    vec3_t center;          // World space bounding sphere
+    float radius;
+    int lod;                // Level of detail it was drawn at last
+} instance_t;
+
+//
+// An instance that passed culling this frame
+//
+typedef struct {
+    int instance;
+    mat4_t world_view_matrix;
+} visible_instance_t;
+
+//
+// Meshes and textures loaded once and drawn by any number of instances
+//
+typedef struct {
+    mesh_t meshes[SCENE_MAX_MESHES];
+    texture_t textures[SCENE_MAX_TEXTURES];
+    int num_meshes;
+    int num_textures;
+    instance_t* instances;          // Dynamic array
+    transform_graph_t transforms;   // Placing the instances and the groups they are in
+    int* transform_instances;       // Dynamic array, the instance every transform node places or -1
+    bvh_t bvh;                      // Over the bounding spheres of the instances
+    bool is_bvh_stale;              // Set when instances were added or meshes loaded, the hierarchy is built again
+    int* candidates;                // Dynamic array of the instances the hierarchy found in view
+    visible_instance_t* visible;    // Dynamic array rebuilt by update_scene every frame, near to far
+} scene_t;
+
+extern scene_t scene;
+
+mesh_t* add_scene_mesh(scene_t* scene, int* index);
+texture_t* add_scene_texture(scene_t* scene, int* index);
+int add_scene_group(scene_t* scene, int parent, vec3_t translation);
+instance_t* add_scene_instance(scene_t* scene, int mesh, int texture, int parent, vec3_t translation);
+void truncate_scene(scene_t* scene, int num_instances, int num_transforms);
+void invalidate_scene(scene_t* scene);
+void update_scene(scene_t* scene, mat4_t view_matrix, float projection_scale);
+void free_scene(scene_t* scene);
+
+#endif
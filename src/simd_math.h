@@ -0,0 +1,253 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <stddef.h>
+#include <math.h>
+#include "vector.h"
+#include "matrix.h"
+
+//
+// Header inline vector and matrix math on 16 byte aligned types, with SSE
+// versions used when __SSE__ is defined and SIMD_MATH_SCALAR is not. Apart
+// from the fast normalize, both versions round exactly like the functions of
+// vector.c and matrix.c: every product and sum is done in the same order,
+// and nothing is fused.
+//
+#if defined(__SSE__) && !defined(SIMD_MATH_SCALAR)
+#define SIMD_MATH_SSE 1
+#include <xmmintrin.h>
+#else
+#define SIMD_MATH_SSE 0
+#endif
+
+//
+// A vector in one SSE register. Functions named 3 only use x, y and z.
+//
+typedef struct {
+    float x, y, z, w;
+} __attribute__((aligned(16))) vec4a_t;
+
+//
+// A matrix stored by columns, so multiplying a vector is a sum of columns
+// scaled by its coordinates
+//
+typedef struct {
+    vec4a_t columns[4];
+} mat4a_t;
+
+#if SIMD_MATH_SSE
+static inline __m128 vec4a_load(vec4a_t v) {
+    return _mm_load_ps(&v.x);
+}
+
+static inline vec4a_t vec4a_store(__m128 v) {
+    vec4a_t result;
+    _mm_store_ps(&result.x, v);
+    return result;
+}
+
+// Sum of the first three lanes in the first one, x + y first and z last
+static inline __m128 sum3_ss(__m128 v) {
+    __m128 sum = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_add_ss(sum, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+#endif
+
+//
+// Conversions from and to the unaligned types
+//
+static inline vec4a_t vec4a_new(float x, float y, float z, float w) {
+    vec4a_t result = { x, y, z, w };
+    return result;
+}
+
+static inline vec4a_t vec4a_from_vec3(vec3_t v, float w) {
+    vec4a_t result = { v.x, v.y, v.z, w };
+    return result;
+}
+
+static inline vec4a_t vec4a_from_vec4(vec4_t v) {
+    vec4a_t result = { v.x, v.y, v.z, v.w };
+    return result;
+}
+
+static inline vec3_t vec3_from_vec4a(vec4a_t v) {
+    vec3_t result = { v.x, v.y, v.z };
+    return result;
+}
+
+static inline vec4_t vec4_from_vec4a(vec4a_t v) {
+    vec4_t result = { v.x, v.y, v.z, v.w };
+    return result;
+}
+
+static inline mat4a_t mat4a_from_mat4(mat4_t m) {
+    mat4a_t result;
+    for (int j = 0; j < 4; j++) {
+        result.columns[j] = vec4a_new(m.m[0][j], m.m[1][j], m.m[2][j], m.m[3][j]);
+    }
+    return result;
+}
+
+static inline mat4_t mat4_from_mat4a(const mat4a_t* m) {
+    mat4_t result;
+    for (int j = 0; j < 4; j++) {
+        result.m[0][j] = m->columns[j].x;
+        result.m[1][j] = m->columns[j].y;
+        result.m[2][j] = m->columns[j].z;
+        result.m[3][j] = m->columns[j].w;
+    }
+    return result;
+}
+
+//
+// Vector functions
+//
+static inline vec4a_t vec4a_add(vec4a_t a, vec4a_t b) {
+#if SIMD_MATH_SSE
+    return vec4a_store(_mm_add_ps(vec4a_load(a), vec4a_load(b)));
+#else
+    return vec4a_new(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+}
+
+static inline vec4a_t vec4a_sub(vec4a_t a, vec4a_t b) {
+#if SIMD_MATH_SSE
+    return vec4a_store(_mm_sub_ps(vec4a_load(a), vec4a_load(b)));
+#else
+    return vec4a_new(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+}
+
+static inline vec4a_t vec4a_mul(vec4a_t v, float factor) {
+#if SIMD_MATH_SSE
+    return vec4a_store(_mm_mul_ps(vec4a_load(v), _mm_set1_ps(factor)));
+#else
+    return vec4a_new(v.x * factor, v.y * factor, v.z * factor, v.w * factor);
+#endif
+}
+
+static inline float vec4a_dot3(vec4a_t a, vec4a_t b) {
+#if SIMD_MATH_SSE
+    return _mm_cvtss_f32(sum3_ss(_mm_mul_ps(vec4a_load(a), vec4a_load(b))));
+#else
+    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+#endif
+}
+
+// The cross product of the xyz parts, with a w of 0
+static inline vec4a_t vec4a_cross3(vec4a_t a, vec4a_t b) {
+#if SIMD_MATH_SSE
+    __m128 va = vec4a_load(a);
+    __m128 vb = vec4a_load(b);
+    __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 a_zxy = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 b_zxy = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 cross = _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+    __m128 high = _mm_movehl_ps(_mm_setzero_ps(), cross);
+    return vec4a_store(_mm_shuffle_ps(cross, high, _MM_SHUFFLE(2, 0, 1, 0)));
+#else
+    return vec4a_new(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0);
+#endif
+}
+
+// Divide by the length of the xyz part, rounding like vec3_normalize
+static inline vec4a_t vec4a_normalize3(vec4a_t v) {
+#if SIMD_MATH_SSE
+    __m128 value = vec4a_load(v);
+    __m128 length = _mm_sqrt_ss(sum3_ss(_mm_mul_ps(value, value)));
+    return vec4a_store(_mm_div_ps(value, _mm_shuffle_ps(length, length, 0)));
+#else
+    float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    return vec4a_new(v.x / length, v.y / length, v.z / length, v.w / length);
+#endif
+}
+
+//
+// Scale by an estimate of the reciprocal length of the xyz part refined by one
+// Newton step, within about 1e-6 of the exact result. Good for lighting and
+// cone tests, not for anything compared against results of vec3_normalize.
+//
+static inline vec4a_t vec4a_normalize3_fast(vec4a_t v) {
+#if SIMD_MATH_SSE
+    __m128 value = vec4a_load(v);
+    __m128 length_squared = sum3_ss(_mm_mul_ps(value, value));
+    __m128 estimate = _mm_rsqrt_ss(length_squared);
+    __m128 refined = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), estimate),
+        _mm_sub_ss(_mm_set_ss(3.0f), _mm_mul_ss(_mm_mul_ss(length_squared, estimate), estimate)));
+    return vec4a_store(_mm_mul_ps(value, _mm_shuffle_ps(refined, refined, 0)));
+#else
+    return vec4a_mul(v, 1.0f / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z));
+#endif
+}
+
+//
+// Matrix functions
+//
+static inline vec4a_t mat4a_mul_vec4a(const mat4a_t* m, vec4a_t v) {
+#if SIMD_MATH_SSE
+    __m128 value = vec4a_load(v);
+    __m128 result = _mm_mul_ps(vec4a_load(m->columns[0]), _mm_shuffle_ps(value, value, _MM_SHUFFLE(0, 0, 0, 0)));
+    result = _mm_add_ps(result, _mm_mul_ps(vec4a_load(m->columns[1]), _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 1, 1, 1))));
+    result = _mm_add_ps(result, _mm_mul_ps(vec4a_load(m->columns[2]), _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 2, 2, 2))));
+    result = _mm_add_ps(result, _mm_mul_ps(vec4a_load(m->columns[3]), _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 3, 3, 3))));
+    return vec4a_store(result);
+#else
+    const vec4a_t* c = m->columns;
+    return vec4a_new(
+        c[0].x * v.x + c[1].x * v.y + c[2].x * v.z + c[3].x * v.w,
+        c[0].y * v.x + c[1].y * v.y + c[2].y * v.z + c[3].y * v.w,
+        c[0].z * v.x + c[1].z * v.y + c[2].z * v.z + c[3].z * v.w,
+        c[0].w * v.x + c[1].w * v.y + c[2].w * v.z + c[3].w * v.w
+    );
+#endif
+}
+
+// Every column of the product is a times the same column of b
+static inline mat4a_t mat4a_mul_mat4a(const mat4a_t* a, const mat4a_t* b) {
+    mat4a_t result;
+    for (int j = 0; j < 4; j++) {
+        result.columns[j] = mat4a_mul_vec4a(a, b->columns[j]);
+    }
+    return result;
+}
+
+//
+// Batch functions over arrays, which have to be 16 byte aligned like dynamic
+// arrays are
+//
+static inline void mat4a_mul_vec4a_array(const mat4a_t* m, const vec4a_t* vectors, vec4a_t* results, int count) {
+    for (int i = 0; i < count; i++) {
+        results[i] = mat4a_mul_vec4a(m, vectors[i]);
+    }
+}
+
+// Transform points with a w of 1, stride bytes apart, such as the positions of an array of vertices
+static inline void mat4a_transform_points(const mat4a_t* m, const vec3_t* points, size_t stride, vec4a_t* results, int count) {
+    const char* point = (const char*)points;
+    for (int i = 0; i < count; i++, point += stride) {
+        results[i] = mat4a_mul_vec4a(m, vec4a_from_vec3(*(const vec3_t*)point, 1));
+    }
+}
+
+// Multiply a matrix by each of an array of matrices, a * matrices[i]
+static inline void mat4a_mul_mat4a_array(const mat4a_t* a, const mat4a_t* matrices, mat4a_t* results, int count) {
+    for (int i = 0; i < count; i++) {
+        results[i] = mat4a_mul_mat4a(a, &matrices[i]);
+    }
+}
+
+static inline void vec4a_dot3_array(const vec4a_t* a, const vec4a_t* b, float* results, int count) {
+    for (int i = 0; i < count; i++) {
+        results[i] = vec4a_dot3(a[i], b[i]);
+    }
+}
+
+static inline void vec4a_normalize3_fast_array(vec4a_t* vectors, int count) {
+    for (int i = 0; i < count; i++) {
+        vectors[i] = vec4a_normalize3_fast(vectors[i]);
+    }
+}
+
+#endif
@@ -1,20 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
 #include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
 #include "texture.h"
+#include "texture_cache.h"
+#include "kernels.h"
+#include "thread_pool.h"
+#include "profile.h"
 
-int texture_width = 64;
-int texture_height = 64;
+// Map textures from their binary cache files and write those on first load
+bool use_texture_cache = true;
 
-upng_t* png_texture = NULL;
-uint32_t* mesh_texture = NULL;
+typedef struct {
+    char* filename;
+    texture_t* texture;
+} png_decode_job_t;
 
-void load_png_texture_data(char* filename) {
-    png_texture = upng_new_from_file(filename);
-    if (png_texture != NULL) {
-        upng_decode(png_texture);
-        if (upng_get_error(png_texture) == UPNG_EOK) {
-            mesh_texture = (uint32_t*)upng_get_buffer(png_texture);
-            texture_width = upng_get_width(png_texture);
-            texture_height = upng_get_height(png_texture);
+//
+// Decode a PNG file straight into aligned texture storage. The storage is sized
+// for the inflated scanlines (one filter byte more per row), which upng unfilters
+// in place so that the texels end up at its start.
+//
+static void decode_png(const char* filename, texture_t* texture) {
+    upng_t* png = upng_new_from_file(filename);
+    if (png == NULL) {
+        return;
+    }
+
+    // The rasterizer reads whole 32-bit RGBA texels, RGB images are swizzled to that layout
+    upng_format format = upng_header(png) == UPNG_EOK ? upng_get_format(png) : UPNG_BADFORMAT;
+    if (format == UPNG_RGBA8 || format == UPNG_RGB8) {
+        int width = upng_get_width(png);
+        int height = upng_get_height(png);
+        unsigned long size = upng_get_decode_size(png);
+        if (size < (unsigned long)width * height * sizeof(uint32_t))
+            size = (unsigned long)width * height * sizeof(uint32_t);
+
+        void* storage = NULL;
+        if (posix_memalign(&storage, TEXTURE_ALIGNMENT, size) == 0) {
+            if (upng_decode_into(png, (unsigned char*)storage, size) == UPNG_EOK) {
+                if (format == UPNG_RGB8)
+                    kernels.expand_rgb_texels((unsigned char*)storage, width * height);
+                texture->texels = (uint32_t*)storage;
+                texture->width = width;
+                texture->height = height;
+                texture->num_mips = 1;
+                texture->mips[0] = texture->texels;
+            } else {
+                free(storage);
+            }
         }
     }
-}
\ No newline at end of file
+
+    if (texture->texels == NULL) {
+        fprintf(stderr, "Error: could not decode %s (upng error %d)\n", filename, upng_get_error(png));
+    }
+    upng_free(png);
+}
+
+//
+// Load one texture, preferring its texture cache file. A PNG without a valid
+// cache is decoded and the cache is written for the next run.
+//
+static void decode_png_job(void* data) {
+    png_decode_job_t* job = (png_decode_job_t*)data;
+    texture_t* texture = job->texture;
+    memset(texture, 0, sizeof(texture_t));
+
+    if (use_texture_cache && texture_cache_load(job->filename, texture)) {
+        return;
+    }
+
+    PROFILE_TRACE_SCOPE("decode_png", "job") {
+        decode_png(job->filename, texture);
+    }
+    if (use_texture_cache && texture->texels != NULL && !texture_cache_write(job->filename, texture)) {
+        fprintf(stderr, "Warning: could not write the texture cache of %s\n", job->filename);
+    }
+}
+
+//
+// Load and decode several PNG files at once. Every image is independent, so
+// each one is inflated and unfiltered by its own thread pool job.
+//
+void load_png_textures(char** filenames, texture_t* textures, int count) {
+    png_decode_job_t* jobs = (png_decode_job_t*)malloc(sizeof(png_decode_job_t) * count);
+    job_group_t group = { 0 };
+
+    for (int i = 0; i < count; i++) {
+        jobs[i].filename = filenames[i];
+        jobs[i].texture = &textures[i];
+        thread_pool_push(&group, decode_png_job, &jobs[i]);
+    }
+    thread_pool_wait(&group);
+
+    free(jobs);
+}
+
+//
+// Load one texture through its cache and report how long it took
+//
+bool load_png_texture_file(char* filename, texture_t* texture) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    load_png_textures(&filename, texture, 1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (texture->texels == NULL)
+        return false;
+
+    double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("Loaded %s in %.2f ms (%s)\n", filename, ms, texture->mapping != NULL ? "mapped from cache" : "decoded");
+    return true;
+}
+
+//
+// Replace a texture with one loaded into another, which gives up its texels
+//
+void set_texture(texture_t* texture, texture_t* loaded) {
+    free_texture(texture);
+    *texture = *loaded;
+
+    texture_t empty = { .texels = NULL };
+    *loaded = empty;
+}
+
+void free_texture(texture_t* texture) {
+    if (texture->mapping != NULL) {
+        cache_unmap(texture->mapping, texture->mapping_size);
+    } else {
+        free(texture->texels);
+    }
+    texture->texels = NULL;
+    texture->mapping = NULL;
+    texture->num_mips = 0;
+}
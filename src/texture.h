@@ -2,6 +2,8 @@
 #define TEXTURE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "upng.h"
 
 typedef struct  {
@@ -10,14 +12,25 @@ typedef struct  {
 
 } tex2_t;
 
-extern int texture_width;
-extern int texture_height;
-
-extern const uint8_t REDBRICK_TEXTURE[];
-
-extern upng_t* png_texture;
-extern uint32_t* mesh_texture;
-
-void load_png_texture_data(char* filename);
+// Texel storage is aligned for SIMD loads
+#define TEXTURE_ALIGNMENT 64
+#define TEXTURE_MAX_MIPS 16
+
+typedef struct {
+    uint32_t* texels;   // RGBA texels, TEXTURE_ALIGNMENT aligned and owned by the texture
+    int width;
+    int height;
+    int num_mips;                       // Levels in mips, level 0 is texels
+    uint32_t* mips[TEXTURE_MAX_MIPS];
+    void* mapping;                      // Texture cache file the texels live in, NULL when decoded
+    size_t mapping_size;
+} texture_t;
+
+extern bool use_texture_cache;
+
+void load_png_textures(char** filenames, texture_t* textures, int count);
+bool load_png_texture_file(char* filename, texture_t* texture);
+void set_texture(texture_t* texture, texture_t* loaded);
+void free_texture(texture_t* texture);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "texture_cache.h"
+
+static int mip_size(int size, int level) {
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+//
+// Map the cache file of a PNG and point the texture at its texels; fails if the
+// cache is missing, from another version, was written for a different PNG or
+// has a size no decoded PNG could have
+//
+bool texture_cache_load(const char* png_filename, texture_t* texture) {
+    size_t size = 0;
+    unsigned char* mapping = (unsigned char*)cache_map(png_filename, &size);
+    if (mapping == NULL)
+        return false;
+
+    const texture_cache_header_t* header = (const texture_cache_header_t*)mapping;
+    cache_source_t source;
+    bool is_valid =
+        size >= sizeof(texture_cache_header_t) &&
+        header->magic == TEXTURE_CACHE_MAGIC &&
+        header->version == TEXTURE_CACHE_VERSION &&
+        header->layout == TEXEL_LAYOUT_RGBA8 &&
+        header->width >= 1 && header->width <= INT_MAX &&
+        header->height >= 1 && header->height <= INT_MAX &&
+        header->num_mips >= 1 && header->num_mips <= TEXTURE_MAX_MIPS &&
+        cache_get_source(png_filename, &source) &&
+        cache_is_same_source(&header->source, &source);
+
+    // Every level has to lie inside the file
+    for (uint32_t level = 0; is_valid && level < header->num_mips; level++) {
+        uint64_t level_size = (uint64_t)mip_size(header->width, level) * mip_size(header->height, level) * sizeof(uint32_t);
+        is_valid = header->mip_offsets[level] % CACHE_ALIGNMENT == 0 &&
+            header->mip_offsets[level] + level_size <= size;
+    }
+
+    if (!is_valid) {
+        cache_unmap(mapping, size);
+        return false;
+    }
+
+    texture->width = header->width;
+    texture->height = header->height;
+    texture->num_mips = header->num_mips;
+    for (uint32_t level = 0; level < header->num_mips; level++) {
+        texture->mips[level] = (uint32_t*)(mapping + header->mip_offsets[level]);
+    }
+    texture->texels = texture->mips[0];
+    texture->mapping = mapping;
+    texture->mapping_size = size;
+    return true;
+}
+
+//
+// Box filter one mip level down to the next, averaging each channel of a 2x2 block
+//
+static void downsample(const uint32_t* src, int src_width, int src_height, uint32_t* dst, int dst_width, int dst_height) {
+    for (int y = 0; y < dst_height; y++) {
+        for (int x = 0; x < dst_width; x++) {
+            int x0 = x * 2, y0 = y * 2;
+            int x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+            int y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+            uint32_t a = src[y0 * src_width + x0];
+            uint32_t b = src[y0 * src_width + x1];
+            uint32_t c = src[y1 * src_width + x0];
+            uint32_t d = src[y1 * src_width + x1];
+
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+                result |= ((sum + 2) / 4) << shift;
+            }
+            dst[y * dst_width + x] = result;
+        }
+    }
+}
+
+//
+// Write the texels of a decoded texture and its whole mip chain next to the PNG
+//
+bool texture_cache_write(const char* png_filename, const texture_t* texture) {
+    texture_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    if (texture->texels == NULL || !cache_get_source(png_filename, &header.source))
+        return false;
+
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.width = texture->width;
+    header.height = texture->height;
+    header.layout = TEXEL_LAYOUT_RGBA8;
+
+    // Lay out levels down to 1x1
+    uint64_t offset = cache_align(sizeof(header));
+    int num_mips = 0;
+    while (num_mips < TEXTURE_MAX_MIPS) {
+        int width = mip_size(texture->width, num_mips);
+        int height = mip_size(texture->height, num_mips);
+        header.mip_offsets[num_mips++] = offset;
+        offset = cache_align(offset + (uint64_t)width * height * sizeof(uint32_t));
+        if (width == 1 && height == 1)
+            break;
+    }
+    header.num_mips = num_mips;
+
+    cache_writer_t writer;
+    if (!cache_begin_write(&writer, png_filename))
+        return false;
+
+    // Level 1 is the largest level that has to be generated, later levels reuse its buffer
+    uint32_t* levels[2] = { NULL, NULL };
+    levels[0] = malloc((size_t)mip_size(texture->width, 1) * mip_size(texture->height, 1) * sizeof(uint32_t));
+    levels[1] = malloc((size_t)mip_size(texture->width, 2) * mip_size(texture->height, 2) * sizeof(uint32_t));
+    writer.is_written = levels[0] != NULL && levels[1] != NULL;
+
+    cache_write(&writer, &header, sizeof(header));
+    const uint32_t* level_texels = texture->texels;
+    for (int level = 0; writer.is_written && level < num_mips; level++) {
+        int width = mip_size(texture->width, level);
+        int height = mip_size(texture->height, level);
+        if (level > 0) {
+            uint32_t* next = levels[(level - 1) % 2];
+            downsample(level_texels, mip_size(texture->width, level - 1), mip_size(texture->height, level - 1), next, width, height);
+            level_texels = next;
+        }
+        cache_write_at(&writer, header.mip_offsets[level], level_texels, (size_t)width * height * sizeof(uint32_t));
+    }
+
+    free(levels[0]);
+    free(levels[1]);
+    return cache_end_write(&writer);
+}
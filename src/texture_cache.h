@@ -0,0 +1,38 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cache.h"
+#include "texture.h"
+
+#define TEXTURE_CACHE_MAGIC 0x43584554 // "TEXC"
+#define TEXTURE_CACHE_VERSION 1
+
+//
+// Texel layouts a cache file can hold
+//
+enum texel_layout {
+    TEXEL_LAYOUT_RGBA8 = 1  // 32-bit texels in RGBA8 PNG byte order, as the rasterizer samples them
+};
+
+//
+// Header of a binary texture cache file, written next to the source PNG.
+// The source ties it to the PNG it was decoded from; every mip level starts
+// at a CACHE_ALIGNMENT aligned offset from the start of the file.
+//
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    cache_source_t source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layout;
+    uint32_t num_mips;
+    uint64_t mip_offsets[TEXTURE_MAX_MIPS];
+} texture_cache_header_t;
+
+bool texture_cache_load(const char* png_filename, texture_t* texture);
+bool texture_cache_write(const char* png_filename, const texture_t* texture);
+
+#endif
@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+#include "profile.h"
+
+#define MAX_THREADS 64
+
+typedef struct job {
+    job_func_t func;
+    void* data;
+    job_group_t* group;
+    struct job* next;
+} job_t;
+
+static pthread_t threads[MAX_THREADS];
+static int num_threads = 0;
+static bool is_stopping = false;
+
+// The mutex guards the job queue and the pending counters of every group
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+static job_t* queue_head = NULL;
+static job_t* queue_tail = NULL;
+
+//
+// Take the oldest job from the queue, the mutex must be held
+//
+static job_t* pop_job(void) {
+    job_t* job = queue_head;
+    if (job != NULL) {
+        queue_head = job->next;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+    }
+    return job;
+}
+
+//
+// Run a job without holding the mutex and signal its group when it is done
+//
+static void run_job(job_t* job) {
+    job->func(job->data);
+
+    pthread_mutex_lock(&mutex);
+    job->group->pending--;
+    pthread_cond_broadcast(&job_finished);
+    pthread_mutex_unlock(&mutex);
+
+    free(job);
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&mutex);
+    for (;;) {
+        while (queue_head == NULL && !is_stopping) {
+            pthread_cond_wait(&job_available, &mutex);
+        }
+        // Drain the queue before stopping so no group is left waiting
+        if (queue_head == NULL)
+            break;
+
+        job_t* job = pop_job();
+        pthread_mutex_unlock(&mutex);
+        run_job(job);
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+//
+// Start the worker threads, a count of 0 uses one worker per online CPU
+//
+bool thread_pool_init(int count) {
+    if (count <= 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = num_cpus > 0 ? (int)num_cpus : 1;
+    }
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+
+    is_stopping = false;
+    for (num_threads = 0; num_threads < count; num_threads++) {
+        if (pthread_create(&threads[num_threads], NULL, worker_main, NULL) != 0)
+            break;
+    }
+    return num_threads > 0;
+}
+
+int thread_pool_size(void) {
+    return num_threads;
+}
+
+//
+// Queue a job; without worker threads it runs right away on the calling thread
+//
+void thread_pool_push(job_group_t* group, job_func_t func, void* data) {
+    job_t* job = num_threads > 0 ? (job_t*)malloc(sizeof(job_t)) : NULL;
+    if (job == NULL) {
+        func(data);
+        return;
+    }
+    job->func = func;
+    job->data = data;
+    job->group = group;
+    job->next = NULL;
+
+    pthread_mutex_lock(&mutex);
+    group->pending++;
+    if (queue_tail != NULL)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&job_available);
+    pthread_mutex_unlock(&mutex);
+}
+
+bool thread_pool_is_done(job_group_t* group) {
+    pthread_mutex_lock(&mutex);
+    bool is_done = group->pending == 0;
+    pthread_mutex_unlock(&mutex);
+    return is_done;
+}
+
+//
+// Block until every job of the group has finished, running queued jobs on the
+// calling thread in the meantime so that waiting from inside a job cannot deadlock
+//
+void thread_pool_wait(job_group_t* group) {
+    PROFILE_TRACE_SCOPE("wait_jobs", "wait") {
+        pthread_mutex_lock(&mutex);
+        while (group->pending > 0) {
+            job_t* job = pop_job();
+            if (job != NULL) {
+                pthread_mutex_unlock(&mutex);
+                run_job(job);
+                pthread_mutex_lock(&mutex);
+            } else {
+                pthread_cond_wait(&job_finished, &mutex);
+            }
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+void thread_pool_destroy(void) {
+    pthread_mutex_lock(&mutex);
+    is_stopping = true;
+    pthread_cond_broadcast(&job_available);
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    num_threads = 0;
+}
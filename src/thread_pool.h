@@ -0,0 +1,23 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+
+typedef void (*job_func_t)(void* data);
+
+//
+// A group counts the jobs that were pushed with it and have not finished yet,
+// so callers can wait on (or poll) just the work they submitted
+//
+typedef struct {
+    int pending;
+} job_group_t;
+
+bool thread_pool_init(int num_threads);
+int thread_pool_size(void);
+void thread_pool_push(job_group_t* group, job_func_t func, void* data);
+bool thread_pool_is_done(job_group_t* group);
+void thread_pool_wait(job_group_t* group);
+void thread_pool_destroy(void);
+
+#endif
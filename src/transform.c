@@ -0,0 +1,93 @@
+#include "array.h"
+#include "transform.h"
+
+//
+// Add a node with no scale or rotation under a parent, or as a root when the
+// parent is -1, and return its index
+//
+int add_transform(transform_graph_t* graph, int parent, vec3_t translation) {
+    int node = array_length(graph->nodes);
+    transform_t transform = {
+        .scale = { 1.0, 1.0, 1.0 },
+        .rotation = quat_identity(),
+        .translation = translation,
+        .parent = parent,
+        .first_child = -1,
+        .next_sibling = parent >= 0 ? graph->nodes[parent].first_child : -1,
+        .is_dirty = true
+    };
+    array_push(graph->nodes, transform);
+    array_push(graph->changed, node);
+    if (parent >= 0)
+        graph->nodes[parent].first_child = node;
+    return node;
+}
+
+void set_transform_scale(transform_graph_t* graph, int node, vec3_t scale) {
+    graph->nodes[node].scale = scale;
+    mark_transform_dirty(graph, node);
+}
+
+void set_transform_rotation(transform_graph_t* graph, int node, quat_t rotation) {
+    graph->nodes[node].rotation = rotation;
+    mark_transform_dirty(graph, node);
+}
+
+void set_transform_translation(transform_graph_t* graph, int node, vec3_t translation) {
+    graph->nodes[node].translation = translation;
+    mark_transform_dirty(graph, node);
+}
+
+//
+// Mark the world matrices of a node and everything under it as stale. Nodes
+// already dirty have dirty descendants too, so the walk stops at them.
+//
+void mark_transform_dirty(transform_graph_t* graph, int node) {
+    transform_t* transform = &graph->nodes[node];
+    if (transform->is_dirty)
+        return;
+    transform->is_dirty = true;
+    array_push(graph->changed, node);
+
+    for (int child = transform->first_child; child >= 0; child = graph->nodes[child].next_sibling) {
+        mark_transform_dirty(graph, child);
+    }
+}
+
+//
+// The world matrix of a node, composed again only if it is dirty: its own
+// scale, rotation and translation in one matrix, under the world matrix of
+// its parent
+//
+mat4_t get_world_matrix(transform_graph_t* graph, int node) {
+    transform_t* transform = &graph->nodes[node];
+    if (transform->is_dirty) {
+        mat4_t local_matrix = mat4_make_transform(transform->scale, transform->rotation, transform->translation);
+        if (transform->parent >= 0)
+            local_matrix = mat4_mul_mat4(get_world_matrix(graph, transform->parent), local_matrix);
+        transform->world_matrix = local_matrix;
+        transform->is_dirty = false;
+    }
+    return transform->world_matrix;
+}
+
+//
+// Remove the nodes added last, leaving the first num_nodes. Newer children come
+// first in the list of their parent, so removing from the newest node on always
+// takes the first child off the list.
+//
+void truncate_transforms(transform_graph_t* graph, int num_nodes) {
+    for (int node = array_length(graph->nodes) - 1; node >= num_nodes; node--) {
+        int parent = graph->nodes[node].parent;
+        if (parent >= 0 && parent < num_nodes)
+            graph->nodes[parent].first_child = graph->nodes[node].next_sibling;
+    }
+    array_truncate(graph->nodes, num_nodes);
+}
+
+void free_transform_graph(transform_graph_t* graph) {
+    array_free(graph->nodes);
+    array_free(graph->changed);
+    graph->nodes = NULL;
+    graph->changed = NULL;
+}
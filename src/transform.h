@@ -0,0 +1,42 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "quaternion.h"
+
+//
+// A node of the transform hierarchy: a scale, rotation and translation
+// relative to its parent, and the world matrix they add up to, cached until
+// the node or one of its ancestors changes
+//
+typedef struct {
+    vec3_t scale;
+    quat_t rotation;
+    vec3_t translation;
+    int parent;             // -1 for roots
+    int first_child;        // -1 without children, the newest child first
+    int next_sibling;       // -1 for the oldest child
+    bool is_dirty;          // The world matrix is stale
+    mat4_t world_matrix;
+} transform_t;
+
+//
+// Transform nodes, parents always before their children
+//
+typedef struct {
+    transform_t* nodes;     // Dynamic array
+    int* changed;           // Dynamic array of the nodes made dirty since it was last emptied
+} transform_graph_t;
+
+int add_transform(transform_graph_t* graph, int parent, vec3_t translation);
+void set_transform_scale(transform_graph_t* graph, int node, vec3_t scale);
+void set_transform_rotation(transform_graph_t* graph, int node, quat_t rotation);
+void set_transform_translation(transform_graph_t* graph, int node, vec3_t translation);
+void mark_transform_dirty(transform_graph_t* graph, int node);
+mat4_t get_world_matrix(transform_graph_t* graph, int node);
+void truncate_transforms(transform_graph_t* graph, int num_nodes);
+void free_transform_graph(transform_graph_t* graph);
+
+#endif
@@ -1,146 +1,56 @@
 #include "display.h"
 #include "swap.h"
 #include "triangle.h"
+#include "kernels.h"
+#include "profile.h"
 
-/*
-// Return the barycentric weights alpha, beta, and gamma for point p
-//
-//
-//          A
-//         /|\
-//        / | \
-//       /  |  \
-//      /  (p)  \
-//     /  /   \  \
-//    / /       \ \
-//   B-------------C
-//
-*/
-vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
-    // Find the vectors between the vertices ABC and point p
-    vec2_t ab = vec2_sub(b, a);
-    vec2_t bc = vec2_sub(c, b);
-    vec2_t ac = vec2_sub(c, a);
-    vec2_t ap = vec2_sub(p, a);
-    vec2_t bp = vec2_sub(p, b);
-
-    // Calcualte the area of the full triangle ABC using cross product (area of parallelogram)
-    float area_triangle_abc = (ab.x * ac.y - ab.y * ac.x);
-
-    // Weight alpha is the area of subtriangle BCP divided by the area of the full triangle ABC
-    float alpha = (bc.x * bp.y - bp.x * bc.y) / area_triangle_abc;
-
-    // Weight beta is the area of subtriangle ACP divided by the area of the full triangle ABC
-    float beta = (ap.x * ac.y - ac.x * ap.y) / area_triangle_abc;
-
-    // Weight gamma is easily found since barycentric cooordinates always add up to 1
-    float gamma = 1 - alpha - beta;
-
-    vec3_t weights = { alpha, beta, gamma };
-    return weights;
-}
+raster_stats_t raster_stats;
 
 //
 // Draw a triangle using three lines
 //
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
+    PROFILE_BEGIN(TIMER_DRAW_WIRE);
     draw_line(x0, y0, x1, y1, color);
     draw_line(x1, y1, x2, y2, color);
     draw_line(x2, y2, x0, y0, color);
+    PROFILE_END(TIMER_DRAW_WIRE);
 } 
 
 //
-// Function to draw a solid pixel at position x and y using depth interpolation
+// Leave out the pixels of a span off the screen, since triangles are not clipped
 //
-void draw_triangle_pixel(
-	int x, int y, uint32_t color,
-	vec4_t point_a, vec4_t point_b, vec4_t point_c
-) {
-	vec2_t p = { x, y };
-	vec2_t a = vec2_from_vec4(point_a);
-	vec2_t b = vec2_from_vec4(point_b);
-	vec2_t c = vec2_from_vec4(point_c);
-	
-	vec3_t weights = barycentric_weights(a, b, c, p);
-
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
-
-	// Interpolate the value of 1/w for the current pixel -- this can be optimized to be calculated outside of this function
-	float interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
-
-	// Adjust 1/w so that pixels that are close to the camera have smaller values
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
-	
-	// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-	if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]) {
-		// Darw a pixel at postion (x, y) with the color that comes from the mapped texture
-		draw_pixel(x, y, color);
-
-		// Update the z-buffer value with the 1/w of this current pixel
-		z_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
-	}
+static bool clip_span(int y, int* x_start, int* x_end) {
+	if (y < 0 || y >= window_height)
+		return false;
+	if (*x_start < 0)
+		*x_start = 0;
+	if (*x_end > window_width)
+		*x_end = window_width;
+	return *x_start < *x_end;
 }
 
 //
-// Function to draw a textured pixel at position x and y using depth interpolation
+// Draw the pixels x_start to x_end - 1 of row y with the span kernels, each
+// only if it is nearer than the depth in the z-buffer
 //
-void draw_triangle_texel(
-	int x, int y, uint32_t* texture,
+static void draw_filled_span(int y, int x_start, int x_end, uint32_t color, vec4_t point_a, vec4_t point_b, vec4_t point_c) {
+	if (clip_span(y, &x_start, &x_end)) {
+		int row = window_width * y;
+		raster_stats.num_pixels += x_end - x_start;
+		kernels.draw_filled_span(&color_buffer[row], &z_buffer[row], y, x_start, x_end, color, point_a, point_b, point_c);
+	}
+}
+
+static void draw_textured_span(
+	int y, int x_start, int x_end, const texture_t* texture,
 	vec4_t point_a, vec4_t point_b, vec4_t point_c,
 	tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
 ) {
-	vec2_t p = { x, y };
-	vec2_t a = vec2_from_vec4(point_a);
-	vec2_t b = vec2_from_vec4(point_b);
-	vec2_t c = vec2_from_vec4(point_c);
-	
-	vec3_t weights = barycentric_weights(a, b, c, p);
-
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
-
-	// Variables to store interpolated values of U, V and 1/w for the current pixel
-	float interpolated_u;
-	float interpolated_v;
-	float interpolated_reciprocal_w;
-
-	// Perform interpolation of all U/w and V/w values using barycentric weights and a factor of 1/w
-	// P = (alpha * A) + (beta * B) + (gamme * C)
-	interpolated_u = (a_uv.u / point_a.w) * alpha + (b_uv.u / point_b.w) * beta + (c_uv.u / point_c.w) * gamma;
-	interpolated_v = (a_uv.v / point_a.w) * alpha + (b_uv.v / point_b.w) * beta + (c_uv.v / point_c.w) * gamma;
-
-	// Interpolate the value of 1/w for the current pixel -- this can be optimized to be calculated outside of this function
-	interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
-
-	// Now we can divide back both interpolated values by 1/w
-	interpolated_u /= interpolated_reciprocal_w;
-	interpolated_v /= interpolated_reciprocal_w;
-
-	// Map the UV coordinate to the full texture width and height
-	int tex_x = abs((int)(interpolated_u * texture_width));
-	int tex_y = abs((int)(interpolated_v * texture_height));
-
-	// Causes seg fault on y rotation due to texture buffer overflow
-	// This equation ends up generating index values for REDBRICK_TEXTURE that are >= 4096.
-    // This is a problem because we can only access 64*64 (4096) elements when using indexing for uint32_t, hence the crash.
-    // draw_pixel(x, y, texture[(texture_width * tex_y) + tex_x]);
-    
-	// Use modulo function to prevent texture buffer overflow
-    int tex_index = ((texture_width * tex_y) + tex_x) % (texture_width * texture_height);
-
-	// Adjust 1/w so that pixels that are close to the camera have smaller values
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
-	
-	// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-	if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]) {
-		// Darw a pixel at postion (x, y) with the color that comes from the mapped texture
-		draw_pixel(x, y, texture[tex_index]);
-
-		// Update the z-buffer value with the 1/w of this current pixel
-		z_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
+	if (clip_span(y, &x_start, &x_end)) {
+		int row = window_width * y;
+		raster_stats.num_pixels += x_end - x_start;
+		kernels.draw_textured_span(&color_buffer[row], &z_buffer[row], y, x_start, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
 	}
 }
 
@@ -172,6 +82,9 @@ void draw_filled_triangle(
 	int x2, int y2, float z2, float w2,
 	uint32_t color
 ) {
+	PROFILE_BEGIN(TIMER_DRAW_FILLED);
+	raster_stats.num_triangles++;
+
 	// We need to sort the vertices by y-coordinate ascending (y0 < y1 < y2)
 	if (y0 > y1) {
 		int_swap(&y0, &y1);
@@ -217,10 +130,8 @@ void draw_filled_triangle(
                 int_swap(&x_start, &x_end); // swap if x_start is to the right of x_end
             }
 
-            for (int x = x_start; x < x_end; x++) {
-                // Draw pixel with a solid colour
-				draw_triangle_pixel(x, y, color,  point_a, point_b, point_c);
-            }
+            // Draw the pixels with a solid colour
+            draw_filled_span(y, x_start, x_end, color, point_a, point_b, point_c);
         }
     }
 
@@ -241,13 +152,11 @@ void draw_filled_triangle(
 			if (x_end < x_start) 
 				int_swap(&x_end, &x_start); // swap if x_start is to the right of x_end
 
-			for (int x = x_start; x < x_end; x++) {
-				// Draw pixel with a solid colour
-				draw_triangle_pixel(x, y, color,  point_a, point_b, point_c);
-			}
+			// Draw the pixels with a solid colour
+			draw_filled_span(y, x_start, x_end, color, point_a, point_b, point_c);
 		}
 	}
-	
+	PROFILE_END(TIMER_DRAW_FILLED);
 }
 
 /*
@@ -277,8 +186,11 @@ void draw_textured_triangle(
 	int x0, int y0, float z0, float w0, float u0, float v0,
 	int x1, int y1, float z1, float w1, float u1, float v1,
 	int x2, int y2, float z2, float w2, float u2, float v2,
-	uint32_t* texture
+	const texture_t* texture
 ) {
+	PROFILE_BEGIN(TIMER_DRAW_TEXTURED);
+	raster_stats.num_triangles++;
+
 	// We need to sort the vertices by y-coordinate ascending (y0 < y1 < y2)
 	if (y0 > y1) {
 		int_swap(&y0, &y1);
@@ -338,10 +250,8 @@ void draw_textured_triangle(
                 int_swap(&x_start, &x_end); // swap if x_start is to the right of x_end
             }
 
-            for (int x = x_start; x < x_end; x++) {
-                // Draw pixel with the colour that comes form the texture
-				draw_triangle_texel(x, y, texture,  point_a, point_b, point_c, a_uv, b_uv, c_uv);
-            }
+            // Draw the pixels with the colour that comes form the texture
+            draw_textured_span(y, x_start, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
         }
     }
 
@@ -362,10 +272,9 @@ void draw_textured_triangle(
 			if (x_end < x_start) 
 				int_swap(&x_end, &x_start); // swap if x_start is to the right of x_end
 
-			for (int x = x_start; x < x_end; x++) {
-				// Draw pixel with the colour that comes form the texture
-				draw_triangle_texel(x, y, texture,  point_a, point_b, point_c, a_uv, b_uv, c_uv);
-			}
+			// Draw the pixels with the colour that comes form the texture
+			draw_textured_span(y, x_start, x_end, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
 		}
 	}
+	PROFILE_END(TIMER_DRAW_TEXTURED);
 }
\ No newline at end of file
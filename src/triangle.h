@@ -5,7 +5,26 @@
 #include "vector.h"
 #include "texture.h"
 
-// Stores vertex index
+// A mesh vertex, shared by every face corner with the same position and texture coordinate
+typedef struct {
+	vec3_t position;
+	tex2_t uv;
+} vertex_t;
+
+// A vertex of a compact mesh, quantized to 16 bits per component within the mesh bounds
+typedef struct {
+	uint16_t x, y, z;
+	uint16_t u, v;
+} compact_vertex_t;
+
+// Stores the vertex indices of a triangle
+typedef struct {
+	int a;
+	int b;
+	int c;
+} face_t;
+
+// A face as it is authored, with a position index and texture coordinate per corner
 typedef struct {
 	int a;
 	int b;
@@ -13,16 +32,26 @@ typedef struct {
 	tex2_t a_uv;
 	tex2_t b_uv;
 	tex2_t c_uv;
-	uint32_t color;
-} face_t;
+} uv_face_t;
 
 // Stores the actual vec4 point of the triangle in the screen
 typedef struct {
 	vec4_t points[3];
 	tex2_t texcoords[3];
 	uint32_t color;
+	const texture_t* texture;	// NULL draws the triangle filled in textured modes
 } triangle_t;
 
+//
+// Rasterization work of the last frame
+//
+typedef struct {
+	int num_triangles;	// filled and textured triangles drawn
+	long num_pixels;	// pixels of their spans on the screen, before the depth test
+} raster_stats_t;
+
+extern raster_stats_t raster_stats;
+
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 void draw_filled_triangle(
 	int x0, int y0, float z0, float w0,
@@ -34,7 +63,7 @@ void draw_textured_triangle(
 	int x0, int y0, float z0, float w0, float u0, float v0,
 	int x1, int y1, float z1, float w1, float u1, float v1,
 	int x2, int y2, float z2, float w2, float u2, float v2,
-	uint32_t* texture
+	const texture_t* texture
 );
 
 #endif
\ No newline at end of file
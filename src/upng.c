@@ -27,12 +27,44 @@ freely, subject to the following restrictions:
 Modification notice 2/1/2022 Ivan Fourie
 
 Removed unused variable `data` in function upng_decode
+
+Modification notice 19/10/2026
+
+Replaced the bit-at-a-time Huffman tree decoder with a table driven inflater
+(two level lookup tables, 64-bit bit buffer, memcpy match copies). The original
+decoder is still available by defining UPNG_LEGACY_INFLATE.
+
+Added SSE2 scanline unfiltering for 3 and 4 byte pixels, used when __SSE2__ is defined
+unless upng_set_sse2(0) turned it off.
+
+Added upng_decode_into to decode into caller owned memory. IDAT chunks are inflated
+straight from the source instead of being concatenated, scanlines are unfiltered in
+place and files are memory mapped where available (define UPNG_NO_MMAP to disable).
 */
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(UPNG_NO_MMAP)
+#define UPNG_USE_MMAP
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+
+#if defined(UPNG_USE_MMAP)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "upng.h"
 
@@ -81,6 +113,12 @@ typedef enum upng_color {
 	UPNG_RGBA		= 6
 } upng_color;
 
+typedef enum upng_owning {
+	UPNG_BORROWED	= 0,	/* the caller owns the source buffer */
+	UPNG_ALLOCATED	= 1,	/* the source buffer was read into malloc'ed memory */
+	UPNG_MAPPED		= 2		/* the source buffer is a read-only mapping of the file */
+} upng_owning;
+
 typedef struct upng_source {
 	const unsigned char*	buffer;
 	unsigned long			size;
@@ -103,6 +141,8 @@ struct upng_t {
 
 	upng_state		state;
 	upng_source		source;
+
+	unsigned long	scratch_peak;
 };
 
 typedef struct huffman_tree {
@@ -134,6 +174,34 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
+/* check the two byte zlib header in front of the deflate data */
+static upng_error uz_check_header(upng_t* upng, unsigned cmf, unsigned flg)
+{
+	/* 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way */
+	if ((cmf * 256 + flg) % 31 != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec */
+	if ((cmf & 15) != 8 || ((cmf >> 4) & 15) > 7) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary." */
+	if (((flg >> 5) & 1) != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	return upng->error;
+}
+
+#if defined(UPNG_LEGACY_INFLATE)
+
+/* Reference inflater that walks the Huffman trees one bit at a time, kept to benchmark the table driven one against */
+
 static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
 	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
 	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
@@ -477,6 +545,9 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
 		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
 		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+	} else {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
 	}
 
 	while (done == 0) {
@@ -542,7 +613,7 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 			start = (*pos);
 			backward = start - distance;
 
-			if ((*pos) + length >= outsize) {
+			if ((*pos) + length > outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
@@ -587,7 +658,7 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
+	if ((*pos) + len > outsize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
@@ -653,30 +724,589 @@ static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long out
 		return upng->error;
 	}
 
-	/* 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way */
-	if ((in[0] * 256 + in[1]) % 31 != 0) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
+	if (uz_check_header(upng, in[0], in[1]) != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec */
-	if ((in[0] & 15) != 8 || ((in[0] >> 4) & 15) > 7) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
+	/* create output buffer */
+	uz_inflate_data(upng, out, outsize, in, insize, 2);
+
+	return upng->error;
+}
+
+/*inflate the IDAT chunks starting at chunk, after concatenating their payloads into one buffer*/
+static upng_error inflate_idat(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char* chunk)
+{
+	const unsigned char* source_end = upng->source.buffer + upng->source.size;
+	const unsigned char* first = chunk;
+	unsigned char* compressed;
+	unsigned long compressed_size = 0, compressed_index = 0;
+
+	/* the chunks were validated by upng_decode, IDAT chunks are consecutive */
+	for (chunk = first; chunk + 12 <= source_end && upng_chunk_type(chunk) == CHUNK_IDAT; chunk += upng_chunk_length(chunk) + 12) {
+		compressed_size += upng_chunk_length(chunk);
+	}
+
+	/* allocate enough space for the (compressed and filtered) image data */
+	compressed = (unsigned char*)malloc(compressed_size);
+	if (compressed == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
+	upng->scratch_peak += compressed_size;
 
-	/* the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary." */
-	if (((in[1] >> 5) & 1) != 0) {
+	for (chunk = first; chunk + 12 <= source_end && upng_chunk_type(chunk) == CHUNK_IDAT; chunk += upng_chunk_length(chunk) + 12) {
+		memcpy(compressed + compressed_index, chunk + 8, upng_chunk_length(chunk));
+		compressed_index += upng_chunk_length(chunk);
+	}
+
+	uz_inflate(upng, out, outsize, compressed, compressed_size);
+	free(compressed);
+
+	return upng->error;
+}
+
+#else /* !defined(UPNG_LEGACY_INFLATE) */
+
+/*
+Table driven inflater. Huffman codes are resolved with a two level lookup table
+(HUFFMAN_PRIMARY_BITS bits in the first level, second level tables for longer
+codes) instead of walking a tree one bit at a time, and input bits come from a
+64-bit buffer that is refilled a whole word at a time. The bit reader walks the
+IDAT chunks of the source itself, so their payloads are never concatenated.
+*/
+
+#define HUFFMAN_PRIMARY_BITS 10	/* bits resolved by the first level of a decoding table */
+#define HUFFMAN_TABLE_SIZE 2048	/* first level plus the second level tables of any complete deflate code */
+#define HUFFMAN_LENGTH_MASK 0xFF	/* entry bits holding the code length (or the second level table bits) */
+#define HUFFMAN_SUBTABLE 0x100	/* entry flag: the entry links to a second level table */
+
+/* a table entry is (symbol << 16) | length for a code, or (offset << 16) | HUFFMAN_SUBTABLE | bits for a link; 0 is an unused code */
+typedef struct huffman_table {
+	unsigned entries[HUFFMAN_TABLE_SIZE];
+	unsigned primary_bits;
+} huffman_table;
+
+typedef struct bit_reader {
+	const unsigned char* next;	/* next byte to load into the bit buffer */
+	const unsigned char* end;	/* end of the current IDAT payload */
+	const unsigned char* chunk;	/* chunk following the current payload */
+	const unsigned char* source_end;	/* end of the PNG data */
+	uint64_t buffer;	/* loaded bits, the next bit to consume is the lsb */
+	unsigned count;	/* number of bits in buffer that have not been consumed */
+	unsigned long overrun;	/* number of zero bytes loaded past the end of the input */
+} bit_reader;
+
+/* move on to the payload of the next non-empty IDAT chunk; IDAT chunks are consecutive, so any other chunk ends the data */
+static int bit_reader_next_chunk(bit_reader* br)
+{
+	while (br->chunk + 12 <= br->source_end && upng_chunk_type(br->chunk) == CHUNK_IDAT) {
+		unsigned long length = upng_chunk_length(br->chunk);
+		br->next = br->chunk + 8;
+		br->end = br->next + length;
+		br->chunk = br->end + 4;	/* skip the CRC */
+		if (length > 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* start reading at the payload of chunk, which must be a validated IDAT chunk */
+static void bit_reader_init(bit_reader* br, const unsigned char* chunk, const unsigned char* source_end)
+{
+	br->next = br->end = chunk;
+	br->chunk = chunk;
+	br->source_end = source_end;
+	bit_reader_next_chunk(br);
+	br->buffer = 0;
+	br->count = 0;
+	br->overrun = 0;
+}
+
+static uint64_t load_le64(const unsigned char* p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+#else
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+#endif
+}
+
+/* top the bit buffer up to at least 56 bits; past the end of the input it is filled with zeros */
+static void bit_reader_refill(bit_reader* br)
+{
+	if (br->end - br->next >= 8) {
+		/* load a whole word, but only advance over the bytes that fit; the bits above count are the bytes at next, so loading them again is harmless */
+		br->buffer |= load_le64(br->next) << br->count;
+		br->next += (63 - br->count) >> 3;
+		br->count |= 56;
+	} else {
+		while (br->count <= 56) {
+			uint64_t byte = 0;
+			if (br->next < br->end || bit_reader_next_chunk(br)) {
+				byte = *br->next++;
+			} else {
+				br->overrun++;
+			}
+			br->buffer |= byte << br->count;
+			br->count += 8;
+		}
+	}
+}
+
+/* true when bits past the end of the input have been consumed */
+static int bit_reader_overrun(const bit_reader* br)
+{
+	return br->overrun * 8 > br->count;
+}
+
+/* consume n bits (n <= 32) that are already in the buffer */
+static unsigned bit_reader_take(bit_reader* br, unsigned n)
+{
+	unsigned result = (unsigned)(br->buffer & (((uint64_t)1 << n) - 1));
+	br->buffer >>= n;
+	br->count -= n;
+	return result;
+}
+
+static unsigned bit_reader_bits(bit_reader* br, unsigned n)
+{
+	if (br->count < n) {
+		bit_reader_refill(br);
+	}
+	return bit_reader_take(br, n);
+}
+
+static unsigned reverse_bits(unsigned code, unsigned length)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < length; i++) {
+		result = (result << 1) | ((code >> i) & 1);
+	}
+	return result;
+}
+
+/*given the code lengths (as stored in the PNG file), generate the decoding table as defined by Deflate. return value is error.*/
+static void huffman_table_create(upng_t* upng, huffman_table* table, const unsigned* bitlen, unsigned numcodes, unsigned primary_bits)
+{
+	unsigned codes[MAX_SYMBOLS];	/* bit reversed code of every symbol, as it appears in the stream */
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned subbits[1 << HUFFMAN_PRIMARY_BITS];	/* index bits of the second level table hanging off each first level entry */
+	unsigned primary_size = 1u << primary_bits;
+	unsigned primary_mask = primary_size - 1;
+	unsigned used = primary_size;
+	long left = 1;
+	unsigned bits, n, i;
+
+	memset(blcount, 0, sizeof(blcount));
+	memset(nextcode, 0, sizeof(nextcode));
+	memset(subbits, 0, primary_size * sizeof(unsigned));
+	memset(table->entries, 0, primary_size * sizeof(unsigned));
+	table->primary_bits = primary_bits;
+
+	/*step 1: count number of instances of each code length */
+	for (n = 0; n < numcodes; n++) {
+		blcount[bitlen[n]]++;
+	}
+	blcount[0] = 0;
+
+	/* an oversubscribed code is malformed; an incomplete one only fails if an unused code shows up */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		left = (left << 1) - (long)blcount[bits];
+		if (left < 0) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+	}
+
+	/*step 2: generate the nextcode values */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+	}
+
+	/*step 3: generate all the codes, reversed since deflate stores them msb first */
+	for (n = 0; n < numcodes; n++) {
+		if (bitlen[n] != 0) {
+			codes[n] = reverse_bits(nextcode[bitlen[n]]++, bitlen[n]);
+			if (bitlen[n] > primary_bits && bitlen[n] - primary_bits > subbits[codes[n] & primary_mask]) {
+				subbits[codes[n] & primary_mask] = bitlen[n] - primary_bits;
+			}
+		}
+	}
+
+	/*step 4: lay out the second level tables behind the first level */
+	for (i = 0; i < primary_size; i++) {
+		if (subbits[i] != 0) {
+			unsigned size = 1u << subbits[i];
+			if (used + size > HUFFMAN_TABLE_SIZE) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+			memset(table->entries + used, 0, size * sizeof(unsigned));
+			table->entries[i] = (used << 16) | HUFFMAN_SUBTABLE | subbits[i];
+			used += size;
+		}
+	}
+
+	/*step 5: fill every entry whose low bits match a code */
+	for (n = 0; n < numcodes; n++) {
+		unsigned length = bitlen[n];
+		if (length == 0) {
+			continue;
+		} else if (length <= primary_bits) {
+			for (i = codes[n]; i < primary_size; i += 1u << length) {
+				table->entries[i] = (n << 16) | length;
+			}
+		} else {
+			unsigned link = table->entries[codes[n] & primary_mask];
+			unsigned offset = link >> 16;
+			unsigned size = 1u << (link & HUFFMAN_LENGTH_MASK);
+			for (i = codes[n] >> primary_bits; i < size; i += 1u << (length - primary_bits)) {
+				table->entries[offset + i] = (n << 16) | length;
+			}
+		}
+	}
+}
+
+/* decode one symbol; the caller makes sure the buffer holds at least MAX_BIT_LENGTH bits */
+static unsigned huffman_decode_symbol(upng_t *upng, bit_reader* br, const huffman_table* table)
+{
+	unsigned entry = table->entries[br->buffer & ((1u << table->primary_bits) - 1)];
+	unsigned length;
+
+	if (entry & HUFFMAN_SUBTABLE) {
+		unsigned index = (unsigned)(br->buffer >> table->primary_bits) & ((1u << (entry & HUFFMAN_LENGTH_MASK)) - 1);
+		entry = table->entries[(entry >> 16) + index];
+	}
+
+	length = entry & HUFFMAN_LENGTH_MASK;
+	if (length == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+
+	br->buffer >>= length;
+	br->count -= length;
+	return entry >> 16;
+}
+
+/* get the tables of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD, bit_reader* br)
+{
+	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
+	unsigned lengths[NUM_DEFLATE_CODE_SYMBOLS + NUM_DISTANCE_SYMBOLS];
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned hlit, hdist, hclen, i;
+	huffman_table* codelengthcodetree;
+
+	bit_reader_refill(br);
+	hlit = bit_reader_take(br, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = bit_reader_take(br, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = bit_reader_take(br, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+
+	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
+		codelengthcode[CLCL[i]] = i < hclen ? bit_reader_bits(br, 3) : 0;
+	}
+
+	/* the code length code is only needed until the real tables are built, borrow the distance table for it */
+	codelengthcodetree = codetreeD;
+	huffman_table_create(upng, codelengthcodetree, codelengthcode, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	/*now we can use this tree to read the lengths for the tree that this function will return */
+	i = 0;
+	while (i < hlit + hdist) {
+		unsigned code, replength, value = 0;
+
+		bit_reader_refill(br);
+		code = huffman_decode_symbol(upng, br, codelengthcodetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		if (code <= 15) {	/*a length code */
+			lengths[i++] = code;
+			continue;
+		} else if (code == 16) {	/*repeat previous 3-6 times */
+			if (i == 0) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+			replength = 3 + bit_reader_take(br, 2);
+			value = lengths[i - 1];
+		} else if (code == 17) {	/*repeat "0" 3-10 times */
+			replength = 3 + bit_reader_take(br, 3);
+		} else if (code == 18) {	/*repeat "0" 11-138 times */
+			replength = 11 + bit_reader_take(br, 7);
+		} else {
+			/* somehow an unexisting code appeared. This can never happen. */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		/* error: i would become larger than the amount of codes */
+		if (i + replength > hlit + hdist) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+		while (replength-- > 0) {
+			lengths[i++] = value;
+		}
+	}
+
+	if (bit_reader_overrun(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	/*the length of the end code 256 must be larger than 0 */
+	if (lengths[256] == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	/*now we've finally got hlit and hdist, so generate the code tables, and the function is done */
+	memset(bitlen, 0, sizeof(bitlen));
+	memset(bitlenD, 0, sizeof(bitlenD));
+	memcpy(bitlen, lengths, hlit * sizeof(unsigned));
+	memcpy(bitlenD, lengths + hlit, hdist * sizeof(unsigned));
+
+	huffman_table_create(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS, HUFFMAN_PRIMARY_BITS);
+	if (upng->error == UPNG_EOK) {
+		huffman_table_create(upng, codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS, HUFFMAN_PRIMARY_BITS);
+	}
+}
+
+static void get_tree_inflate_fixed(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD)
+{
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned i;
+
+	for (i = 0; i < NUM_DEFLATE_CODE_SYMBOLS; i++) {
+		bitlen[i] = i <= 143 ? 8 : i <= 255 ? 9 : i <= 279 ? 7 : 8;
+	}
+	for (i = 0; i < NUM_DISTANCE_SYMBOLS; i++) {
+		bitlenD[i] = 5;
+	}
+
+	huffman_table_create(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS, HUFFMAN_PRIMARY_BITS);
+	huffman_table_create(upng, codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS, HUFFMAN_PRIMARY_BITS);
+}
+
+/* copy a match of length bytes from distance bytes back; the source may overlap the destination */
+static void copy_match(unsigned char* out, unsigned long distance, unsigned long length)
+{
+	const unsigned char* src = out - distance;
+
+	if (distance >= length) {
+		memcpy(out, src, length);
+	} else if (distance == 1) {
+		memset(out, *src, length);
+	} else {
+		/* the output repeats every distance bytes, so copy it in non-overlapping pieces that double each time */
+		while (length > 0) {
+			unsigned long span = (unsigned long)(out - src);
+			unsigned long n = span < length ? span : length;
+			memcpy(out, src, n);
+			out += n;
+			length -= n;
+		}
+	}
+}
+
+/*inflate a block with dynamic of fixed Huffman tree*/
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos, unsigned btype)
+{
+	huffman_table codetree;
+	huffman_table codetreeD;
+
+	if (btype == 1) {
+		get_tree_inflate_fixed(upng, &codetree, &codetreeD);
+	} else {
+		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, br);
+	}
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	for (;;) {
+		unsigned code, codeD;
+		unsigned long length, distance;
+
+		/* 56 bits cover the longest length code, its extra bits, the longest distance code and its extra bits */
+		bit_reader_refill(br);
+		code = huffman_decode_symbol(upng, br, &codetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		if (code <= 255) {
+			/* literal symbol */
+			if ((*pos) >= outsize) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+			out[(*pos)++] = (unsigned char)code;
+			continue;
+		}
+
+		if (code == 256) {
+			/* end code */
+			break;
+		}
+
+		if (code > LAST_LENGTH_CODE_INDEX) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX] + bit_reader_take(br, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
+
+		codeD = huffman_decode_symbol(upng, br, &codetreeD);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		/* invalid distance code (30-31 are never used) */
+		if (codeD > 29) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		distance = DISTANCE_BASE[codeD] + bit_reader_take(br, DISTANCE_EXTRA[codeD]);
+
+		/* the match must start inside the output and end inside the buffer */
+		if (distance > (*pos) || (*pos) + length > outsize) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		copy_match(out + (*pos), distance, length);
+		(*pos) += length;
+	}
+
+	if (bit_reader_overrun(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+}
+
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos)
+{
+	unsigned len, nlen;
+
+	/* go to first boundary of byte */
+	bit_reader_take(br, br->count & 7);
+
+	/* read len (2 bytes) and nlen (2 bytes) */
+	len = bit_reader_bits(br, 16);
+	nlen = bit_reader_bits(br, 16);
+
+	/* check if 16-bit nlen is really the one's complement of len */
+	if (len + nlen != 65535 || bit_reader_overrun(br)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	if ((*pos) + len > outsize) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	/* the first literal bytes may already sit in the bit buffer */
+	while (len > 0 && br->count >= 8) {
+		out[(*pos)++] = (unsigned char)bit_reader_take(br, 8);
+		len--;
+	}
+
+	if (len == 0) {
+		return;
+	}
+
+	/* the rest is copied straight from the input; the buffer is empty, drop the look-ahead bits it still holds */
+	br->buffer = 0;
+	while (len > 0) {
+		unsigned long n;
+		if (br->next == br->end && !bit_reader_next_chunk(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		n = (unsigned long)(br->end - br->next);
+		if (n > len) {
+			n = len;
+		}
+		memcpy(out + (*pos), br->next, n);
+		br->next += n;
+		(*pos) += n;
+		len -= n;
+	}
+}
+
+/*inflate the zlib stream spread over the IDAT chunks starting at chunk; return value is the error*/
+static upng_error inflate_idat(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char* chunk)
+{
+	bit_reader br;
+	unsigned long pos = 0;	/*byte position in the out buffer */
+	unsigned done = 0;
+	unsigned cmf, flg;
+
+	bit_reader_init(&br, chunk, upng->source.buffer + upng->source.size);
+
+	/* we require two bytes for the zlib data header */
+	cmf = bit_reader_bits(&br, 8);
+	flg = bit_reader_bits(&br, 8);
+	if (bit_reader_overrun(&br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+	if (uz_check_header(upng, cmf, flg) != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/* create output buffer */
-	uz_inflate_data(upng, out, outsize, in, insize, 2);
+	while (done == 0) {
+		unsigned btype;
+
+		/* ensure next bit doesn't point past the end of the buffer */
+		bit_reader_refill(&br);
+		if (br.overrun * 8 >= br.count) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return upng->error;
+		}
+
+		/* read block control bits */
+		done = bit_reader_take(&br, 1);
+		btype = bit_reader_take(&br, 2);
+
+		/* process control type appropriateyly */
+		if (btype == 3) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return upng->error;
+		} else if (btype == 0) {
+			inflate_uncompressed(upng, out, outsize, &br, &pos);	/*no compression */
+		} else {
+			inflate_huffman(upng, out, outsize, &br, &pos, btype);	/*compression, btype 01 or 10 */
+		}
+
+		/* stop if an error has occured */
+		if (upng->error != UPNG_EOK) {
+			return upng->error;
+		}
+	}
 
 	return upng->error;
 }
 
+#endif /* defined(UPNG_LEGACY_INFLATE) */
+
 /*Paeth predicter, used by PNG filter type 4*/
 static int paeth_predictor(int a, int b, int c)
 {
@@ -693,6 +1323,110 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
+#if defined(__SSE2__)
+/*
+SSE2 versions of the Sub, Average and Paeth filters for 3 and 4 byte pixels.
+The filters depend on the pixel to the left, so they work one pixel at a time
+with every channel in its own lane, after the filters in libpng's
+intel/filter_sse2_intrinsics.c.
+*/
+
+static __m128i load_pixel(const unsigned char* p, unsigned long bytewidth)
+{
+	int value = 0;
+	memcpy(&value, p, bytewidth);
+	return _mm_cvtsi32_si128(value);
+}
+
+static void store_pixel(unsigned char* p, __m128i v, unsigned long bytewidth)
+{
+	int value = _mm_cvtsi128_si32(v);
+	memcpy(p, &value, bytewidth);
+}
+
+static void unfilter_sub_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long bytewidth, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		a = _mm_add_epi8(a, load_pixel(scanline + i, bytewidth));
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+static void unfilter_average_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		__m128i b = load_pixel(precon + i, bytewidth);
+		/* _mm_avg_epu8 rounds up, (a + b) / 2 rounds down: subtract the odd bit back out */
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(average, load_pixel(scanline + i, bytewidth));
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+static __m128i abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i select_epi16(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void unfilter_paeth_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;	/* left and upper left pixels, widened to 16 bits */
+	unsigned long i;
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(precon + i, bytewidth), zero);
+		__m128i d = _mm_unpacklo_epi8(load_pixel(scanline + i, bytewidth), zero);
+
+		/* with p = a + b - c: |p - a| = |b - c|, |p - b| = |a - c| and |p - c| = |(b - c) + (a - c)| */
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = abs_epi16(_mm_add_epi16(pa, pb));
+		__m128i smallest, predictor;
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+
+		/* ties are broken in favour of a, then b, then c */
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		predictor = select_epi16(_mm_cmpeq_epi16(smallest, pa), a, select_epi16(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		/* the 8-bit add wraps modulo 256 without carrying into the zero high bytes */
+		a = _mm_add_epi8(d, predictor);
+		store_pixel(recon + i, _mm_packus_epi16(a, a), bytewidth);
+		c = b;
+	}
+}
+
+static void unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+		_mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+	}
+	for (; i < length; i++) {
+		recon[i] = scanline[i] + precon[i];
+	}
+}
+#endif
+
+static int use_sse2 = 1;
+
+void upng_set_sse2(int enabled)
+{
+	use_sse2 = enabled;
+}
+
 static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
 	/*
@@ -704,6 +1438,29 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	 */
 
 	unsigned long i;
+
+#if defined(__SSE2__)
+	/* whole pixel SSE2 filters; the first scanline has no precon and is left to the scalar code */
+	if (use_sse2 && precon != NULL && filterType != 0) {
+		if (filterType == 2) {
+			unfilter_up_sse2(recon, scanline, precon, length);
+			return;
+		} else if (bytewidth == 3 || bytewidth == 4) {
+			switch (filterType) {
+			case 1:
+				unfilter_sub_sse2(recon, scanline, bytewidth, length);
+				return;
+			case 3:
+				unfilter_average_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			case 4:
+				unfilter_paeth_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			}
+		}
+	}
+#endif
+
 	switch (filterType) {
 	case 0:
 		for (i = 0; i < length; i++)
@@ -888,9 +1645,14 @@ static upng_format determine_format(upng_t* upng) {
 
 static void upng_free_source(upng_t* upng)
 {
-	if (upng->source.owning != 0) {
+	if (upng->source.owning == UPNG_ALLOCATED) {
 		free((void*)upng->source.buffer);
 	}
+#if defined(UPNG_USE_MMAP)
+	if (upng->source.owning == UPNG_MAPPED) {
+		munmap((void*)upng->source.buffer, upng->source.size);
+	}
+#endif
 
 	upng->source.buffer = NULL;
 	upng->source.size = 0;
@@ -965,150 +1727,164 @@ upng_error upng_header(upng_t* upng)
 	return upng->error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-upng_error upng_decode(upng_t* upng)
+/*scan through the chunks, verifying their well-formedness; returns the first IDAT chunk*/
+static const unsigned char* upng_find_idat(upng_t* upng)
 {
 	const unsigned char *chunk;
-	unsigned char* compressed;
-	unsigned char* inflated;
-	unsigned long compressed_size = 0, compressed_index = 0;
-	unsigned long inflated_size;
-	upng_error error;
-
-	/* if we have an error state, bail now */
-	if (upng->error != UPNG_EOK) {
-		return upng->error;
-	}
-
-	/* parse the main header, if necessary */
-	upng_header(upng);
-	if (upng->error != UPNG_EOK) {
-		return upng->error;
-	}
-
-	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
-	if (upng->state != UPNG_HEADER) {
-		return upng->error;
-	}
-
-	/* release old result, if any */
-	if (upng->buffer != 0) {
-		free(upng->buffer);
-		upng->buffer = 0;
-		upng->size = 0;
-	}
+	const unsigned char *idat = NULL;
 
 	/* first byte of the first chunk after the header */
 	chunk = upng->source.buffer + 33;
 
-	/* scan through the chunks, finding the size of all IDAT chunks, and also
-	 * verify general well-formed-ness */
 	while (chunk < upng->source.buffer + upng->source.size) {
 		unsigned long length;
-		// const unsigned char *data;	/*the data in the chunk */ // IF: This variable was set but not used
 
 		/* make sure chunk header is not larger than the total compressed */
 		if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			return NULL;
 		}
 
 		/* get length; sanity check it */
 		length = upng_chunk_length(chunk);
 		if (length > INT_MAX) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			return NULL;
 		}
 
 		/* make sure chunk header+paylaod is not larger than the total compressed */
 		if ((unsigned long)(chunk - upng->source.buffer + length + 12) > upng->source.size) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			return NULL;
 		}
 
-		/* get pointer to payload */
-		// data = chunk + 8; // IF: This variable was set but not used
-
 		/* parse chunks */
 		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			compressed_size += length;
+			if (idat == NULL) {
+				idat = chunk;
+			}
 		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
 			break;
 		} else if (upng_chunk_critical(chunk)) {
 			SET_ERROR(upng, UPNG_EUNSUPPORTED);
-			return upng->error;
+			return NULL;
 		}
 
 		chunk += upng_chunk_length(chunk) + 12;
 	}
 
-	/* allocate enough space for the (compressed and filtered) image data */
-	compressed = (unsigned char*)malloc(compressed_size);
-	if (compressed == NULL) {
-		SET_ERROR(upng, UPNG_ENOMEM);
+	if (idat == NULL) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+	return idat;
+}
+
+/*inflate and unfilter the image into out, which holds upng_get_decode_size() bytes; the image ends up at the start of out*/
+static upng_error upng_decode_buffer(upng_t* upng, unsigned char* out)
+{
+	const unsigned char *idat = upng_find_idat(upng);
+	if (idat == NULL) {
 		return upng->error;
 	}
 
-	/* scan through the chunks again, this time copying the values into
-	 * our compressed buffer.  there's no reason to validate anything a second time. */
-	chunk = upng->source.buffer + 33;
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
+	/* decompress image data, filter bytes included */
+	if (inflate_idat(upng, out, upng_get_decode_size(upng), idat) != UPNG_EOK) {
+		return upng->error;
+	}
 
-		length = upng_chunk_length(chunk);
-		data = chunk + 8;
+	/* unfilter scanlines in place, each row moves down over the filter bytes of the rows before it */
+	post_process_scanlines(upng, out, out, upng);
+	return upng->error;
+}
 
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			memcpy(compressed + compressed_index, data, length);
-			compressed_index += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		}
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+upng_error upng_decode(upng_t* upng)
+{
+	unsigned long decode_size;
 
-		chunk += upng_chunk_length(chunk) + 12;
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
 	}
 
-	/* allocate space to store inflated (but still filtered) data */
-	inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
-	inflated = (unsigned char*)malloc(inflated_size);
-	if (inflated == NULL) {
-		free(compressed);
-		SET_ERROR(upng, UPNG_ENOMEM);
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/* decompress image data */
-	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
-	if (error != UPNG_EOK) {
-		free(compressed);
-		free(inflated);
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
 		return upng->error;
 	}
 
-	/* free the compressed compressed data */
-	free(compressed);
+	/* release old result, if any */
+	if (upng->buffer != 0) {
+		free(upng->buffer);
+		upng->buffer = 0;
+		upng->size = 0;
+	}
 
-	/* allocate final image buffer */
-	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
-	upng->buffer = (unsigned char*)malloc(upng->size);
+	/* allocate a buffer that can hold the inflated (but still filtered) data, the image is unfiltered in place */
+	decode_size = upng_get_decode_size(upng);
+	upng->buffer = (unsigned char*)malloc(decode_size);
 	if (upng->buffer == NULL) {
-		free(inflated);
-		upng->size = 0;
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
 
-	/* unfilter scanlines */
-	post_process_scanlines(upng, upng->buffer, inflated, upng);
-	free(inflated);
+	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
+	upng->scratch_peak = decode_size - upng->size;
+	upng_decode_buffer(upng, upng->buffer);
 
 	if (upng->error != UPNG_EOK) {
 		free(upng->buffer);
 		upng->buffer = NULL;
 		upng->size = 0;
 	} else {
+		/* drop the space the filter bytes took */
+		unsigned char* buffer = (unsigned char*)realloc(upng->buffer, upng->size);
+		if (buffer != NULL) {
+			upng->buffer = buffer;
+		}
+		upng->state = UPNG_DECODED;
+	}
+
+	/* we are done with our input buffer; free it if we own it */
+	upng_free_source(upng);
+
+	return upng->error;
+}
+
+/*read a PNG into memory owned by the caller; out must hold upng_get_decode_size() bytes and receives the image at its start*/
+upng_error upng_decode_into(upng_t* upng, unsigned char* out, unsigned long size)
+{
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
+		return upng->error;
+	}
+
+	if (out == NULL || size < upng_get_decode_size(upng)) {
+		SET_ERROR(upng, UPNG_EPARAM);
+		return upng->error;
+	}
+
+	upng->scratch_peak = 0;
+	upng_decode_buffer(upng, out);
+
+	if (upng->error == UPNG_EOK) {
+		upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
 		upng->state = UPNG_DECODED;
 	}
 
@@ -1141,6 +1917,8 @@ static upng_t* upng_new(void)
 	upng->error = UPNG_EOK;
 	upng->error_line = 0;
 
+	upng->scratch_peak = 0;
+
 	upng->source.buffer = NULL;
 	upng->source.size = 0;
 	upng->source.owning = 0;
@@ -1157,7 +1935,7 @@ upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
 
 	upng->source.buffer = buffer;
 	upng->source.size = size;
-	upng->source.owning = 0;
+	upng->source.owning = UPNG_BORROWED;
 
 	return upng;
 }
@@ -1174,6 +1952,27 @@ upng_t* upng_new_from_file(const char *filename)
 		return NULL;
 	}
 
+#if defined(UPNG_USE_MMAP)
+	/* map the file instead of copying it, fall back to reading it below */
+	{
+		int fd = open(filename, O_RDONLY);
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping != MAP_FAILED) {
+				close(fd);
+				upng->source.buffer = (const unsigned char*)mapping;
+				upng->source.size = (unsigned long)st.st_size;
+				upng->source.owning = UPNG_MAPPED;
+				return upng;
+			}
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+#endif
+
 	file = fopen(filename, "rb");
 	if (file == NULL) {
 		SET_ERROR(upng, UPNG_ENOTFOUND);
@@ -1198,7 +1997,7 @@ upng_t* upng_new_from_file(const char *filename)
 	/* set the read buffer as our source buffer, with owning flag set */
 	upng->source.buffer = buffer;
 	upng->source.size = size;
-	upng->source.owning = 1;
+	upng->source.owning = UPNG_ALLOCATED;
 
 	return upng;
 }
@@ -1284,3 +2083,14 @@ unsigned upng_get_size(const upng_t* upng)
 {
 	return upng->size;
 }
+
+unsigned long upng_get_decode_size(const upng_t* upng)
+{
+	/* every scanline is preceded by its filter type byte */
+	return (unsigned long)upng->height * (1 + ((unsigned long)upng->width * upng_get_bpp(upng) + 7) / 8);
+}
+
+unsigned long upng_get_scratch_peak(const upng_t* upng)
+{
+	return upng->scratch_peak;
+}
@@ -64,6 +64,10 @@ void		upng_free			(upng_t* upng);
 upng_error	upng_header			(upng_t* upng);
 upng_error	upng_decode			(upng_t* upng);
 
+/* decode into out, which must hold upng_get_decode_size() bytes (the image plus one filter byte per scanline);
+ * the image ends up at the start of out and upng_get_buffer() stays NULL */
+upng_error	upng_decode_into	(upng_t* upng, unsigned char* out, unsigned long size);
+
 upng_error	upng_get_error		(const upng_t* upng);
 unsigned	upng_get_error_line	(const upng_t* upng);
 
@@ -78,4 +82,12 @@ upng_format	upng_get_format		(const upng_t* upng);
 const unsigned char*	upng_get_buffer		(const upng_t* upng);
 unsigned				upng_get_size		(const upng_t* upng);
 
+/* buffer size upng_decode_into() needs, valid once upng_header() succeeded */
+unsigned long			upng_get_decode_size	(const upng_t* upng);
+/* most heap memory the last decode held besides the source data and the decoded image */
+unsigned long			upng_get_scratch_peak	(const upng_t* upng);
+
+/* turn the SSE2 scanline filters of every decoder off (0) or back on, for CPUs or measurements without them */
+void					upng_set_sse2			(int enabled);
+
 #endif /*defined(UPNG_H)*/